@@ -0,0 +1,157 @@
+/*
+ * dlbench.c --
+ *
+ * Test functions for measuring the overhead of wrapped functions.
+ *
+ *-----------------------------------------------------------------------------
+ *
+ * Copyright (C) 2011-2015: Éric Thiébaut <https://github.com/emmt>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+/*
+ * This shared library provides trivial functions to measure the overhead of
+ * calling compiled functions through the wrappers of the plugin (see
+ * dlbench.i).  There is one function for each type of argument and result
+ * supported by dlwrap() and functions taking from 0 to 14 integer or
+ * floating-point arguments.  All functions are as simple as possible so
+ * that their execution time is negligible compared to the cost of calling
+ * them.
+ */
+
+#include <stddef.h>
+
+typedef struct { double re, im; } dlbench_complex_t;
+typedef struct { double x, y; } dlbench_point_t;
+
+/* Scalar arguments and results. */
+void dlbench_void(void) { }
+char dlbench_char(char a) { return a; }
+short dlbench_short(short a) { return a; }
+int dlbench_int(int a) { return a; }
+long dlbench_long(long a) { return a; }
+float dlbench_float(float a) { return a; }
+double dlbench_double(double a) { return a; }
+dlbench_complex_t dlbench_complex(dlbench_complex_t a) { return a; }
+const char *dlbench_string(const char *a) { return a; }
+long dlbench_pointer(void *a) { return (a != NULL); }
+
+/* Array arguments. */
+long dlbench_char_array(char *a) { return (long)a[0]; }
+long dlbench_short_array(short *a) { return (long)a[0]; }
+long dlbench_int_array(int *a) { return (long)a[0]; }
+long dlbench_long_array(long *a) { return a[0]; }
+long dlbench_float_array(float *a) { return (long)a[0]; }
+long dlbench_double_array(double *a) { return (long)a[0]; }
+long dlbench_complex_array(double *a) { return (long)a[0]; }
+long dlbench_string_array(char **a) { return (a[0] != NULL); }
+long dlbench_pointer_array(void **a) { return (a[0] != NULL); }
+
+/* Array results (of a given number of elements). */
+static double dlbench_data[16];
+double *dlbench_double_result(long n) { return (n > 0 ? dlbench_data : NULL); }
+
+/* Output and input/output arguments. */
+void dlbench_char_out(char *a) { *a = 1; }
+void dlbench_short_out(short *a) { *a = 1; }
+void dlbench_int_out(int *a) { *a = 1; }
+void dlbench_long_out(long *a) { *a = 1; }
+void dlbench_float_out(float *a) { *a = 1; }
+void dlbench_double_out(double *a) { *a = 1; }
+void dlbench_complex_out(dlbench_complex_t *a) { a->re = 1; a->im = 0; }
+void dlbench_int_inout(int *a) { *a += 1; }
+void dlbench_double_inout(double *a) { *a += 1; }
+
+/* Structures passed by value. */
+dlbench_point_t dlbench_struct(dlbench_point_t a) { return a; }
+
+/* Number of arguments: dlbench_longN and dlbench_doubleN take N arguments
+   of type long or double and return their sum. */
+#define ARGS0(T)  void
+#define ARGS1(T)  T a1
+#define ARGS2(T)  ARGS1(T), T a2
+#define ARGS3(T)  ARGS2(T), T a3
+#define ARGS4(T)  ARGS3(T), T a4
+#define ARGS5(T)  ARGS4(T), T a5
+#define ARGS6(T)  ARGS5(T), T a6
+#define ARGS7(T)  ARGS6(T), T a7
+#define ARGS8(T)  ARGS7(T), T a8
+#define ARGS9(T)  ARGS8(T), T a9
+#define ARGS10(T) ARGS9(T), T a10
+#define ARGS11(T) ARGS10(T), T a11
+#define ARGS12(T) ARGS11(T), T a12
+#define ARGS13(T) ARGS12(T), T a13
+#define ARGS14(T) ARGS13(T), T a14
+#define SUM0  0
+#define SUM1  a1
+#define SUM2  SUM1 + a2
+#define SUM3  SUM2 + a3
+#define SUM4  SUM3 + a4
+#define SUM5  SUM4 + a5
+#define SUM6  SUM5 + a6
+#define SUM7  SUM6 + a7
+#define SUM8  SUM7 + a8
+#define SUM9  SUM8 + a9
+#define SUM10 SUM9 + a10
+#define SUM11 SUM10 + a11
+#define SUM12 SUM11 + a12
+#define SUM13 SUM12 + a13
+#define SUM14 SUM13 + a14
+#define DEFINE(T, N) T dlbench_##T##N(ARGS##N(T)) { return SUM##N; }
+DEFINE(long, 0)
+DEFINE(long, 1)
+DEFINE(long, 2)
+DEFINE(long, 3)
+DEFINE(long, 4)
+DEFINE(long, 5)
+DEFINE(long, 6)
+DEFINE(long, 7)
+DEFINE(long, 8)
+DEFINE(long, 9)
+DEFINE(long, 10)
+DEFINE(long, 11)
+DEFINE(long, 12)
+DEFINE(long, 13)
+DEFINE(long, 14)
+DEFINE(double, 0)
+DEFINE(double, 1)
+DEFINE(double, 2)
+DEFINE(double, 3)
+DEFINE(double, 4)
+DEFINE(double, 5)
+DEFINE(double, 6)
+DEFINE(double, 7)
+DEFINE(double, 8)
+DEFINE(double, 9)
+DEFINE(double, 10)
+DEFINE(double, 11)
+DEFINE(double, 12)
+DEFINE(double, 13)
+DEFINE(double, 14)
+#undef DEFINE
+
+/*
+ * Local Variables:
+ * mode: C
+ * tab-width: 8
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * fill-column: 79
+ * coding: utf-8
+ * ispell-local-dictionary: "american"
+ * End:
+ */
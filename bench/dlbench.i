@@ -0,0 +1,332 @@
+/*
+ * dlbench.i --
+ *
+ * Benchmark of the overhead of calling compiled functions with the plugin.
+ *
+ *-----------------------------------------------------------------------------
+ *
+ * Copyright (C) 2011-2015: Éric Thiébaut <https://github.com/emmt>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+/*
+ * This script is run by "make bench" as:
+ *
+ *     yorick -batch bench/dlbench.i LIBRARY OUTPUT
+ *
+ * with LIBRARY the shared library built from "dlbench.c" and OUTPUT the name
+ * of the file where to write the results.  In batch mode, the plugin is
+ * searched first in the current directory (the build directory) and
+ * "dlwrap.i" is taken from the source directory.  The script can also be
+ * included in an interactive session to use function dlbench.
+ */
+
+if (batch()) {
+  _dlbench_srcdir = current_include();
+  _dlbench_srcdir = strpart(_dlbench_srcdir,
+                            1:strfind("/bench/dlbench.i", _dlbench_srcdir,
+                                      back=1)(1));
+  plug_dir, _(".", plug_dir());
+  include, _dlbench_srcdir + "/dlwrap.i", 1;
+} else {
+  require, "dlwrap.i";
+}
+
+struct dlbench_point { double x, y; }
+
+func dlbench(lib, output, number=, repeat=)
+/* DOCUMENT dlbench, lib;
+         or dlbench, lib, output;
+
+     Measure the overhead of calling the functions of the shared library
+     LIB (built from "dlbench.c") with the wrappers of the plugin.  Each
+     benchmark calls a wrapped function NUMBER times (100,000 by default)
+     in an interpreted loop and the best time of REPEAT runs (5 by default)
+     is kept.  The time of an empty loop is subtracted.  The time of a
+     direct call to a built-in function (is_void) is measured for reference.
+     Every function is wrapped with and without the DL_JIT attribute.  The
+     benchmarks are run for every combination of the available loaders and
+     backends (see dlvariant), LIB being opened once by each loader.
+
+     The results are printed and, if OUTPUT is specified, written in this
+     file with one line per benchmark and the following tab-separated
+     fields:
+
+       variant - the implementation used to load LIB (member loader of the
+                 module, "-" for a built-in function);
+       backend - the generic machinery of the wrapper (member backend of
+                 the wrapped function: "ffcall" or "libffi", "-" for a
+                 built-in function);
+       name    - the name of the benchmark;
+       attr    - "jit" if the function has been wrapped with DL_JIT, "-"
+                 otherwise;
+       path    - how the function has been called (see member path in
+                 dlwrap), "builtin" for a built-in function;
+       nargs   - the number of arguments;
+       ns      - the overhead of a call in nanoseconds.
+
+     The first line of the file gives the names of the fields.  Results
+     obtained with plugins built with different options can be compared by
+     concatenating their files.
+
+   KEYWORDS: number, repeat.
+   SEE ALSO: dlwrap, dlvariant.
+ */
+{
+  extern _dlbench_lines;
+  if (is_void(number)) number = 100000;
+  if (is_void(repeat)) repeat = 5;
+
+  /* Reference times. */
+  _dlbench_lines = [];
+  empty = _dlbench_best(_dlbench_empty, , , number, repeat);
+  _dlbench_run, "-", "-", "builtin", "-", "builtin", 1,
+    _dlbench_best(_dlbench_loop1, is_void, [&number], number, repeat) - empty;
+
+  /* All combinations of loaders and backends. */
+  loaders = dlvariant("loader");
+  backends = dlvariant("backend");
+  for (i = 1; i <= numberof(loaders); ++i) {
+    dl = _dlbench_open(lib, loaders(i));
+    if (is_void(dl)) {
+      write, format="loader %s skipped (%s)\n", loaders(i), catch_message;
+      continue;
+    }
+    for (j = 1; j <= numberof(backends); ++j) {
+      write, format="loader %s, backend %s:\n", dl.loader, backends(j);
+      _dlbench_cases, dl, backends(j);
+    }
+  }
+
+  if (! is_void(output)) {
+    file = open(output, "w");
+    write, file, format="%s\t%s\t%s\t%s\t%s\t%s\t%s\n",
+      "variant", "backend", "name", "attr", "path", "nargs", "ns";
+    write, file, format="%s\n", _dlbench_lines;
+    close, file;
+  }
+  _dlbench_lines = [];
+}
+
+_DLBENCH_MAX_ARGS = 14;
+
+func _dlbench_open(lib, loader)
+{
+  if (catch(-1)) return;
+  return dlopen(lib, loader=loader);
+}
+
+func _dlbench_cases(dl, backend)
+/* DOCUMENT _dlbench_cases, dl, backend;
+     Private subroutine to run the benchmarks of dlbench for the functions
+     of module DL wrapped with the generic machinery BACKEND.
+   SEE ALSO: dlbench.
+ */
+{
+  /* One function for each type of argument and result. */
+  x = 1.0;
+  s = "hello";
+  list = ["char", "short", "int", "long", "float", "double"];
+  types = [DL_CHAR, DL_SHORT, DL_INT, DL_LONG, DL_FLOAT, DL_DOUBLE];
+  values = [&char(1), &short(1), &int(1), &long(1), &float(1), &double(1)];
+  for (k = 1; k <= numberof(list); ++k) {
+    _dlbench_case, dl, list(k), types(k), "dlbench_" + list(k),
+      [types(k)], [values(k)];
+  }
+  _dlbench_case, dl, "void", DL_VOID, "dlbench_void", [], [];
+  _dlbench_case, dl, "complex", DL_COMPLEX, "dlbench_complex",
+    [DL_COMPLEX], [&complex(1,2)];
+  _dlbench_case, dl, "string", DL_STRING, "dlbench_string",
+    [DL_STRING], [&s];
+  _dlbench_case, dl, "pointer", DL_LONG, "dlbench_pointer",
+    [DL_POINTER], [&&x];
+  list = ["char", "short", "int", "long", "float", "double", "complex",
+          "string", "pointer"];
+  types = [DL_CHAR_ARRAY, DL_SHORT_ARRAY, DL_INT_ARRAY, DL_LONG_ARRAY,
+           DL_FLOAT_ARRAY, DL_DOUBLE_ARRAY, DL_COMPLEX_ARRAY,
+           DL_STRING_ARRAY, DL_POINTER_ARRAY];
+  values = [&array(char, 100), &array(short, 100), &array(int, 100),
+            &array(long, 100), &array(float, 100), &array(double, 100),
+            &array(complex, 100), &array(string, 100),
+            &array(pointer, 100)];
+  for (k = 1; k <= numberof(list); ++k) {
+    _dlbench_case, dl, list(k) + "_array", DL_LONG,
+      "dlbench_" + list(k) + "_array", [types(k)], [values(k)];
+  }
+  _dlbench_case, dl, "double_array_converted", DL_LONG,
+    "dlbench_double_array", [DL_DOUBLE_ARRAY], [&array(int, 100)];
+  _dlbench_case, dl, "double_result", DL_DOUBLE_ARRAY,
+    "dlbench_double_result", [DL_LONG], [&long(16)], size=1;
+  list = ["char", "short", "int", "long", "float", "double", "complex"];
+  types = [DL_CHAR_OUT, DL_SHORT_OUT, DL_INT_OUT, DL_LONG_OUT,
+           DL_FLOAT_OUT, DL_DOUBLE_OUT, DL_COMPLEX_OUT];
+  for (k = 1; k <= numberof(list); ++k) {
+    _dlbench_case, dl, list(k) + "_out", DL_VOID,
+      "dlbench_" + list(k) + "_out", [types(k)], [&double(0)];
+  }
+  _dlbench_case, dl, "int_inout", DL_VOID, "dlbench_int_inout",
+    [DL_INT_INOUT], [&int(0)];
+  _dlbench_case, dl, "double_inout", DL_VOID, "dlbench_double_inout",
+    [DL_DOUBLE_INOUT], [&double(0)];
+  _dlbench_case, dl, "struct", dlbench_point, "dlbench_struct",
+    [], [&dlbench_point(x=1, y=2)], structure=dlbench_point;
+
+  /* Number of arguments. */
+  _dlbench_case, dl, "long0", DL_LONG, "dlbench_long0", [], [];
+  _dlbench_case, dl, "double0", DL_DOUBLE, "dlbench_double0", [], [];
+  for (n = 1; n <= _DLBENCH_MAX_ARGS; ++n) {
+    _dlbench_case, dl, swrite(format="long%d", n), DL_LONG,
+      swrite(format="dlbench_long%d", n), array(DL_LONG, n),
+      array(&long(1), n);
+    _dlbench_case, dl, swrite(format="double%d", n), DL_DOUBLE,
+      swrite(format="dlbench_double%d", n), array(DL_DOUBLE, n),
+      array(&double(1), n);
+  }
+}
+
+func _dlbench_case(dl, name, rtype, symbol, atypes, values, size=,
+                   structure=)
+/* DOCUMENT _dlbench_case, dl, name, rtype, symbol, atypes, values;
+
+     Private function to wrap function SYMBOL of DL with return type RTYPE
+     and argument types ATYPES, with and without DL_JIT, and measure the
+     overhead of calling it with arguments VALUES (a vector of pointers).
+     If keyword STRUCTURE is set with a structure definition, RTYPE and the
+     type of the single argument are this structure (DL_JIT is not used).
+     The benchmark is skipped if the function cannot be wrapped by this
+     build of the plugin.
+
+   SEE ALSO: dlbench.
+ */
+{
+  extern number, repeat, empty, backend;
+  nargs = numberof(values);
+  loop = symbol_def(swrite(format="_dlbench_loop%d", nargs));
+  for (attr = 0; attr <= (is_void(structure) ? 1 : 0); ++attr) {
+    if (is_void(structure)) {
+      wrap = symbol_def(swrite(format="_dlbench_wrap%d", nargs));
+      fn = wrap(dl, (attr ? rtype|DL_JIT : rtype), symbol, atypes,
+                size=size, backend=backend);
+    } else {
+      fn = _dlbench_wrap_struct(dl, structure, symbol, backend);
+    }
+    if (is_void(fn)) {
+      write, format="%-24s skipped (%s)\n", name, catch_message;
+      return;
+    }
+    _dlbench_run, dl.loader, fn.backend, name, (attr ? "jit" : "-"),
+      fn.path, nargs, _dlbench_best(loop, fn, values, number, repeat) - empty;
+  }
+}
+
+func _dlbench_wrap_struct(dl, s, symbol, backend)
+{
+  if (catch(-1)) return;
+  return dlwrap(dl, s, symbol, s, backend=backend);
+}
+
+func _dlbench_run(variant, backend, name, attr, path, nargs, t)
+{
+  extern _dlbench_lines;
+  write, format="%-24s %-4s %-7s %2d args: %8.1f ns\n",
+    name, attr, path, nargs, t;
+  grow, _dlbench_lines, swrite(format="%s\t%s\t%s\t%s\t%s\t%d\t%.1f",
+                               variant, backend, name, attr, path,
+                               nargs, t);
+}
+
+func _dlbench_best(loop, f, p, number, repeat)
+/* DOCUMENT t = _dlbench_best(loop, f, p, number, repeat);
+     Private function to yield the best time (in nanoseconds per call) of
+     REPEAT runs of LOOP(F, P, NUMBER).
+   SEE ALSO: dlbench.
+ */
+{
+  best = [];
+  for (k = 1; k <= repeat; ++k) {
+    t = loop(f, p, number);
+    if (is_void(best) || t < best) best = t;
+  }
+  return 1e9*best/number;
+}
+
+func _dlbench_empty(f, p, n)
+{
+  t = array(double, 3);
+  timer, t;
+  t0 = t;
+  for (i = 1; i <= n; ++i);
+  timer, t;
+  return t(3) - t0(3);
+}
+
+/* Define the functions _dlbench_wrapN(dl, rtype, symbol, atypes, size=,
+   backend=)
+   which wrap a function with N arguments (yielding nil on error) and
+   _dlbench_loopN(f, p, n) which call F, N times with the arguments pointed
+   by the elements of P and yield the elapsed time. */
+func _dlbench_define(n)
+{
+  args = (n > 0 ? swrite(format=", a%d", indgen(n))(sum) : "");
+  atypes = (n > 0 ? swrite(format=", t(%d)", indgen(n))(sum) : "");
+  include, [swrite(format="func _dlbench_wrap%d(dl, rt, sym, t, size=, "
+                   + "backend=)", n),
+            "{",
+            "  if (catch(-1)) return;",
+            "  return dlwrap(dl, rt, sym" + atypes
+            + ", size=size, backend=backend);",
+            "}",
+            swrite(format="func _dlbench_loop%d(f, p, n)", n),
+            "{",
+            (n > 0 ? swrite(format="  a%d = *p(%d);", indgen(n),
+                            indgen(n)) : []),
+            "  t = array(double, 3);",
+            "  timer, t;",
+            "  t0 = t;",
+            "  for (i = 1; i <= n; ++i) f" + args + ";",
+            "  timer, t;",
+            "  return t(3) - t0(3);",
+            "}"], 1;
+}
+for (_dlbench_n = 0; _dlbench_n <= _DLBENCH_MAX_ARGS; ++_dlbench_n) {
+  _dlbench_define, _dlbench_n;
+}
+
+if (batch()) {
+  _dlbench_argv = get_argv();
+  _dlbench_k = where(strpart(_dlbench_argv, -8:0) == "dlbench.i");
+  _dlbench_argv = (numberof(_dlbench_k) ?
+                   _dlbench_argv(_dlbench_k(0)+1:) : []);
+  if (numberof(_dlbench_argv) < 1 || numberof(_dlbench_argv) > 2) {
+    error, "usage: yorick -batch dlbench.i LIBRARY [OUTPUT]";
+  }
+  dlbench, _dlbench_argv(1),
+    (numberof(_dlbench_argv) >= 2 ? _dlbench_argv(2) : []);
+  quit;
+}
+
+/*
+ * Local Variables:
+ * mode: Yorick
+ * tab-width: 8
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * fill-column: 79
+ * coding: utf-8
+ * ispell-local-dictionary: "american"
+ * End:
+ */
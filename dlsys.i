@@ -274,51 +274,27 @@ func _sys_have(sym)
   return (dlsym(SYS.__libc__, sym) != 0);
 }
 
-func _sys_link(rt,nm,a1,a2,a3,a4,a5,a6,a7,a8,a9,a10,a11,a12,a13,a14,a15)
-/* DOCUMENT  _sys_link, rtype, fname, atype1, atype2, ...
-      Private subroutine to add a function wrapper in the global SYS table.
-      RTYPE is the return type, FNAME the function name, and ATYPE1, ... the
-      type(s) of the arguments of the function.
-
-   SEE ALSO: _sys_init, dlwrap.
+func _sys_declare(protos)
+/* DOCUMENT  _sys_declare, prototypes;
+      Private subroutine to add function wrappers in the global SYS table.
+      PROTOTYPES is a vector of C prototypes of functions of the C library.
+      All the wrappers are built by a single call to dlwrap_declare and are
+      created lazily: the symbol of a function is only resolved (and the
+      call prepared) the first time the function is called.  Type address_t
+      stands for an address passed as an integer (see DL_ADDRESS).
+
+   SEE ALSO: _sys_init, dlwrap_declare.
  */
 {
   extern SYS;
-  dl = SYS.__libc__;
-  if (is_void(a1)) {
-    fn = dlwrap(dl,rt,nm);
-  } else if (is_void(a2)) {
-    fn = dlwrap(dl,rt,nm,a1);
-  } else if (is_void(a3)) {
-    fn = dlwrap(dl,rt,nm,a1,a2);
-  } else if (is_void(a4)) {
-    fn = dlwrap(dl,rt,nm,a1,a2,a3);
-  } else if (is_void(a5)) {
-    fn = dlwrap(dl,rt,nm,a1,a2,a3,a4);
-  } else if (is_void(a6)) {
-    fn = dlwrap(dl,rt,nm,a1,a2,a3,a4,a5);
-  } else if (is_void(a7)) {
-    fn = dlwrap(dl,rt,nm,a1,a2,a3,a4,a5,a6);
-  } else if (is_void(a8)) {
-    fn = dlwrap(dl,rt,nm,a1,a2,a3,a4,a5,a6,a7);
-  } else if (is_void(a9)) {
-    fn = dlwrap(dl,rt,nm,a1,a2,a3,a4,a5,a6,a7,a8);
-  } else if (is_void(a10)) {
-    fn = dlwrap(dl,rt,nm,a1,a2,a3,a4,a5,a6,a7,a8,a9);
-  } else if (is_void(a11)) {
-    fn = dlwrap(dl,rt,nm,a1,a2,a3,a4,a5,a6,a7,a8,a9,a10);
-  } else if (is_void(a12)) {
-    fn = dlwrap(dl,rt,nm,a1,a2,a3,a4,a5,a6,a7,a8,a9,a10,a11);
-  } else if (is_void(a13)) {
-    fn = dlwrap(dl,rt,nm,a1,a2,a3,a4,a5,a6,a7,a8,a9,a10,a11,a12);
-  } else if (is_void(a14)) {
-    fn = dlwrap(dl,rt,nm,a1,a2,a3,a4,a5,a6,a7,a8,a9,a10,a11,a12,a13);
-  } else if (is_void(a15)) {
-    fn = dlwrap(dl,rt,nm,a1,a2,a3,a4,a5,a6,a7,a8,a9,a10,a11,a12,a13,a14);
-  } else {
-    fn = dlwrap(dl,rt,nm,a1,a2,a3,a4,a5,a6,a7,a8,a9,a10,a11,a12,a13,a14,a15);
+  tab = dlwrap_declare(SYS.__libc__, protos, lazy=1,
+                       typedefs=("typedef " + typeof(sys_address_t(0)) +
+                                 " address_t"));
+  names = tab();
+  n = numberof(names);
+  for (i = 1; i <= n; ++i) {
+    h_set, SYS, names(i), tab(names(i));
   }
-  h_set, SYS, nm, fn;
 }
 
 func _sys_swallow(..)
@@ -373,65 +349,40 @@ func _sys_init(nil)
 
   USE_FILE_OFFSET64 = FALSE;
 
-  /* Some shorcuts. */
-  VOID = DL_VOID;
-  CHAR = DL_CHAR;
-  SHORT = DL_SHORT;
-  INT = DL_INT;
-  LONG = DL_LONG;
-  FLOAT = DL_FLOAT;
-  DOUBLE = DL_DOUBLE;
-  COMPLEX = DL_COMPLEX;
-  STRING = DL_STRING;
-  POINTER = DL_POINTER;
-  CHAR_ARRAY = DL_CHAR_ARRAY;
-  SHORT_ARRAY = DL_SHORT_ARRAY;
-  INT_ARRAY = DL_INT_ARRAY;
-  LONG_ARRAY = DL_LONG_ARRAY;
-  FLOAT_ARRAY = DL_FLOAT_ARRAY;
-  DOUBLE_ARRAY = DL_DOUBLE_ARRAY;
-  COMPLEX_ARRAY = DL_COMPLEX_ARRAY;
-  STRING_ARRAY = DL_STRING_ARRAY;
-  POINTER_ARRAY = DL_POINTER_ARRAY;
-  FD = INT;     /* data type for a file descriptor */
-  SOCKFD = INT; /* data type for a socket descriptor */
-  SOCKLEN = dltype(sys_socklen_t); /* data type to store the length of a
-                                      sockaddr structure */
-  SIZE = dltype(sys_size_t);
-  SSIZE = SIZE; /* no unsigned type in Yorick */
-  ADDRESS = dltype(sys_address_t);
   WORDSIZE = 8*sizeof(pointer); /* size of a 'word' in bits */
-  INT16 = dltype(sys_int16_t);
-  INT32 = dltype(sys_int32_t);
-  if (! is_void(sys_int64_t)) {
-    INT64 = dltype(sys_int64_t);
-  }
 
-  _sys_link, ADDRESS, "memcpy", ADDRESS, ADDRESS, SIZE;
-
-  _sys_link, INT,  "open", STRING, INT, INT;
-  _sys_link, INT,  "close", INT;
-  _sys_link, LONG, "read", INT, POINTER, LONG;
-  _sys_link, LONG, "write", INT, POINTER, LONG;
-
-  _sys_link, INT32, "htonl", INT32;
-  _sys_link, INT32, "ntohl", INT32;
-  _sys_link, INT16, "htons", INT16;
-  _sys_link, INT16, "ntohs", INT16;
-
-  _sys_link, INT, "socket", INT, INT, INT;
-  _sys_link, INT, "bind", INT, POINTER, LONG;
-  _sys_link, INT, "connect", INT, ADDRESS, LONG;
-  _sys_link, INT, "accept", INT, ADDRESS, POINTER;
-  _sys_link, INT, "listen", INT, INT;
-  _sys_link, INT, "shutdown", INT, INT;
-  _sys_link, LONG, "send", INT, POINTER, LONG, INT;
-  _sys_link, LONG, "recv", INT, POINTER, LONG, INT;
-  _sys_link, INT, "getpeername", INT, POINTER, POINTER;
-  _sys_link, INT, "getsockname", INT, POINTER, POINTER;
+  /* Functions of the C library (see definitions in "/usr/include/netdb.h"
+     for getaddrinfo, etc.). */
+  _sys_declare,
+    ["address_t memcpy(address_t, address_t, size_t)",
+     "int open(const char*, int, int)",
+     "int close(int)",
+     "ssize_t read(int, void*, size_t)",
+     "ssize_t write(int, const void*, size_t)",
+     "off_t lseek(int, off_t, int)",
+     "int poll(struct pollfd*, unsigned long, int)",
+     "uint32_t htonl(uint32_t)",
+     "uint32_t ntohl(uint32_t)",
+     "uint16_t htons(uint16_t)",
+     "uint16_t ntohs(uint16_t)",
+     "int socket(int, int, int)",
+     "int bind(int, const struct sockaddr*, socklen_t)",
+     "int connect(int, const struct sockaddr*, socklen_t)",
+     "int accept(int, struct sockaddr*, INOUT socklen_t*)",
+     "int listen(int, int)",
+     "int shutdown(int, int)",
+     "ssize_t send(int, const void*, size_t, int)",
+     "ssize_t recv(int, void*, size_t, int)",
+     "int getpeername(int, struct sockaddr*, INOUT socklen_t*)",
+     "int getsockname(int, struct sockaddr*, INOUT socklen_t*)",
+     ("int getaddrinfo(const char*, const char*, const struct addrinfo*, "+
+      "OUT struct addrinfo**)"),
+     "void freeaddrinfo(address_t)",
+     "const char *gai_strerror(int)",
+     ("int getnameinfo(const struct sockaddr*, socklen_t, char*, size_t, "+
+      "char*, size_t, int)")];
 
   /* poll - wait for some event on a file descriptor. */
-  _sys_link, INT, "poll", POINTER, LONG, INT;
   h_set, SYS,
     POLLIN     = 0x001, /* There is data to read.  */
     POLLPRI    = 0x002, /* There is urgent data to read.  */
@@ -453,7 +404,6 @@ func _sys_init(nil)
     POLLNVAL   = 0x020; /* Invalid polling request.  */
 
   /* lseek - reposition read/write file offset. */
-  _sys_link, LONG, "lseek", INT, LONG, INT;
   h_set, SYS,
     SEEK_SET = 0, /* seek relative to beginning of file */
     SEEK_CUR = 1, /* seek relative to current file position */
@@ -631,13 +581,6 @@ func _sys_init(nil)
     SHUT_WR   = 1,  /* No more transmissions.  */
     SHUT_RDWR = 2;  /* No more receptions or transmissions.  */
 
-  /* See definitions in "/usr/include/netdb.h" */
-  _sys_link, INT, "getaddrinfo", STRING, STRING, POINTER, POINTER;
-  _sys_link, VOID, "freeaddrinfo", ADDRESS;
-  _sys_link, STRING, "gai_strerror", INT;
-  _sys_link, INT, "getnameinfo", POINTER, SOCKLEN, POINTER, SIZE,
-    POINTER, SIZE, INT;
-
   /* Possible values for `ai_flags' field in `addrinfo' structure.  */
   h_set, SYS,
     AI_PASSIVE     = 0x0001,  /* Socket address is intended for `bind'.  */
@@ -658,6 +601,9 @@ func _sys_init(nil)
 
   /* IPC */
   _sys_init_ipc;
+
+  /* Check the socket address structures. */
+  _sys_check_sockaddr;
 }
 
 /* Structure used to store address information. */
@@ -699,24 +645,20 @@ func sys_getaddrinfo(node, service, flags=, family=, socktype=, protocol=)
                            ai_socktype = socktype,
                            ai_protocol = protocol);
 
-  /* Initialize buffers and local variables. */
-  handle = NULL; // to store the address of the result
+  /* Initialize local variables. */
+  handle = 0; // to store the address of the result
   addrinfo = [];
-  entry = sys_raw_addrinfo();
-  entry_ptr = &entry;
-  entry_size = sizeof(entry);
 
   /* Query the addresses that match the hints. */
-  status = SYS.getaddrinfo(node, service, &hints, &handle);
+  status = SYS.getaddrinfo(node, service, &hints, handle);
   if (status != 0) {
-    if (handle != NULL) dummy = SYS.freeaddrinfo(handle);
+    if (handle) dummy = SYS.freeaddrinfo(handle);
     error, SYS.gai_strerror(staut);
   }
-  if (handle != NULL) {
+  if (handle) {
     address = handle;
-    while (address != NULL) {
-      //entry = dlwrap_fetch(address, sys_raw_addrinfo);
-      dlwrap_memcpy, entry_ptr, address, entry_size;
+    while (address) {
+      entry = dlwrap_fetch(address, sys_raw_addrinfo);
       if ((ai_addr = entry.ai_addr) != NULL &&
           (ai_addrlen = entry.ai_addrlen) > 0) {
         ai_addr_ptr = &array(char, ai_addrlen);
@@ -806,13 +748,13 @@ func sys_connect(sockfd, sockaddr)
 
 func sys_accept(sockfd, &sockaddr)
 {
-  buf = array(char, 1024);/* FIXME: depends on socket address familly */
-  status = SYS.connect(sockfd, &buf, sizeof(buf));
-  if (status == 0) {
-    /* FIXME: unpack socket address */
-    sockaddr = 0;
+  addrlen = sys_socklen_t(256);
+  buffer = array(char, addrlen);
+  fd = SYS.accept(sockfd, &buffer, addrlen);
+  if (fd >= 0) {
+    sockaddr = _sys_unpack_sockaddr(buffer(1:min(addrlen, sizeof(buffer))));
   }
-  return status;
+  return fd;
 }
 
 func sys_listen(sockfd, backlog)
@@ -877,11 +819,11 @@ func _sys_getsockname_worker(getname)
   extern sockaddr, sockfd;
   addrlen = sys_socklen_t(256);
   buffer = array(char, addrlen);
-  status = getname(sockfd, &buffer, &addrlen);
+  status = getname(sockfd, &buffer, addrlen);
   if (status != 0) return status;
   if (addrlen > sizeof(buffer)) {
     buffer = array(char, addrlen);
-    status = getname(sockfd, &buffer, &addrlen);
+    status = getname(sockfd, &buffer, addrlen);
     if (status != 0) return status;
   }
   sockaddr = _sys_unpack_sockaddr(buffer(1:addrlen));
@@ -901,9 +843,6 @@ struct sys_sockaddr_in {
   sys_uint32_t sin_addr;    /* Internet address in network byte order.  */
   char         sin_zero(8);
 }
-if (sizeof(sys_sockaddr_in) != 16) {
-  error, "unexpected size for struct sys_sockaddr_in";
-}
 
 /* Ditto, for IPv6.  */
 struct sys_sockaddr_in6 {
@@ -914,18 +853,50 @@ struct sys_sockaddr_in6 {
   sys_uint32_t sin6_scope_id; /* IPv6 scope-id */
   char         sin6_zero(18);
 }
-// FIXME: because of alignment, the size is a multiple of 4
-if (sizeof(sys_sockaddr_in6) < 46) {
-  error, "unexpected size for struct sys_sockaddr_in6";
-}
+
 /* Structure describing the address of an AF_LOCAL (aka AF_UNIX) socket.
    Defined in "/usr/include/sys/un.h"  */
 struct sys_sockaddr_un {
   sys_uint16_t sun_family;      /* Socket family. */
   char         sun_path(108);   /* Path name.  */
 }
-if (sizeof(sys_sockaddr_un) != 110) {
-  error, "unexpected size for struct sys_sockaddr_un";
+
+func _sys_check_sockaddr(probe)
+/* DOCUMENT _sys_check_sockaddr;
+         or _sys_check_sockaddr, 1;
+     Private subroutine to check the Yorick definitions of the socket address
+     structures against the layout of their C counterparts: the sizes of
+     sockaddr_in and sockaddr_un and the offset of the last member of
+     sockaddr_in6 (sys_sockaddr_in6 is padded to be larger than the C
+     structure).  The C layout is taken from the cache of sys_probe, the
+     layout of the GNU C library is assumed if it is not cached.  If PROBE
+     is true, the layout is probed (and cached) if not yet known, this
+     compiles a program and is therefore not done when dlsys.i is loaded.
+
+   SEE ALSO: sys_probe.
+ */
+{
+  layout = sys_probe(["sizeof(struct sockaddr_in)",
+                      "offsetof(struct sockaddr_in6, sin6_scope_id)",
+                      "sizeof(struct sockaddr_un)"],
+                     head=["#include <sys/socket.h>",
+                           "#include <netinet/in.h>",
+                           "#include <sys/un.h>"],
+                     cached=(! probe), throw=0);
+  if (numberof(layout) != 3) {
+    layout = [16, 24, 110];
+  }
+  if (sizeof(sys_sockaddr_in) != layout(1)) {
+    error, "unexpected size for struct sys_sockaddr_in";
+  }
+  addr = sys_sockaddr_in6(sin6_scope_id = -1);
+  offset = where(dlwrap_fetch(&addr, char, sizeof(addr)))(1) - 1;
+  if (offset != layout(2)) {
+    error, "unexpected layout for struct sys_sockaddr_in6";
+  }
+  if (sizeof(sys_sockaddr_un) != layout(3)) {
+    error, "unexpected size for struct sys_sockaddr_un";
+  }
 }
 
 /* Structures describing the address of an AF_APPLETALK (AppleTalk) socket.  */
@@ -995,15 +966,11 @@ func _sys_init_ipc
   extern SYS, SYS_HAVE_IPC, sys_key_t;
 
   SYS_HAVE_IPC = 0;
-  KEY = dltype(sys_key_t);
-  INT = DL_INT;
-  LONG = DL_LONG;
-  ADDRESS = DL_ADDRESS;
-  POINTER = DL_POINTER;
+  protos = [];
 
   /* Generates key for System V style IPC.  */
   if (_sys_have("ftok")) {
-    _sys_link, KEY, "ftok", STRING /* pathname */, INT /* proj_id */;
+    grow, protos, "key_t ftok(const char *pathname, int proj_id)";
   }
 
   /* IPC Messages */
@@ -1013,19 +980,18 @@ func _sys_init_ipc
     SYS_HAVE_IPC |= SYS_HAVE_IPC_MSG;
 
     /* Message queue control operation.  */
-    _sys_link, INT, "msgctl", INT /* msqid */, INT /* cmd */,
-      ADDRESS /* buf */;
+    grow, protos, "int msgctl(int msqid, int cmd, address_t buf)";
 
     /* Get messages queue.  */
-    _sys_link, INT, "msgget", KEY /* key */, INT /* msgflg */;
+    grow, protos, "int msgget(key_t key, int msgflg)";
 
     /* Receive message from message queue. */
-    _sys_link, SSIZE, "msgrcv", INT /* msqid */, ADDRESS /* msgp */,
-      SIZE /* msgsz */, LONG /* msgtyp */, INT /* msgflg */;
+    grow, protos, ("ssize_t msgrcv(int msqid, address_t msgp, size_t msgsz, " +
+                   "long msgtyp, int msgflg)");
 
     /* Send message to message queue. */
-    _sys_link, INT, "msgsnd", INT /* msqid */, ADDRESS /* msgp */,
-      SIZE /* msgsz */, INT /* msgflg */;
+    grow, protos, ("int msgsnd(int msqid, address_t msgp, size_t msgsz, " +
+                   "int msgflg)");
 
     /* Flags and constants for message queues (definitions found in
        "bits/msq.h"). */
@@ -1044,18 +1010,16 @@ func _sys_init_ipc
     SYS_HAVE_IPC |= SYS_HAVE_IPC_SHM;
 
     /* Shared memory control operation.  */
-    _sys_link, INT, "shmctl", INT /* shmid */, INT /* cmd */,
-      POINTER /* buf */;
+    grow, protos, "int shmctl(int shmid, int cmd, struct shmid_ds *buf)";
 
     /* Get shared memory segment.  */
-    _sys_link, INT, "shmget", KEY /* key */, SIZE /* size */, INT /* shmflg */;
+    grow, protos, "int shmget(key_t key, size_t size, int shmflg)";
 
     /* Attach shared memory segment.  */
-    _sys_link, ADDRESS, "shmat", INT /* shmid */, ADDRESS /* shmaddr */,
-      INT /* shmflg */;
+    grow, protos, "address_t shmat(int shmid, address_t shmaddr, int shmflg)";
 
     /* Detach shared memory segment.  */
-    _sys_link, INT, "shmdt", ADDRESS /* shmaddr */;
+    grow, protos, "int shmdt(address_t shmaddr)";
 
     /* Flags and constants for shared memory (definitions found in
        "bits/shm.h"). */
@@ -1086,21 +1050,19 @@ func _sys_init_ipc
     SYS_HAVE_IPC |= SYS_HAVE_IPC_SEM;
 
     /* Semaphore control operation.  */
-    _sys_link, INT, "semctl", INT /* semid */, INT /* semnum */, INT /* cmd */,
-      ADDRESS /* FIXME: optional union semun argument */;
+    grow, protos, "int semctl(int semid, int semnum, int cmd, address_t arg)";
 
     /* Get semaphore.  */
-    _sys_link, INT, "semget", KEY /* key */, INT /* nsems */, INT /* semflg */;
+    grow, protos, "int semget(key_t key, int nsems, int semflg)";
 
     /* Operate on semaphore.  */
-    _sys_link, INT, "semop", INT /* semid */, ADDRESS /* sops */,
-      SIZE /* nsops */;
+    grow, protos, "int semop(int semid, address_t sops, size_t nsops)";
 
     /* Operate on semaphore with timeout.  */
     if (_sys_have("semtimedop")) {
       SYS_HAVE_IPC |= SYS_HAVE_IPC_GNU_SEM;
-      _sys_link, INT, "semtimedop", INT /* semid */, ADDRESS /* sops */,
-        SIZE /* nsops */, ADDRESS /* timeout */;
+      grow, protos, ("int semtimedop(int semid, address_t sops, " +
+                     "size_t nsops, address_t timeout)");
     }
 
     /* Flags and constants for semaphores (definitions found in
@@ -1120,6 +1082,9 @@ func _sys_init_ipc
       SEM_STAT =     18,
       SEM_INFO =     19;
   }
+  if (! is_void(protos)) {
+    _sys_declare, protos;
+  }
 
   if (SYS_HAVE_IPC != 0) {
     h_set, SYS,
@@ -1440,28 +1405,19 @@ errs2caller, _sys_exec_worker;
 
 func sys_get_sizeof_type(type, head=, cc=, tmpdir=, mktemp=, cflags=,
                          ldflags=, cppflags=, defs=, libs=, exe=, debug=)
-{
-  /* Prepare the preamble of the code. */
-  if (numberof(head) > 0) {
-    code = sum(head + "\n");
-  } else {
-    code = "";
-  }
-  code += "#include <stdio.h>\nint main() {\n";
-
-  /* Add statements to print the result. */
-  code += swrite(format="  printf(\"%%ld\\n\", (long)sizeof(%s));\n",
-                 type);
+/* DOCUMENT sys_get_sizeof_type(type);
+     This function yields the size (in bytes) of the C type TYPE (a string),
+     or -1 if it cannot be determined.  The keywords are the same as for
+     sys_probe, the result is cached.
 
-  /* Finalize the code, compile it and run the command. */
-  code += "  return 0;\n}\n";
-  res = sys_run_code(code, tmpdir=tmpdir, mktemp=mktemp,
-                     cc=cc, cflags=cflags, ldflags=ldflags,
-                     cppflags=cppflags, defs=defs, libs=libs,
-                     exe=exe, debug=debug);
-  value = 0;
-  if (sread(res, value) == 1) return value;
-  return -1;
+   SEE ALSO: sys_probe.
+ */
+{
+  value = sys_probe("sizeof(" + type + ")", head=head, throw=0,
+                    tmpdir=tmpdir, mktemp=mktemp, cc=cc, cflags=cflags,
+                    ldflags=ldflags, cppflags=cppflags, defs=defs,
+                    libs=libs, exe=exe, debug=debug);
+  return (is_void(value) ? -1 : value(1));
 }
 
 func sys_run_code(code, cc=, tmpdir=, mktemp=, cflags=,
@@ -1518,6 +1474,158 @@ func sys_run_code(code, cc=, tmpdir=, mktemp=, cflags=,
   }
   return result;
 }
+
+local SYS_PROBE_CACHE;
+func sys_probe(queries, head=, cache=, cached=, throw=, cc=, tmpdir=,
+               mktemp=, cflags=, ldflags=, cppflags=, defs=, libs=, exe=,
+               debug=)
+/* DOCUMENT sys_probe(queries);
+
+     This function yields the values of QUERIES, a string or an array of
+     strings with C integer constant expressions such as:
+
+         "sizeof(struct sockaddr_in6)"
+         "offsetof(struct sockaddr_in6, sin6_scope_id)"
+         "ALIGNOF(double)"
+
+     The result is an array of long integers with the same dimensions as
+     QUERIES.  Keyword HEAD is a string or an array of strings with the lines
+     of C code needed by the queries (typically #include directives);
+     <stddef.h> is always included and the macro ALIGNOF(T) yields the
+     alignment of type T.  The queries and the lines of HEAD must not
+     contain tabulations nor newlines.
+
+     All the queries which are not already known are answered by compiling
+     and running a single program (see sys_run_code for keywords CC, TMPDIR,
+     MKTEMP, CFLAGS, LDFLAGS, CPPFLAGS, DEFS, LIBS, EXE and DEBUG).  Their
+     values are saved in a cache file so that later calls, even in other
+     sessions, do not spawn the compiler.  Cached values are keyed by the
+     compiler, its flags, the lines of HEAD and the target (the size of a
+     long, of a pointer and the byte order of Yorick).  Keyword CACHE is the
+     name of the cache file, by default the value of global variable
+     SYS_PROBE_CACHE (initially "dlsys-probe.cache" in Y_USER directory); set
+     it to an empty string to disable the cache.  The cache file is a text
+     file with a line "@KEY" (KEY being the compiler, the flags, the target
+     and the lines of HEAD separated by tabulations) followed by lines
+     "VALUE<tab>QUERY" for each group of queries.
+
+     If keyword CACHED is true, the queries are only answered from the cache
+     (the compiler is never run), an error is raised if some are unknown.
+     If keyword THROW is false, nothing is returned instead of raising an
+     error when the queries cannot be answered.
+
+   SEE ALSO: sys_run_code, sys_get_sizeof_type.
+ */
+{
+  if (! is_void(throw) && ! throw) {
+    if (catch(-1)) return;
+  }
+  if (structof(queries) != string || ! is_array(queries)) {
+    error, "expecting an array of strings";
+  }
+  if (_sys_probe_bad(queries) || _sys_probe_bad(head)) {
+    error, "queries and header lines must not contain tabs nor newlines";
+  }
+  if (is_void(cache)) cache = SYS_PROBE_CACHE;
+  if (is_void(cc)) cc = "gcc";
+  if (is_void(defs)) defs = "";
+  if (is_void(cppflags)) cppflags = "";
+  if (is_void(cflags)) cflags = "-O";
+  if (is_void(ldflags)) ldflags = "";
+  if (is_void(exe)) exe = "";
+  if (is_void(libs)) libs = "";
+
+  /* Key of the facts in the cache (the full key is compared, not a hash,
+     so that facts of different configurations cannot be mixed). */
+  key = (cc + "\t" + defs + "\t" + cppflags + "\t" + cflags + "\t"
+         + ldflags + "\t" + libs + "\t"
+         + swrite(format="%d-%d-%d", sizeof(long), sizeof(pointer),
+                  DL_NATIVE_ORDER)
+         + (numberof(head) ? sum("\t" + head(*)) : ""));
+
+  /* Fetch the known values from the blocks of lines following the key. */
+  n = numberof(queries);
+  values = array(long, dimsof(queries));
+  known = array(0n, n);
+  if (cache && (file = open(cache, "r", 1))) {
+    lines = sys_read_stream(file);
+    close, file;
+    header = (strpart(lines, 1:1) == "@");
+    block = header(psum);
+    i = where(header);
+    if (is_array(i)) {
+      i = i(where(strpart(lines(i), 2:0) == key));
+    }
+    for (b = 1; b <= numberof(i); ++b) {
+      k = where(block == block(i(b)) & ! header);
+      if (! is_array(k)) continue;
+      tok = strtok(lines(k), "\t");
+      for (j = 1; j <= n; ++j) {
+        l = where(tok(2,) == queries(j));
+        if (is_array(l)) {
+          value = 0;
+          if (sread(tok(1,l(0)), value) == 1) {
+            values(j) = value;
+            known(j) = 1n;
+          }
+        }
+      }
+    }
+  }
+  i = where(! known);
+  m = numberof(i);
+  if (! m) {
+    return values;
+  }
+  if (cached) {
+    error, "queries not found in the cache";
+  }
+
+  /* Answer all the missing queries at once. */
+  code = ["#include <stddef.h>", "#include <stdio.h>"];
+  if (numberof(head)) grow, code, head(*);
+  grow, code, ["#ifndef ALIGNOF",
+               "# define ALIGNOF(T) offsetof(struct {char c; T x;}, x)",
+               "#endif",
+               "int main() {"];
+  grow, code, swrite(format="  printf(\"%%ld\\n\", (long)(%s));",
+                     queries(i));
+  grow, code, ["  return 0;", "}"];
+  res = sys_run_code(code, tmpdir=tmpdir, mktemp=mktemp,
+                     cc=cc, cflags=cflags, ldflags=ldflags,
+                     cppflags=cppflags, defs=defs, libs=libs,
+                     exe=exe, debug=debug);
+  if (numberof(res) != m) {
+    error, "unexpected output of the probing program";
+  }
+  for (j = 1; j <= m; ++j) {
+    value = 0;
+    if (sread(res(j), value) != 1) {
+      error, "unexpected output of the probing program";
+    }
+    values(i(j)) = value;
+  }
+
+  /* Save the new facts (failures are not an error). */
+  if (cache && (file = open(cache, "a", 1))) {
+    write, file, format="%s\n", "@" + key;
+    write, file, format="%d\t%s\n", values(i), queries(i);
+    close, file;
+  }
+  return values;
+}
+SYS_PROBE_CACHE = (is_void(Y_USER) ? "" : Y_USER + "dlsys-probe.cache");
+
+func _sys_probe_bad(str)
+/* DOCUMENT _sys_probe_bad(str);
+     Private function which yields whether some string of STR contains a
+     tabulation or a newline.
+ */
+{
+  if (! numberof(str)) return 0n;
+  return (anyof(strfind("\t", str)(2,..) >= 0) ||
+          anyof(strfind("\n", str)(2,..) >= 0));
+}
 /*---------------------------------------------------------------------------*/
 
 if (0) {
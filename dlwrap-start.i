@@ -1,3 +1,6 @@
-autoload, "dlwrap.i", dlopen, dlsym, dltype, dlvariant, dlwrap,
-  dlwrap_addressof, dlwrap_errno, dlwrap_fetch, dlwrap_memcpy,
-  dlwrap_memmove, dlwrap_strcpy, dlwrap_strerror, dlwrap_strlen;
+autoload, "dlwrap.i", dlbind, dlcallback, dlcompile, dlopen, dlpipeline,
+  dlsym, dltype, dlvariant, dlwrap, dlwrap_addressof, dlwrap_async,
+  dlwrap_conversions, dlwrap_declare, dlwrap_errno, dlwrap_fetch,
+  dlwrap_intern, dlwrap_map, dlwrap_memcpy, dlwrap_memmove, dlwrap_profile,
+  dlwrap_reduce, dlwrap_strcpy, dlwrap_strerror, dlwrap_strlen,
+  dlwrap_threads, dlwrap_trace, dlwrap_trace_dump;
@@ -28,7 +28,7 @@ if (is_func(plug_in)) plug_in, "dlwrap";
 extern dlopen;
 /* DOCUMENT dl = dlopen();
          or dl = dlopen(filename);
-         or dl = dlopen(filename, hints);
+         or dl = dlopen(filename, hints, loader=);
 
      This functions open a dynamic module and returns an opaque handle on it.
      FILENAME is the module file name, HINTS is an optional argument to
@@ -36,17 +36,22 @@ extern dlopen;
      HINTS is (DL_LAZY | DL_LOCAL).  If FILENAME is omitted, the code of
      Yorick itself is used (this may not work with all implementations).
 
+     Keyword LOADER can be set with the name of the implementation used to
+     load the module ("play", "dl" or "ltdl", see dlvariant) instead of the
+     default one.  Not all hints are supported by all implementations.
+
      The returned object has members:
 
        dl.path   gives the path of the module
        dl.hints  gives the value of hints
+       dl.loader gives the name of the implementation used to load it
 
      You can use dlsym() to figure out whether a particular symbol exists in
      the module and dlwrap() to create wrappers to functions defined in the
      module.
 
-     Call dlvariant() to figure out which implementation is used to load
-     dynamic modules.
+     Call dlvariant() to figure out which implementation is used by default
+     to load dynamic modules.
 
      There is no dlclose() function: when the dynamic module is no longer in
      use, it gets automatically unloaded (not all implementations can really
@@ -111,13 +116,23 @@ DL_PRELOAD   = 0x04000;
 
 extern dlvariant;
 /* DOCUMENT dlvariant();
-     This functions returns the name of the implementation used to load
-     dynamic modules:
+         or dlvariant("loader");
+         or dlvariant("backend");
+     This functions returns the name of the default implementation used to
+     load dynamic modules:
        "play" - Yorick implementation by the Portability LAYer;
        "dl"   - system interface to dynamic linking loader;
        "ltdl" - GNU Libtool library.
 
-   SEE ALSO: dlopen.
+     All the implementations available when the plugin was built are
+     compiled in.  With argument "loader", the names of the available
+     implementations are returned (the default one first), any of them can
+     be used with the LOADER keyword of dlopen.  With argument "backend",
+     the names of the available engines of the generic call machinery
+     ("ffcall" and/or "libffi", the default one first) are returned, any of
+     them can be used with the BACKEND keyword of dlwrap.
+
+   SEE ALSO: dlopen, dlwrap.
 */
 
 extern dlsym;
@@ -131,8 +146,160 @@ extern dlsym;
    SEE ALSO: dlopen, dlwrap.
 */
 
+local DLCOMPILE_CACHE, DLCOMPILE_CC;
+func dlcompile(code, cflags=, libs=, cc=, cache=, hints=, loader=)
+/* DOCUMENT dl = dlcompile(code, cflags=, libs=);
+
+     This function compiles the C source CODE (a string or an array of
+     strings, one per line) into a shared object and loads it with dlopen.
+     The result is a DLModule whose functions can be wrapped by dlwrap.  For
+     instance:
+
+       dl = dlcompile(["double dot(long n, const double *x,",
+                       "           const double *y)",
+                       "{",
+                       "  double s = 0;",
+                       "  long i;",
+                       "  for (i = 0; i < n; ++i) s += x[i]*y[i];",
+                       "  return s;",
+                       "}"], cflags="-O3");
+       dot = dlwrap(dl, DL_DOUBLE, "dot", DL_LONG,
+                    DL_DOUBLE_ARRAY, DL_DOUBLE_ARRAY);
+
+     Keyword CFLAGS gives the compiler flags (default is "-O2"), keyword LIBS
+     the libraries to link with (for instance "-lm") and keyword CC the
+     compiler (default is the value of global variable DLCOMPILE_CC,
+     initially "cc").  Flags "-shared -fPIC" are always used.  If the
+     compilation fails, an error is raised with the messages of the
+     compiler.
+
+     The shared objects are cached in the directory given by keyword CACHE,
+     by default the value of global variable DLCOMPILE_CACHE (initially
+     "dlcompile/" in the Y_USER directory).  The name of the shared object
+     is derived from a hash of the source code, of the flags and of the
+     compiler; the source is saved along with the shared object (with the
+     compiler command in its first line) and checked before reusing the
+     shared object.  Hence the compiler is only run the first time a given
+     code is compiled.  The name of the cache directory must not contain any
+     of the characters $, `, " or \.
+
+     Keywords HINTS and LOADER are passed to dlopen.  With the "dl" loader,
+     the default hints are (DL_NOW | DL_LOCAL) so that unresolved symbols
+     are reported at once; the other loaders do not support DL_NOW and use
+     the default hints of dlopen.
+
+   SEE ALSO: dlopen, dlwrap.
+*/
+{
+  if (structof(code) != string || ! is_array(code)) {
+    error, "expecting C code as an array of strings";
+  }
+  if (is_void(cc)) cc = DLCOMPILE_CC;
+  if (is_void(cflags)) cflags = "-O2";
+  if (is_void(libs)) libs = "";
+  if (is_void(cache)) cache = DLCOMPILE_CACHE;
+  if (is_void(hints)) {
+    hints = ((is_void(loader) ? dlvariant() : loader) == "dl" ?
+             (DL_NOW | DL_LOCAL) : 0);
+  }
+  if (! cache || ! strlen(cache)) {
+    error, "no cache directory for compiled code";
+  }
+  c = strchar(cache);
+  if (anyof(c == '$') || anyof(c == '`') || anyof(c == '"') ||
+      anyof(c == '\\')) {
+    error, "cache directory name must not contain $, `, \" or \\";
+  }
+  if (strpart(cache, 0:0) != "/") cache += "/";
+
+  /* The first line of the source is the compiler command so that the saved
+     source identifies the flags as well. */
+  command = cc + " -shared -fPIC " + cflags;
+  text = grow("/* " + command + " " + libs + " */", code(*));
+  source = sum(text + "\n");
+  base = cache + "dl" + _dl_hash(source + swrite(format="%d",
+                                                 sizeof(pointer)));
+  srcname = base + ".c";
+  objname = base + ".so";
+
+  /* Reuse the shared object if it has been compiled from the same source
+     (the hash may collide). */
+  file = open(objname, "rb", 1);
+  if (file) {
+    close, file;
+    file = open(srcname, "r", 1);
+  }
+  if (file) {
+    saved = "";
+    while ((line = rdline(file))) {
+      saved += line + "\n";
+    }
+    close, file;
+    if (saved == source) {
+      return dlopen(objname, hints, loader=loader);
+    }
+  }
+
+  /* Save the source and compile it into temporary files which are renamed
+     together on success, so that a failed compilation never pairs a stale
+     shared object with a new source.  The names of the temporary files are
+     derived from a file created by mktemp so that concurrent processes
+     compiling the same code do not clash. */
+  mkdirp, cache;
+  stream = popen("mktemp \"" + base + ".XXXXXX\" 2>/dev/null", 0);
+  tmpname = rdline(stream);
+  close, stream;
+  if (! tmpname) {
+    error, "cannot create temporary file in \"" + cache + "\"";
+  }
+  tmpsrc = tmpname + ".c";
+  tmpobj = tmpname + ".so";
+  file = open(tmpsrc, "w");
+  write, file, format="%s\n", text;
+  close, file;
+  script = ("(" + command + " -o \"" + tmpobj + "\" \"" + tmpsrc + "\" "
+            + libs + " 2>&1 && mv -f \"" + tmpobj + "\" \"" + objname
+            + "\" && mv -f \"" + tmpsrc + "\" \"" + srcname
+            + "\"); status=$?; rm -f \"" + tmpobj + "\" \"" + tmpsrc
+            + "\" \"" + tmpname + "\"; echo $status");
+  stream = popen(script, 0);
+  output = [];
+  while ((line = rdline(stream))) {
+    grow, output, line;
+  }
+  close, stream;
+  status = -1;
+  if (numberof(output) < 1 || sread(output(0), status) != 1 || status) {
+    if (numberof(output) > 1) {
+      error, sum(output(1:-2) + "\n") + "compilation failed";
+    }
+    error, "compilation failed";
+  }
+  return dlopen(objname, hints, loader=loader);
+}
+DLCOMPILE_CC = "cc";
+DLCOMPILE_CACHE = (is_void(Y_USER) ? "" : Y_USER + "dlcompile/");
+
+func _dl_hash(str)
+/* DOCUMENT _dl_hash(str);
+     Private function which yields the 32-bit FNV-1a hash of the scalar
+     string STR as a string of 8 hexadecimal digits.
+ */
+{
+  c = long(strchar(str));
+  n = numberof(c) - 1; /* skip final null */
+  h = 2166136261;
+  for (i = 1; i <= n; ++i) {
+    h = ((h ~ c(i))*16777619) & 0xffffffff;
+  }
+  return swrite(format="%08x", h);
+}
+
 extern dlwrap;
 /* DOCUMENT fn = dlwrap(dl, rtype, name, atype1, atype2, ..., atypeN);
+         or fn = dlwrap(dl, rtype, name, atype1, ..., atypeN,
+                        size=, dims=, free=, cache=, evict=, backend=,
+                        lazy=);
 
      This functions creates a function-like object that can be called later.
      DL is the handle returned by dlopen, NAME is the name of the function,
@@ -157,6 +324,131 @@ extern dlwrap;
        fn.rtype  --> the identifier of the return type;
        fn.atypes --> the identifiers of the arguments (as a vector of long
                      integer(s); or nil, if there are no arguments).
+       fn.path   --> the name of the method used to call the function:
+                     "thunk" for a specialized caller (see below), "jit"
+                     for a native trampoline, "ffcall" or "libffi" for the
+                     generic machinery, "lazy" if FN has not yet been bound
+                     (see keyword LAZY below).
+       fn.backend --> the engine of the generic machinery ("ffcall" or
+                     "libffi"), used for the calls not handled by the
+                     specialized caller or the native trampoline.
+       fn.strict --> whether FN has been created with DL_STRICT;
+       fn.conversions --> the number of array arguments which have been
+                     converted (see dlwrap_conversions);
+       fn.copied --> the number of bytes copied by these conversions;
+       fn.hits, fn.misses --> the number of calls answered or not by the
+                     cache of a DL_PURE function;
+       fn.cached, fn.capacity --> the current and maximum number of results
+                     stored in this cache;
+       fn.ncalls, fn.nerrors, fn.ns_total, fn.ns_max, fn.ns_marshal --> the
+                     profiling counters of FN (see dlwrap_profile).
+
+     For the most common signatures, namely: double(double),
+     double(double,double), int(int), long(void), int(pointer,long) and
+     long(int,pointer,long), the wrapped function is directly called by a
+     specialized function (a "thunk") which bypasses the generic machinery.
+
+     Keyword BACKEND selects how FN calls the function, this is meant to
+     compare the different methods without rebuilding the plugin:
+
+       "auto"   - use a thunk if any, else a native trampoline if DL_JIT is
+                  set, else the generic machinery (this is the default);
+       "thunk"  - use a thunk, an error is raised if there is none for the
+                  signature of the function;
+       "jit"    - use a native trampoline (as if DL_JIT were set but without
+                  a thunk), an error is raised if none can be generated;
+       "ffcall", "libffi" - only use the generic machinery with the given
+                  engine (see dlvariant for the available ones).
+
+     By default the engine is FFCALL if available, LIBFFI otherwise or if
+     structures are passed by value.
+
+     Some attributes can be bitwise or'ed with the return type RTYPE:
+
+       DL_JIT - Generate a native trampoline to call the function.  This is
+              only available on x86-64 Linux machines and for functions
+              whose arguments are all passed in registers (at most 6
+              integer/pointer arguments and 8 floating-point arguments, a
+              complex counts for 2).  If no native trampoline can be
+              generated, the generic machinery is used.  Specialized
+              callers have precedence over native trampolines.
+
+       DL_THREADSAFE - The function can be safely called from several threads
+              at the same time.  This lets dlwrap_map() split the work
+              among several threads (see dlwrap_threads).
+
+       DL_STRICT - Array arguments must have exactly the type expected by
+              the function, an error is raised for any array argument
+              which would otherwise be converted.  This guarantees that
+              the function works directly with the caller's data (no
+              copies are made and any changes are visible to the caller).
+
+       DL_PURE - The result of the function only depends on the values of
+              its arguments and the function has no side effects.  The
+              results are memoized in a cache bounded to CACHE entries (256
+              by default) and keyed on the values of the arguments.  When
+              the cache is full, the least recently used entry is evicted
+              if EVICT="lru" (the default) or the oldest one if
+              EVICT="fifo".  The result and the arguments must be
+              numerical scalars.  Only direct calls to FN use the cache,
+              not dlwrap_map, dlbind, etc.  When a result is taken from the
+              cache, dlwrap_errno() yields zero.
+
+     For instance:
+
+       dll_fma = dlwrap(dll, DL_DOUBLE|DL_JIT, "fma",
+                        DL_DOUBLE, DL_DOUBLE, DL_DOUBLE);
+
+     An argument of type DL_*_OUT or DL_*_INOUT (see dltype) is a pointer to
+     a numerical scalar which is set by the called function.  The
+     corresponding argument of FN must be a simple variable which is
+     assigned the value stored by the function on return.  For a DL_*_INOUT
+     argument, the variable must be defined before the call and its value is
+     passed to the function.  For instance:
+
+       frexp = dlwrap(libm, DL_DOUBLE, "frexp", DL_DOUBLE, DL_INT_OUT);
+       m = frexp(x, e); // e is set with the exponent of x
+
+     A function may return an array of numerical values (RTYPE is one of
+     DL_CHAR_ARRAY, DL_SHORT_ARRAY, ..., DL_COMPLEX_ARRAY).  Keyword SIZE or
+     DIMS must then be specified to size the result: SIZE=J means that the
+     number of elements is given by the J-th argument (an integer or an
+     integer output argument), DIMS is a constant dimension list (or a
+     number of elements).  Keyword FREE may be set with a wrapped function,
+     taking the address of the array, to call when the result is no longer
+     used.  The result is an external array object (or nil if the function
+     returns NULL) which keeps the C memory without copying it:
+
+       arr(i)      --> a copy of the element(s) at linear index(es) I;
+       arr()       --> a copy of all the elements;
+       arr.dims    --> the dimension list;
+       arr.number  --> the number of elements;
+       arr.type    --> the type identifier of the elements;
+       arr.address --> the address of the first element.
+
+     An external array can be passed without any copy to a wrapped function
+     for an array argument of the same type.  For instance:
+
+       make_grid = dlwrap(lib, DL_DOUBLE_ARRAY, "make_grid", DL_LONG,
+                          size=1, free=dlwrap(libc, DL_VOID, "free",
+                                              DL_POINTER));
+       grid = make_grid(n);
+
+     If keyword LAZY is true, the symbol is not resolved by dlwrap: FN only
+     stores the types and the name of the function and is bound (the symbol
+     is resolved and the call is prepared) in place the first time it is
+     used.  An error about a missing symbol is thus only raised by the first
+     call.  This is meant for tables of many functions of which only a few
+     are actually called (see dlsys.i).
+
+     Wrappers are interned: an identical request (same module, symbol,
+     types, attributes and keywords) yields the same shared wrapper object
+     without resolving the symbol nor parsing the types again, as long as
+     this wrapper is in use (see dlwrap_intern).  Beware that the mutable
+     state of a wrapper is then shared between all the identical calls to
+     dlwrap: its profiling counters (see dlwrap_profile), its conversion
+     counters (see DL_STRICT) and the cache of results of a DL_PURE
+     function.
 
      To get textual information about the dynamic function object FN, you must
      use info or print built-in functions, e.g.:
@@ -165,10 +457,24 @@ extern dlwrap;
 
      Yorick warrants that it stores structures in memory like the compiler so
      you can exchange (arrays of) structures consistently between Yorick and a
-     module.  However you'll have to use DL_POINTER or DL_POINTER_ARRAY for
-     the corresponding argument type and take care of passing the address of
-     the structure (&arg).  Of course you'll also have to take care of
-     defining a Yorick structure matching its C counterpart.
+     module.  To pass (arrays of) structures by address, you'll have to use
+     DL_POINTER or DL_POINTER_ARRAY for the corresponding argument type and
+     take care of passing the address of the structure (&arg).  Of course
+     you'll also have to take care of defining a Yorick structure matching
+     its C counterpart.
+
+     A structure passed or returned by value is specified by its definition
+     (instead of a type identifier) for RTYPE or for any ATYPE.  The layout
+     of the structure is computed once by dlwrap and the structure is passed
+     according to the calling conventions of the machine.  The corresponding
+     argument of FN must be a scalar instance of this very structure and the
+     result is a new instance.  Structures returned by value cannot have
+     string nor pointer members.  This requires the plugin to be built with
+     LIBFFI (and BACKEND cannot be "ffcall").  For instance:
+
+       struct point { double x, y; }
+       padd = dlwrap(lib, point, "point_add", point, point);
+       p = padd(point(x=1, y=2), point(x=3, y=4));
 
      As a general rule, prefer to use Yorick to allocate memory for arrays so
      that Yorick will take care of freeing unused data for you.  This does not
@@ -186,13 +492,497 @@ extern dlwrap;
      that the buffer address is a long integer).
 
 
-   SEE ALSO: dlopen, dlsym, dltype, identof.
+   SEE ALSO: dlopen, dlsym, dltype, identof, dlwrap_conversions.
 */
+DL_JIT = 0x00100;
+DL_THREADSAFE = 0x00200;
+DL_STRICT = 0x00400;
+DL_PURE = 0x00800;
+
+extern dlwrap_declare;
+/* DOCUMENT tab = dlwrap_declare(dl, prototypes, typedefs=, lazy=);
+
+     This function creates the wrappers of the functions whose C prototypes
+     are given by the string(s) PROTOTYPES (blank ones are ignored) in the
+     dynamic module DL.  All the wrappers are built by this single call (as
+     by dlwrap, hence interned) and are returned in a table indexed by the
+     names of the functions:
+
+       tab.NAME   --> the wrapper of function NAME;
+       tab("NAME") --> the same, for a name given by a variable;
+       tab()      --> the names of the functions (sorted).
+
+     The prototypes are written as in C, the names of the arguments and the
+     final semicolon are optional:
+
+       tab = dlwrap_declare(dlopen(), ["ssize_t read(int, void*, size_t)",
+                                       "double hypot(double x, double y);",
+                                       "const char *strerror(int)"]);
+       n = tab.read(fd, &buf, sizeof(buf));
+
+     The C types are mapped to the types of dlwrap as follows:
+
+       T          -> T for a numerical type T (char, short, int, long,
+                     float, double or double complex, there are no
+                     unsigned types in Yorick);
+       const char* -> DL_STRING for an argument;
+       char*      -> DL_STRING for the result;
+       T*         -> DL_POINTER for an argument, DL_ADDRESS for the result;
+       T x[]      -> DL_T_ARRAY for an argument;
+       char *x[]  -> DL_STRING_ARRAY for an argument;
+       T *x[]     -> DL_POINTER_ARRAY for an argument.
+
+     Only a plain char (neither signed nor unsigned, nor given by a typedef
+     such as int8_t or uint8_t) is taken as text: pointers to other bytes
+     are binary data (DL_POINTER or DL_ADDRESS).
+
+     An argument qualified by OUT (resp. INOUT) is an output (resp.
+     input/output) argument: "OUT T*" yields DL_T_OUT for a numerical type
+     T and "OUT T**" yields DL_ADDRESS_OUT.  Structures passed by value and
+     variadic functions are not supported, use dlwrap for the former.
+
+     Besides the basic C types, the common system types (size_t, ssize_t,
+     ptrdiff_t, off_t, pid_t, uid_t, gid_t, mode_t, key_t, time_t,
+     socklen_t, int8_t, ..., uint64_t, etc.) are known.  Other type names
+     can be defined by keyword TYPEDEFS set with C typedef declarations
+     which may refer to the previous ones and have precedence over the
+     known types:
+
+       typedefs=["typedef long address_t", "typedef address_t handle_t"]
+
+     If keyword LAZY is true, the wrappers are bound on first use (see
+     dlwrap): unresolved symbols are only reported by the first call.
+
+   KEYWORDS: lazy, typedefs.
+
+   SEE ALSO: dlwrap, dlopen.
+ */
+
+extern dlwrap_map;
+/* DOCUMENT y = dlwrap_map(fn, arg1, ..., argN);
+         or dlwrap_map, fn, arg1, ..., argN, out=y;
+
+     This function applies the wrapped function FN elementwise to the
+     arguments ARG1, ..., ARGN which are arrays (or scalars) conformable
+     according to Yorick's broadcasting rules.  The result is an array whose
+     dimensions are those of the broadcast arguments and whose elements are
+     given by calling FN with the corresponding elements of the arguments.
+     The loop over the elements is done in compiled code which is much faster
+     than calling FN in an interpreted loop.
+
+     FN must take at least one argument and all its arguments and its result
+     must be numerical scalars (DL_CHAR, DL_SHORT, DL_INT, DL_LONG,
+     DL_FLOAT, DL_DOUBLE or DL_COMPLEX).  The arguments are converted, if
+     needed, to the types expected by FN.
+
+     Keyword OUT can be used to specify an array where to store the result.
+     The type and the dimensions of OUT must exactly match those of the
+     result.  When called as a function with keyword OUT, OUT is returned.
+
+     For instance:
+
+       dll_hypot = dlwrap(dlopen("libm.so"), DL_DOUBLE, "hypot",
+                          DL_DOUBLE, DL_DOUBLE);
+       r = dlwrap_map(dll_hypot, x, y(-,));
+
+     If the arguments and the result of FN are all of type double (or all
+     of type float) and if the dynamic module of FN provides a vector
+     variant of the function (following the x86-64 vector function ABI,
+     e.g. "_ZGVdN4v_sin" for the AVX2 variant of "sin"), the vector variant
+     is used for the bulk of the elements (the most efficient variant
+     supported by the CPU is chosen) and the scalar function for the
+     remaining ones.  With glibc, the vector variants of the mathematical
+     functions are provided by libmvec (which depends on libm).  If the
+     module of FN does not provide the vector variant, it is looked for in
+     "libmvec.so.1" which is loaded the first time it is needed, so:
+
+       dll_sin = dlwrap(dlopen(), DL_DOUBLE, "sin", DL_DOUBLE);
+       y = dlwrap_map(dll_sin, x);
+
+     gives access to the scalar and vector versions of "sin".  Beware that
+     vector variants may not set errno and that their results may differ
+     from those of the scalar function by a few ULPs.
+
+     If FN has been created with the DL_THREADSAFE attribute and the result
+     is large enough, the work is split in chunks which are processed in
+     parallel by a pool of threads (see dlwrap_threads).
+
+     Function dlwrap_errno() yields the value of errno after the last call
+     (in the last chunk with an error if the work was split).
+
+   SEE ALSO: dlwrap, dlwrap_errno, dlwrap_reduce, dlwrap_threads.
+ */
+
+extern dlwrap_reduce;
+/* DOCUMENT r = dlwrap_reduce(fn, op, arg1, ..., argN);
+
+     This function applies the wrapped function FN elementwise to the
+     arguments ARG1, ..., ARGN (as dlwrap_map does) and reduces the result
+     according to the operation OP which is one of:
+
+       "sum"   - the sum of the elements;
+       "prod"  - the product of the elements;
+       "min"   - the minimum of the elements;
+       "max"   - the maximum of the elements;
+       "avg"   - the average of the elements;
+       "count" - the number of non-zero elements.
+
+     The result is never stored as a whole: the elements are computed by
+     small blocks which are folded on the fly.  For instance:
+
+       dlwrap_reduce(fn, "max", x, y)
+
+     yields the same result as max(dlwrap_map(fn, x, y)) but is faster and
+     requires no temporary array.
+
+     The result is a long integer for "count" and if FN returns an integer
+     (except for "avg" which yields a double), a complex if FN returns a
+     complex ("min" and "max" are not allowed in that case) and a double
+     otherwise.  If FN has been created with the DL_THREADSAFE attribute,
+     the work may be split among several threads in which case the order in
+     which the elements are summed is not specified.
+
+   SEE ALSO: dlwrap_map, dlwrap_threads.
+ */
+
+extern dlcallback;
+/* DOCUMENT cb = dlcallback(f, rtype, atype1, ..., atypeN);
+         or cb = dlcallback(fn);
+
+     This function returns a callback object CB, that is the address of a
+     function which can be given to a wrapped function expecting a pointer
+     to a function (for instance, the comparison function of qsort).  CB can
+     be directly passed for a DL_POINTER argument, its address is also
+     given by CB.address (for a DL_ADDRESS argument).
+
+     In the first form, F is a Yorick function which is called when CB is
+     called by compiled code.  RTYPE and ATYPE1, ..., ATYPEN are the return
+     and argument types of CB (at most 8 arguments).  These types must be
+     numerical scalars (DL_CHAR, ..., DL_COMPLEX) or DL_POINTER for an
+     address which is given to F as an integer; RTYPE may also be DL_VOID.
+     This requires the plugin to be built with LIBFFI.  For instance:
+
+       func cmp(a, b)
+       {
+         x = dlwrap_fetch(a, int);
+         y = dlwrap_fetch(b, int);
+         return (x > y) - (x < y);
+       }
+       qsort = dlwrap(dlopen(), DL_VOID, "qsort", DL_INT_ARRAY, DL_LONG,
+                      DL_LONG, DL_POINTER);
+       qsort, arr, numberof(arr), sizeof(int),
+         dlcallback(cmp, DL_INT, DL_POINTER, DL_POINTER);
+
+     Calling a Yorick function has the cost of the interpreter.  In the
+     second form, FN is a wrapped function and CB is the address of the
+     compiled function which is then called at full speed without
+     involving the interpreter.  A wrapped function can also be directly
+     passed for a DL_POINTER argument, for instance:
+
+       qsort, arr, numberof(arr), sizeof(int),
+         dlwrap(lib, DL_INT, "compare_ints", DL_POINTER, DL_POINTER);
+
+     A callback must be kept alive (and not be redefined) as long as the
+     compiled code may call it.  A callback made from a Yorick function must
+     only be called from the main thread while a wrapped function is
+     running: the interpreter cannot be entered from another thread.
+     Hence such a callback cannot be given to a function wrapped with the
+     DL_THREADSAFE attribute (which may be run by worker threads, see
+     dlwrap_map) nor be called asynchronously (see dlwrap_async), an error
+     is raised when the call is made.  It must not be given to compiled
+     code which calls it from threads of its own either.  If the plugin is
+     built with pthreads, such calls are detected and, as no error can be
+     raised, F is not called and the result is zero; otherwise their
+     behavior is undefined.  If an error occurs in F
+     (including a result of the wrong type), the foreign code which called
+     the callback is aborted without any cleanup: the memory it allocated
+     is leaked, the locks it holds are not released and the data it was
+     modifying may be left inconsistent.  Global variables _dlcb_func,
+     _dlcb_result and _dlcb_arg1, ..., _dlcb_arg8 and private functions
+     _dlcb_call0, ..., _dlcb_call8 and _dlcb_sub0, ..., _dlcb_sub8 (defined
+     when first needed) are used to call Yorick functions.
+
+     The returned object has the following members:
+
+       cb.address  --> the address of the callback;
+       cb.function --> the Yorick function or the wrapped function;
+       cb.nargs    --> the number of arguments;
+       cb.native   --> whether the callback is a compiled function.
+
+   SEE ALSO: dlwrap, dlwrap_fetch.
+ */
+
+extern dlbind;
+/* DOCUMENT fb = dlbind(fn, argJ=valJ, argK=valK, ...);
+
+     This function binds some arguments of the wrapped function FN to fixed
+     values and returns a new callable object FB which takes the other
+     (free) arguments in their original order.  The arguments to bind are
+     specified by keywords ARG1, ARG2, etc. (ARGJ being the J-th argument of
+     FN).  For instance:
+
+       read_fd = dlbind(SYS.read, arg1=fd);
+       n = read_fd(&buf, sizeof(buf));
+
+     The values of the bound arguments are converted once by dlbind(), only
+     the free arguments are fetched and converted when FB is called.  The
+     bound values are kept alive by FB; an array argument is passed by
+     reference if it has exactly the type expected by FN (its contents may
+     therefore change between calls), otherwise it is converted once and
+     the same copy is used by all calls.  If all arguments of FN are bound,
+     FB must be called with a single nil argument, e.g. FB().
+
+     The returned object has the following members:
+
+       fb.nargs   --> the number of free arguments;
+       fb.bound   --> the indices of the bound arguments (nil if none);
+       fb.wrapper --> the wrapped function FN.
+
+     Function dlwrap_errno() yields the value of errno after the last call.
+
+   SEE ALSO: dlwrap, dlpipeline.
+ */
+
+extern dlpipeline;
+/* DOCUMENT pl = dlpipeline(fn1, wire1, fn2, wire2, ..., fnN, wireN);
+
+     This function creates a pipeline of wrapped functions FN1, FN2, ...,
+     FNN which are called one after the other, in that order, when the
+     pipeline is called:
+
+       res = pl(arg1, ..., argM);
+
+     The calls are all done in compiled code, the intermediate results are
+     kept in native storage and are not converted to Yorick values.  The
+     result of the pipeline is that of the last executed stage.
+
+     WIREK specifies the sources of the arguments of FNK (the K-th stage),
+     it is a vector of integers with one element per argument of FNK (or nil
+     if FNK has no arguments).  A source J > 0 means the J-th argument of
+     the pipeline while a source J < 0 means the result of the -J-th stage
+     (which must be a previous one).  The number M of arguments of the
+     pipeline is the largest positive source.  Results of integer or
+     floating-point type can be passed to numerical arguments (with
+     conversion) and integer results to pointer arguments.
+
+     Keyword STOP can be used to stop the execution of the pipeline after a
+     stage depending on its result.  STOP is a string (the same predicate
+     for all stages) or a vector of strings (one per stage) among:
+
+       "none"     - never stop;
+       "negative" - stop if the result is strictly negative;
+       "zero"     - stop if the result is zero (or a NULL string);
+       "nonzero"  - stop if the result is non-zero;
+       "errno"    - stop if errno has been set by the call.
+
+     The returned object has the following members:
+
+       pl.nstages --> the number of stages;
+       pl.ninputs --> the number of arguments of the pipeline;
+       pl.stage   --> the index of the last executed stage.
+
+     Function dlwrap_errno() yields the value of errno after the last
+     executed stage.
+
+     For instance, to seek and read in a file (see dlsys.i):
+
+       seek_read = dlpipeline(SYS.lseek, [1,2,3], SYS.read, [1,4,5],
+                              stop="negative");
+       n = seek_read(fd, offset, SYS.SEEK_SET, &buf, sizeof(buf));
+
+   SEE ALSO: dlwrap, dlbind, dlwrap_errno.
+ */
+
+extern dlwrap_async;
+/* DOCUMENT fut = dlwrap_async(fn, arg1, ..., argN);
+
+     This function starts calling the wrapped function FN with arguments
+     ARG1, ..., ARGN in a background thread and immediately returns a
+     "future" object FUT to collect the result of the call later.  This lets
+     Yorick do other work (or start other asynchronous calls) while long
+     computations or blocking I/O are done by compiled code.
+
+     The arguments are converted by dlwrap_async() (in the calling thread)
+     and FUT keeps a reference on them so that their data are not released
+     before the call has finished; the data of an array argument should not
+     be modified while the call is running.  The returned object has the
+     following members:
+
+       fut.ready   --> whether the call has finished (without blocking);
+       fut.wait    --> wait for the call to finish (and yield true);
+       fut.result  --> the result of the call (waiting if needed);
+       fut.errno   --> the value of errno after the call (waiting if
+                       needed);
+       fut.wrapper --> the wrapped function FN.
+
+     FUT() is the same as FUT.result.  When the result is collected,
+     dlwrap_errno() is set with the value of errno after the call.
+
+     FN must not have output arguments nor return an array, and callbacks
+     made from Yorick functions cannot be passed to FN.  FN must be safe to
+     call while the main thread keeps running (and possibly calls FN or
+     other functions).  If the plugin has been built without POSIX threads
+     support, the call is done by dlwrap_async() itself.  Destroying FUT
+     waits for the call to finish.  For instance:
+
+       fut = dlwrap_async(SYS.read, fd, &buf, sizeof(buf));
+       ...; // do something else
+       n = fut.result;
+
+   SEE ALSO: dlwrap, dlwrap_errno.
+ */
+
+extern dlwrap_profile;
+/* DOCUMENT dlwrap_profile, flag;
+         or dlwrap_profile;
+         or dlwrap_profile();
+
+     This function manages the profiling of the calls to wrapped functions.
+     If FLAG is true (resp. false), profiling is enabled (resp. disabled).
+     Profiling is disabled by default.  When called as a subroutine without
+     FLAG, a table of the profiled wrappers (which are still alive) is
+     printed by decreasing time spent in native code.  If keyword RESET is
+     true, the counters of all wrappers are reset to zero (after printing).
+     When called as a function, the returned value is whether profiling was
+     enabled before the call.
+
+     The following counters are maintained for each wrapped function FN and
+     can be queried as members of FN:
+
+       fn.ncalls     --> the number of profiled calls;
+       fn.nerrors    --> the number of profiled calls which have set errno;
+       fn.ns_total   --> the time spent in native code (in nanoseconds);
+       fn.ns_max     --> the maximum time spent in native code by a call;
+       fn.ns_marshal --> the time spent converting the arguments.
+
+     In the printed table, "mean" and "marshal" are average times per call.
+     Only direct calls FN(...) are profiled.  Calls to a DL_PURE function,
+     or to a function with output arguments, structures passed by value or
+     returning an array are timed as a whole (the conversion of the
+     arguments is then accounted as time spent in native code).  When
+     profiling is disabled, the calls are not slowed down.
+
+   KEYWORDS: reset.
+
+   SEE ALSO: dlwrap, dlwrap_trace.
+ */
+
+extern dlwrap_intern;
+/* DOCUMENT dlwrap_intern, flag;
+         or dlwrap_intern;
+         or dlwrap_intern, clear=1;
+         or stats = dlwrap_intern();
+
+     This function manages the table of interned wrappers.  When interning
+     is enabled (the default), the wrappers created by dlwrap are stored in a
+     table keyed on the handle of the dynamic module, the symbol name, the
+     types (with their attributes) and the keywords, and an identical request
+     to dlwrap returns the existing wrapper.  Requests with structures passed
+     by value or with more than 32 arguments are not interned.  The table
+     holds no references: a wrapper (and its dynamic module) is freed as
+     usual when no longer in use and is then removed from the table.
+
+     If FLAG is true (resp. false), interning is enabled (resp. disabled),
+     the wrappers already interned are kept.  When called as a subroutine
+     without FLAG nor CLEAR, the interned wrappers are printed with the
+     number of requests they have answered.  If keyword CLEAR is true, the
+     table is emptied (the wrappers are not freed, but later requests create
+     new ones) and the counters are reset.
+     When called as a function, STATS = [NUMBER, HITS, MISSES] is returned
+     (before clearing) with NUMBER the number of interned wrappers, HITS and
+     MISSES the number of requests answered or not by the table.
+
+   KEYWORDS: clear.
+
+   SEE ALSO: dlwrap.
+ */
+
+extern dlwrap_trace;
+extern dlwrap_trace_dump;
+/* DOCUMENT dlwrap_trace, size;
+         or dlwrap_trace();
+         or dlwrap_trace_dump, filename;
+
+     These functions record the timeline of the calls to wrapped functions.
+     dlwrap_trace() with SIZE > 0 starts tracing: an entry is recorded for
+     each call in a ring buffer of SIZE entries (rounded up to a power of 2)
+     where the oldest entries are overwritten when it is full.  Previously
+     recorded entries are discarded.  dlwrap_trace() with SIZE = 0 stops
+     tracing (the recorded entries are kept).  The returned value is the
+     number of entries available in the buffer.
+
+     An entry has the name of the called function, the start and end times
+     of the call, the type of the result and the value of errno after the
+     call.  Recording an entry is cheap (a few tens of nanoseconds) and only
+     direct calls FN(...) are traced (like with dlwrap_profile).
+
+     dlwrap_trace_dump() writes the recorded entries (from the oldest to the
+     newest) in file FILENAME.  By default, the file is in the JSON trace
+     event format which can be viewed by Chrome (chrome://tracing) or
+     Perfetto.  With keyword BINARY set true, the file is written in a
+     compact binary format (all values are in native byte order):
+
+       "YDLTRACE"     - 8-byte magic;
+       NNAMES, NENTRIES - number of names and of entries (2 longs);
+       names          - NNAMES times: length (an int) and characters;
+       entries        - NENTRIES times: start and end times (2 longs, in
+                        nanoseconds relative to the start of tracing),
+                        index of name (from 0), errno, identifier of the
+                        result type (like fn.rtype) and padding (4 ints).
+
+   KEYWORDS: binary.
+
+   SEE ALSO: dlwrap, dlwrap_profile.
+ */
+
+extern dlwrap_conversions;
+/* DOCUMENT dlwrap_conversions();
+         or dlwrap_conversions(fn);
+
+     This function returns [NCONV,NBYTES] where NCONV is the number of array
+     arguments which have been converted to the type expected by a wrapped
+     function and NBYTES is the number of bytes of the copies made by these
+     conversions.  The counts are global (for all wrapped functions) unless
+     a wrapped function FN is specified.  If keyword RESET is true, the
+     counters are reset to zero after having been read.
+
+     For instance, an int array passed to a DL_DOUBLE_ARRAY argument is
+     converted into a temporary double array: the called function does not
+     work with the data of the caller.  Use DL_STRICT to forbid such
+     conversions.
+
+   KEYWORDS: reset.
+
+   SEE ALSO: dlwrap.
+ */
+
+extern dlwrap_threads;
+/* DOCUMENT dlwrap_threads, nthreads, chunk;
+         or dlwrap_threads();
+
+     This function configures the pool of threads used by dlwrap_map() for
+     functions created with the DL_THREADSAFE attribute.  NTHREADS is the
+     number of threads (including the main one) and CHUNK is the number of
+     elements processed at a time by a thread.  If an argument is nil or
+     zero, the corresponding setting is left unchanged.  The returned value
+     is [NTHREADS,CHUNK] with the current settings.  By default, NTHREADS is
+     the number of available processors and CHUNK is 65536.
+
+     The worker threads are only started when needed and persist between
+     calls.  Parallel execution requires that the plugin has been compiled
+     with POSIX threads support (otherwise NTHREADS is always 1).
+
+   SEE ALSO: dlwrap_map.
+ */
 
 local DL_VOID,DL_CHAR,DL_SHORT,DL_INT,DL_LONG,DL_FLOAT,DL_DOUBLE,DL_COMPLEX;
 local DL_STRING,DL_POINTER,DL_CHAR_ARRAY,DL_SHORT_ARRAY,DL_INT_ARRAY;
 local DL_LONG_ARRAY,DL_FLOAT_ARRAY,DL_DOUBLE_ARRAY,DL_COMPLEX_ARRAY;
-local DL_STRING_ARRAY,DL_POINTER_ARRAY;
+local DL_STRING_ARRAY,DL_POINTER_ARRAY,DL_OUT,DL_INOUT,DL_CHAR_OUT;
+local DL_SHORT_OUT,DL_INT_OUT,DL_LONG_OUT,DL_FLOAT_OUT,DL_DOUBLE_OUT;
+local DL_COMPLEX_OUT,DL_ADDRESS_OUT,DL_CHAR_INOUT,DL_SHORT_INOUT,DL_INT_INOUT;
+local DL_LONG_INOUT,DL_FLOAT_INOUT,DL_DOUBLE_INOUT,DL_COMPLEX_INOUT;
+local DL_ADDRESS_INOUT;
 func dltype(arg, arr)
 /* DOCUMENT dltype(arg);
          or dltype(arg, arr);
@@ -227,15 +1017,24 @@ func dltype(arg, arr)
      | DL_STRING          char*     yes   (d)     |
      | DL_ADDRESS         void*     yes   (b)     |
      | DL_POINTER         void*     no    (b)     |
-     | DL_CHAR_ARRAY      char*     no    (e)     |
-     | DL_SHORT_ARRAY     short*    no    (e)     |
-     | DL_INT_ARRAY       int*      no    (e)     |
-     | DL_LONG_ARRAY      long*     no    (e)     |
-     | DL_FLOAT_ARRAY     float*    no    (e)     |
-     | DL_DOUBLE_ARRAY    double*   no    (e)     |
-     | DL_COMPLEX_ARRAY   double*   no    (e)     |
+     | DL_CHAR_ARRAY      char*     yes   (e,g)   |
+     | DL_SHORT_ARRAY     short*    yes   (e,g)   |
+     | DL_INT_ARRAY       int*      yes   (e,g)   |
+     | DL_LONG_ARRAY      long*     yes   (e,g)   |
+     | DL_FLOAT_ARRAY     float*    yes   (e,g)   |
+     | DL_DOUBLE_ARRAY    double*   yes   (e,g)   |
+     | DL_COMPLEX_ARRAY   double*   yes   (e,g)   |
      | DL_STRING_ARRAY    char**    no    (e)     |
      | DL_POINTER_ARRAY   void**    no    (e)     |
+     | DL_CHAR_OUT        char*     no    (f)     |
+     | DL_SHORT_OUT       short*    no    (f)     |
+     | DL_INT_OUT         int*      no    (f)     |
+     | DL_LONG_OUT        long*     no    (f)     |
+     | DL_FLOAT_OUT       float*    no    (f)     |
+     | DL_DOUBLE_OUT      double*   no    (f)     |
+     | DL_COMPLEX_OUT     double*   no    (f)     |
+     | DL_ADDRESS_OUT     void**    no    (f)     |
+     | (structure)        struct    yes   (h)     |
      +--------------------------------------------+
 
      (a) DL_VOID is only allowed for the return type.  It is sufficient to
@@ -251,6 +1050,15 @@ func dltype(arg, arr)
      (e) An array of any dimensionality is stored as a "flat" array by Yorick
          and its length is given, by numberof().  Without the "_ARRAY" suffix,
          a Yorick scalar is meant.
+     (f) An output argument is a variable set on return with the scalar
+         stored by the function (see dlwrap).  The types of input/output
+         arguments have a "_INOUT" suffix instead of "_OUT".  Output types
+         are obtained by bitwise or'ing the scalar type with DL_OUT (value
+         64) or DL_INOUT (value 192).
+     (g) An array result is returned as an external array (see dlwrap).
+     (h) A structure passed by value is specified by its definition (see
+         dlwrap), dltype returns the definition itself for a scalar
+         structure.
 
      For convenience and if a corresponding primitive type is found at
      runtime, DL_INT_8, DL_INT_16, DL_INT_32, DL_INT_64 and their *_ARRAY
@@ -276,6 +1084,7 @@ func dltype(arg, arr)
     if (arg == complex) return (arr ? DL_COMPLEX_ARRAY : DL_COMPLEX);
     if (arg == string)  return (arr ? DL_STRING_ARRAY  : DL_STRING);
     if (arg == pointer) return (arr ? DL_POINTER_ARRAY : DL_POINTER);
+    if (! arr) return arg; /* structure passed by value */
   }
   error, "not a primitive type";
 }
@@ -306,6 +1115,22 @@ if (! is_void(DL_INT_8)) DL_INT_8_ARRAY = DL_INT_8 | 32;
 if (! is_void(DL_INT_16)) DL_INT_16_ARRAY = DL_INT_16 | 32;
 if (! is_void(DL_INT_32)) DL_INT_32_ARRAY = DL_INT_32 | 32;
 if (! is_void(DL_INT_64)) DL_INT_64_ARRAY = DL_INT_64 | 32;
+DL_OUT = 64;
+DL_INOUT = 192;
+DL_CHAR_OUT = DL_CHAR | DL_OUT;
+DL_SHORT_OUT = DL_SHORT | DL_OUT;
+DL_INT_OUT = DL_INT | DL_OUT;
+DL_LONG_OUT = DL_LONG | DL_OUT;
+DL_FLOAT_OUT = DL_FLOAT | DL_OUT;
+DL_DOUBLE_OUT = DL_DOUBLE | DL_OUT;
+DL_COMPLEX_OUT = DL_COMPLEX | DL_OUT;
+DL_CHAR_INOUT = DL_CHAR | DL_INOUT;
+DL_SHORT_INOUT = DL_SHORT | DL_INOUT;
+DL_INT_INOUT = DL_INT | DL_INOUT;
+DL_LONG_INOUT = DL_LONG | DL_INOUT;
+DL_FLOAT_INOUT = DL_FLOAT | DL_INOUT;
+DL_DOUBLE_INOUT = DL_DOUBLE | DL_INOUT;
+DL_COMPLEX_INOUT = DL_COMPLEX | DL_INOUT;
 if (sizeof(pointer) == sizeof(long)) {
   DL_ADDRESS = DL_LONG;
 } else if (sizeof(pointer) == sizeof(int)) {
@@ -313,6 +1138,8 @@ if (sizeof(pointer) == sizeof(long)) {
 } else {
   error, "expecting that 'long' or 'int' have the same size as a 'pointer'";
 }
+DL_ADDRESS_OUT = DL_ADDRESS | DL_OUT;
+DL_ADDRESS_INOUT = DL_ADDRESS | DL_INOUT;
 
 extern dlwrap_strlen;
 extern dlwrap_strcpy;
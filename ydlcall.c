@@ -24,21 +24,64 @@
  */
 
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
 #if defined(HAVE_FFCALL)
+# define USE_FFCALL 1
 # include <avcall.h>
-#elif defined(HAVE_LIBFFI)
-# error libffi not yet supported
-#else
+#endif
+#if defined(HAVE_LIBFFI)
+# define USE_LIBFFI 1
+# include <fenv.h>
+# include <ffi.h>
+#endif
+#if ! defined(USE_FFCALL) && ! defined(USE_LIBFFI)
 # error no dynamic fucntion call support defined
 #endif
 #include <yapi.h>
 #include <pstdlib.h>
 #include "ydlwrap.h"
 
+/* Value of errno after the last call.  This variable is only written by the
+   main thread: errors occurring in worker threads (see dlwrap_map) are
+   collected by each worker and merged when all workers are done. */
 static int last_error = 0;
 
+/* Number of conversions of array arguments and number of bytes copied by
+   these conversions for all wrappers (see dlwrap_conversions). */
+static long conversions = 0;
+static long copied = 0;
+
+/* Calls are profiled (see dlwrap_profile) and/or traced (see dlwrap_trace)
+   when these flags are set.  The flag INSTRUMENTED is set if any of them is
+   set. */
+static int profiling = FALSE;
+static int tracing = FALSE;
+static int instrumented = FALSE;
+
+/* Attributes of function wrappers which are bitwise or'ed with the return
+   type.  These bits must match the definitions in "dlwrap.i". */
+#define YFFC_JIT         0x00100
+#define YFFC_THREADSAFE  0x00200
+#define YFFC_STRICT      0x00400
+#define YFFC_PURE        0x00800
+#define YFFC_ATTRIBUTES  (YFFC_JIT|YFFC_THREADSAFE|YFFC_STRICT|YFFC_PURE)
+
+/* Array types which can be returned by a wrapped function (as external
+   arrays). */
+#define IS_ARRAY_RESULT(c_type) ((c_type) >= C_CHAR_ARRAY && \
+                                 (c_type) <= C_COMPLEX_ARRAY)
+
+/* Wrappers which need temporaries for their arguments or their result (see
+   yffc_output_call). */
+#define NEEDS_TEMPORARIES(obj) ((obj)->nouts > 0 || (obj)->nstructs > 0 || \
+                                IS_ARRAY_RESULT((obj)->args[0]))
+
 static const struct {
   const char *c_name;
   int c_type;
@@ -63,18 +106,114 @@ static const struct {
   {"complex*",  C_COMPLEX_ARRAY,  Y_COMPLEX_ARRAY},
   {"string*",   C_STRING_ARRAY,   Y_STRING_ARRAY},
   {"pointer*",  C_POINTER_ARRAY,  Y_POINTER_ARRAY},
+  {"char* [out]",       C_CHAR_OUT,       Y_CHAR|OUT_FLAG},
+  {"short* [out]",      C_SHORT_OUT,      Y_SHORT|OUT_FLAG},
+  {"int* [out]",        C_INT_OUT,        Y_INT|OUT_FLAG},
+  {"long* [out]",       C_LONG_OUT,       Y_LONG|OUT_FLAG},
+  {"float* [out]",      C_FLOAT_OUT,      Y_FLOAT|OUT_FLAG},
+  {"double* [out]",     C_DOUBLE_OUT,     Y_DOUBLE|OUT_FLAG},
+  {"complex* [out]",    C_COMPLEX_OUT,    Y_COMPLEX|OUT_FLAG},
+  {"char* [inout]",     C_CHAR_INOUT,     Y_CHAR|INOUT_FLAG},
+  {"short* [inout]",    C_SHORT_INOUT,    Y_SHORT|INOUT_FLAG},
+  {"int* [inout]",      C_INT_INOUT,      Y_INT|INOUT_FLAG},
+  {"long* [inout]",     C_LONG_INOUT,     Y_LONG|INOUT_FLAG},
+  {"float* [inout]",    C_FLOAT_INOUT,    Y_FLOAT|INOUT_FLAG},
+  {"double* [inout]",   C_DOUBLE_INOUT,   Y_DOUBLE|INOUT_FLAG},
+  {"complex* [inout]",  C_COMPLEX_INOUT,  Y_COMPLEX|INOUT_FLAG},
+  {"struct",            C_STRUCT,         Y_STRUCT},
+};
+
+typedef union _yffc_value yffc_value_t;
+union _yffc_value {
+  char c;
+  short s;
+  int i;
+  long l;
+  float f;
+  double d;
+  double z[2];
+  char *q;
+  void *p;
+#ifdef USE_LIBFFI
+  ffi_arg r; /* integral results are widened by libffi */
+#endif
+};
+
+typedef struct _complex complex_t;
+struct _complex {
+  double re, im;
 };
 
 typedef struct _yffc_instance yffc_instance_t;
+typedef struct _yffc_cache yffc_cache_t;
+typedef struct _yffc_intern yffc_intern_t;
+
+/* Cache of the results of a pure function (see "Memoization"). */
+struct _yffc_cache {
+  long capacity;  /* maximum number of entries */
+  long count;     /* number of entries */
+  long hits;      /* number of calls answered by the cache */
+  long misses;    /* number of calls not answered by the cache */
+  long head;      /* first entry in the list */
+  long tail;      /* last entry in the list (next to evict) */
+  long mask;      /* number of buckets minus one */
+  long *buckets;  /* first entry of each bucket */
+  char *entries;  /* storage for the entries */
+  size_t size;    /* size of an entry */
+  int policy;     /* eviction policy */
+  int nargs;      /* number of arguments */
+};
+
+/* A thunk is a specialized function to call a wrapped function with a given
+   signature directly (that is, without the generic machinery).  ARGC is the
+   number of arguments on top of the stack. */
+typedef void yffc_thunk_t(const yffc_instance_t *obj, int argc);
+
 struct _yffc_instance {
+  yffc_thunk_t *thunk; /* NULL or specialized caller */
+  void *code;          /* NULL or native trampoline */
+  ydl_vector_t vector; /* vector variant (see dlwrap_map) */
+  int vector_checked;  /* vector variant has been looked for */
   void *func;    /* pointer to function */
   void *module;  /* NULL or address of loaded dynamic module */
   char *symbol;  /* name of function in the dynamic module */
+  int engine;    /* call engine of the generic machinery */
+  int backend;   /* requested call path (see dlwrap) */
+#ifdef USE_LIBFFI
+  ffi_cif cif;          /* call interface, prepared once by dlwrap() */
+  ffi_type **atypes;    /* argument types of the call interface */
+  void **avalues;       /* addresses of the argument values */
+  yffc_value_t *values; /* storage for the argument values */
+#endif
+  unsigned int attr; /* attributes */
+  long conversions;  /* number of conversions of array arguments */
+  long copied;       /* number of bytes copied by these conversions */
+  yffc_cache_t *cache; /* NULL or cache of results (see DL_PURE) */
+  yffc_instance_t *prev, *next; /* neighbors in the list of live wrappers */
+  long ncalls;       /* number of profiled calls */
+  long nerrors;      /* number of profiled calls which have set errno */
+  long ns_total;     /* time spent in native code by profiled calls (ns) */
+  long ns_max;       /* maximum time spent in native code by a call (ns) */
+  long ns_marshal;   /* time spent converting arguments (ns) */
+  int trace_symbol;  /* index of the symbol name in the trace */
+  unsigned int trace_generation; /* generation of TRACE_SYMBOL */
+  yffc_instance_t *rfree; /* NULL or deallocator of array results */
+  void *rfree_use;   /* reference on the deallocator */
+  long rdims[Y_DIMSIZE]; /* dimension list of array results */
+  int   rsize;       /* argument giving the length of array results (0 if
+                        RDIMS is used instead) */
+  ydl_struct_t **structs; /* layouts of the structures passed by value
+                             (NULL for the other types), indexed as ARGS */
+  yffc_intern_t *intern; /* NULL or entry in the table of interned
+                            wrappers */
+  int   nstructs; /* number of structures passed by value */
+  int   nouts;   /* number of output arguments */
   int   nargs;   /* number of arguments */
   short args[1]; /* array of nargs + 1 argument types */
 };
 
 static void yffc_free(void *);
+static void yffc_intern_remove(yffc_intern_t *entry);
 static void yffc_print(void *);
 static void yffc_eval(void *, int);
 static void yffc_extract(void *, char *);
@@ -88,11 +227,71 @@ static y_userobj_t yffc_class = {
   NULL
 };
 
+/* List of live wrappers (see dlwrap_profile). */
+static yffc_instance_t *yffc_wrappers = NULL;
+
+/* Call engines of the generic machinery.  Every engine available when the
+   plugin is built is compiled in and the engine is chosen for each wrapper
+   (see the BACKEND keyword of dlwrap).  FFCALL is the default engine when
+   both are available, except for structures passed by value. */
+#define YFFC_FFCALL 1
+#define YFFC_LIBFFI 2
+#ifdef USE_FFCALL
+# define YFFC_DEFAULT_ENGINE YFFC_FFCALL
+#else
+# define YFFC_DEFAULT_ENGINE YFFC_LIBFFI
+#endif
+
+/* Values of the BACKEND keyword of dlwrap, indexed by their identifiers:
+   "auto" lets dlwrap choose the fastest path, "thunk" and "jit" require a
+   specialized caller or a native trampoline, "ffcall" and "libffi" only use
+   the generic machinery with the given engine. */
+#define YFFC_AUTO       0
+#define YFFC_THUNK      3
+#define YFFC_TRAMPOLINE 4
+#define YFFC_NBACKENDS  5
+static const char *backend_names[YFFC_NBACKENDS] = {
+  "auto", "ffcall", "libffi", "thunk", "jit"
+};
+
+static const char *yffc_engine_name(int engine)
+{
+  return (engine == YFFC_FFCALL ? "ffcall" : "libffi");
+}
+
+int ydl_backends(const char *names[])
+{
+  int n = 0;
+#ifdef USE_FFCALL
+  names[n++] = "ffcall";
+#endif
+#ifdef USE_LIBFFI
+  names[n++] = "libffi";
+#endif
+  return n;
+}
+
 static void yffc_free(void *self)
 {
   yffc_instance_t *obj = (yffc_instance_t *)self;
+  if (obj->prev != NULL) {
+    obj->prev->next = obj->next;
+  } else if (yffc_wrappers == obj) {
+    yffc_wrappers = obj->next;
+  }
+  if (obj->next != NULL) obj->next->prev = obj->prev;
+  if (obj->intern != NULL) yffc_intern_remove(obj->intern);
   if (obj->module != NULL) ydrop_use(obj->module);
+  if (obj->rfree_use != NULL) ydrop_use(obj->rfree_use);
+  if (obj->cache != NULL) p_free(obj->cache);
+  if (obj->structs != NULL) {
+    int j;
+    for (j = 0; j <= obj->nargs; ++j) {
+      ydl_struct_free(obj->structs[j]);
+    }
+  }
   if (obj->symbol != NULL) p_free(obj->symbol);
+  if (obj->code != NULL) ydl_jit_free(obj->code);
 }
 
 static void yffc_print(void *self)
@@ -143,36 +342,320 @@ static void yffc_extract(void *addr, char *member)
     ypush_q(&dims)[0] = p_strcpy(obj->symbol);
   } else if (c == 'm' && strcmp(member, "module") == 0) {
     ykeep_use(obj->module);
+  } else if (c == 'p' && strcmp(member, "path") == 0) {
+    long dims = 0;
+    ypush_q(&dims)[0] = p_strcpy(obj->func == NULL ? "lazy" :
+                                 (obj->thunk != NULL ? "thunk" :
+                                  (obj->code != NULL ? "jit" :
+                                   yffc_engine_name(obj->engine))));
+  } else if (c == 'b' && strcmp(member, "backend") == 0) {
+    long dims = 0;
+    ypush_q(&dims)[0] = p_strcpy(yffc_engine_name(obj->engine));
+  } else if (c == 's' && strcmp(member, "strict") == 0) {
+    ypush_int((obj->attr & YFFC_STRICT) != 0);
+  } else if (c == 'c' && strcmp(member, "conversions") == 0) {
+    ypush_long(obj->conversions);
+  } else if (c == 'c' && strcmp(member, "copied") == 0) {
+    ypush_long(obj->copied);
+  } else if (c == 'h' && strcmp(member, "hits") == 0) {
+    ypush_long(obj->cache != NULL ? obj->cache->hits : 0L);
+  } else if (c == 'm' && strcmp(member, "misses") == 0) {
+    ypush_long(obj->cache != NULL ? obj->cache->misses : 0L);
+  } else if (c == 'c' && strcmp(member, "cached") == 0) {
+    ypush_long(obj->cache != NULL ? obj->cache->count : 0L);
+  } else if (c == 'c' && strcmp(member, "capacity") == 0) {
+    ypush_long(obj->cache != NULL ? obj->cache->capacity : 0L);
+  } else if (c == 'n' && strcmp(member, "ncalls") == 0) {
+    ypush_long(obj->ncalls);
+  } else if (c == 'n' && strcmp(member, "nerrors") == 0) {
+    ypush_long(obj->nerrors);
+  } else if (c == 'n' && strcmp(member, "ns_total") == 0) {
+    ypush_long(obj->ns_total);
+  } else if (c == 'n' && strcmp(member, "ns_max") == 0) {
+    ypush_long(obj->ns_max);
+  } else if (c == 'n' && strcmp(member, "ns_marshal") == 0) {
+    ypush_long(obj->ns_marshal);
   } else {
     ERROR("bad member name");
   }
 }
 
-typedef union _yffc_value yffc_value_t;
-union _yffc_value {
-  char c;
-  short s;
-  int i;
-  long l;
-  float f;
-  double d;
-  double z[2];
-  char *q;
-  void *p;
-};
+/*-----------------------------------------------------------------------------
+** Thunks
+** ======
+**
+** The following thunks are used for the most common signatures.  They cast
+** the address of the wrapped function to the exact function type and call it
+** with the arguments taken from the stack.
+*/
 
-typedef struct _complex complex_t;
-struct _complex {
-  double re, im;
+static void *yffc_gets_p(const yffc_instance_t *obj, int iarg);
+
+#define THUNK_CHECK_NO_ARGS(argc)                               \
+  if ((argc) != 0 && ((argc) > 1 || ! yarg_nil(0)))             \
+    y_error("expecting one nil argument")
+#define THUNK_CHECK_NARGS(argc, n)                              \
+  if ((argc) != (n)) y_error("bad number of arguments")
+
+static void thunk_d_d(const yffc_instance_t *obj, int argc)
+{
+  double (*func)(double) = (double (*)(double))obj->func;
+  double a1, result;
+  THUNK_CHECK_NARGS(argc, 1);
+  a1 = ygets_d(0);
+  errno = 0;
+  result = func(a1);
+  last_error = errno;
+  ypush_double(result);
+}
+
+static void thunk_d_dd(const yffc_instance_t *obj, int argc)
+{
+  double (*func)(double, double) = (double (*)(double, double))obj->func;
+  double a1, a2, result;
+  THUNK_CHECK_NARGS(argc, 2);
+  a1 = ygets_d(1);
+  a2 = ygets_d(0);
+  errno = 0;
+  result = func(a1, a2);
+  last_error = errno;
+  ypush_double(result);
+}
+
+static void thunk_i_i(const yffc_instance_t *obj, int argc)
+{
+  int (*func)(int) = (int (*)(int))obj->func;
+  int a1, result;
+  THUNK_CHECK_NARGS(argc, 1);
+  a1 = ygets_i(0);
+  errno = 0;
+  result = func(a1);
+  last_error = errno;
+  ypush_int(result);
+}
+
+static void thunk_l_v(const yffc_instance_t *obj, int argc)
+{
+  long (*func)(void) = (long (*)(void))obj->func;
+  long result;
+  THUNK_CHECK_NO_ARGS(argc);
+  errno = 0;
+  result = func();
+  last_error = errno;
+  ypush_long(result);
+}
+
+static void thunk_i_pl(const yffc_instance_t *obj, int argc)
+{
+  int (*func)(void *, long) = (int (*)(void *, long))obj->func;
+  void *a1;
+  long a2;
+  int result;
+  THUNK_CHECK_NARGS(argc, 2);
+  a1 = yffc_gets_p(obj, 1);
+  a2 = ygets_l(0);
+  errno = 0;
+  result = func(a1, a2);
+  last_error = errno;
+  ypush_int(result);
+}
+
+static void thunk_l_ipl(const yffc_instance_t *obj, int argc)
+{
+  long (*func)(int, void *, long) = (long (*)(int, void *, long))obj->func;
+  int a1;
+  void *a2;
+  long a3, result;
+  THUNK_CHECK_NARGS(argc, 3);
+  a1 = ygets_i(2);
+  a2 = yffc_gets_p(obj, 1);
+  a3 = ygets_l(0);
+  errno = 0;
+  result = func(a1, a2, a3);
+  last_error = errno;
+  ypush_long(result);
+}
+
+#undef THUNK_CHECK_NO_ARGS
+#undef THUNK_CHECK_NARGS
+
+#define THUNK_MAX_ARGS 3
+static const struct {
+  yffc_thunk_t *thunk;
+  int nargs;
+  short args[THUNK_MAX_ARGS + 1]; /* return type, then argument types */
+} thunk_table[] = {
+  {thunk_d_d,   1, {C_DOUBLE, C_DOUBLE}},
+  {thunk_d_dd,  2, {C_DOUBLE, C_DOUBLE, C_DOUBLE}},
+  {thunk_i_i,   1, {C_INT, C_INT}},
+  {thunk_l_v,   0, {C_LONG}},
+  {thunk_i_pl,  2, {C_INT, C_POINTER, C_LONG}},
+  {thunk_l_ipl, 3, {C_LONG, C_INT, C_POINTER, C_LONG}},
 };
 
-static void yffc_eval(void *self, int argc)
+/* Returns the thunk matching the signature of a wrapper, NULL if none. */
+static yffc_thunk_t *yffc_find_thunk(const yffc_instance_t *obj)
+{
+  int j, k, n;
+  n = sizeof(thunk_table)/sizeof(thunk_table[0]);
+  for (k = 0; k < n; ++k) {
+    if (thunk_table[k].nargs != obj->nargs) continue;
+    for (j = 0; j <= obj->nargs; ++j) {
+      if (thunk_table[k].args[j] != obj->args[j]) break;
+    }
+    if (j > obj->nargs) return thunk_table[k].thunk;
+  }
+  return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void yffc_push_result(int c_type, const yffc_value_t *result)
+{
+  long dims = 0;
+  switch (c_type) {
+  case C_VOID:
+    ypush_nil();
+    break;
+  case C_CHAR:
+    *ypush_c(&dims) = result->c;
+    break;
+  case C_SHORT:
+    *ypush_s(&dims) = result->s;
+    break;
+  case C_INT:
+    ypush_int(result->i);
+    break;
+  case C_LONG:
+    ypush_long(result->l);
+    break;
+  case C_FLOAT:
+    *ypush_f(&dims) = result->f;
+    break;
+  case C_DOUBLE:
+    ypush_double(result->d);
+    break;
+  case C_COMPLEX:
+    {
+      double *dst = ypush_z(&dims);
+      dst[0] = result->z[0];
+      dst[1] = result->z[1];
+    }
+    break;
+  case C_STRING:
+    /* Assumes that a copy of the returned string must be done. */
+    *ypush_q(&dims) = (result->q == NULL ? NULL : p_strcpy(result->q));
+    break;
+  default:
+    ERROR("unexpected return type (BUG)");
+  }
+}
+
+static size_t yffc_scalar_size(int c_type);
+static void *yffc_external_data(int iarg, int c_type);
+static void yffc_push_external(yffc_instance_t *obj, const yffc_value_t *argv,
+                               const yffc_value_t *temp,
+                               const yffc_value_t *result);
+
+/* Account for the conversion of the array argument at position IARG in the
+   stack into an array of C type C_TYPE (a numerical scalar type) for the
+   wrapper OBJ.  In strict mode, an error is raised instead. */
+static void yffc_check_array(yffc_instance_t *obj, int c_type, int iarg)
+{
+  long ntot, nbytes;
+  int y_type;
+
+  if (c_type < C_CHAR || c_type > C_COMPLEX) return;
+  ygeta_any(iarg, &ntot, NULL, &y_type);
+  if (y_type == type_table[c_type].y_type
+      || y_type < Y_CHAR || y_type > Y_COMPLEX) return;
+  if ((obj->attr & YFFC_STRICT) != 0) {
+    y_error("array argument needs conversion (wrapper is in strict mode)");
+  }
+  nbytes = ntot*(long)yffc_scalar_size(c_type);
+  ++obj->conversions;
+  obj->copied += nbytes;
+  ++conversions;
+  copied += nbytes;
+}
+
+/* Store the value of the argument at position IARG in the stack in native
+   storage SLOT for C type C_TYPE.  OBJ is the wrapper for which the
+   conversions of array arguments are accounted. */
+static void yffc_get_arg(yffc_instance_t *obj, int c_type, int iarg,
+                         yffc_value_t *slot)
+{
+  long dims[Y_DIMSIZE];
+  const double *ptr;
+
+  switch (c_type) {
+#define CASE(TYPE, member, suffix)                      \
+  case C_##TYPE:                                        \
+    slot->member = ygets_##suffix(iarg);                \
+    break
+    CASE(CHAR, c, c);
+    CASE(SHORT, s, s);
+    CASE(INT, i, i);
+    CASE(LONG, l, l);
+    CASE(FLOAT, f, f);
+    CASE(DOUBLE, d, d);
+    CASE(STRING, q, q);
+#undef CASE
+  case C_POINTER:
+    slot->p = yffc_gets_p(obj, iarg);
+    break;
+  case C_COMPLEX:
+    ptr = ygeta_z(iarg, NULL, dims);
+    if (dims[0] != 0) y_error("expecting a scalar complex");
+    slot->z[0] = ptr[0];
+    slot->z[1] = ptr[1];
+    break;
+#define CASE_ARRAY(TYPE, suffix)                        \
+  case C_##TYPE##_ARRAY:                                \
+    slot->p = yffc_external_data(iarg, C_##TYPE);       \
+    if (slot->p == NULL) {                              \
+      yffc_check_array(obj, C_##TYPE, iarg);            \
+      slot->p = ygeta_##suffix(iarg, NULL, NULL);       \
+    }                                                   \
+    break
+    CASE_ARRAY(CHAR, c);
+    CASE_ARRAY(SHORT, s);
+    CASE_ARRAY(INT, i);
+    CASE_ARRAY(LONG, l);
+    CASE_ARRAY(FLOAT, f);
+    CASE_ARRAY(DOUBLE, d);
+    CASE_ARRAY(COMPLEX, z);
+    CASE_ARRAY(STRING, q);
+    CASE_ARRAY(POINTER, p);
+#undef CASE_ARRAY
+  default:
+    y_error("bad argument type");
+  }
+}
+
+/* Store the values of the arguments of a wrapper in native storage.  ARGC is
+   the number of arguments on top of the stack. */
+static void yffc_get_args(yffc_instance_t *obj, int argc,
+                          yffc_value_t *argv)
+{
+  int j, nargs;
+
+  nargs = obj->nargs;
+  for (j = 0; j < nargs; ++j) {
+    yffc_get_arg(obj, obj->args[j + 1], argc - 1 - j, &argv[j]);
+  }
+}
+
+#ifdef USE_FFCALL
+
+/* Call a wrapped function with the generic machinery of FFCALL.  The number
+   of arguments has already been checked. */
+static void yffc_ffcall_generic_call(yffc_instance_t *obj, int argc)
 {
   /* Note: we use switch statements here rather than a table of functions
      since the optimizer will adopt a fast solution ;-).  This assumption is
      confirmed by the measured overheads. */
   long dims[Y_DIMSIZE];
-  yffc_instance_t *obj = (yffc_instance_t *)self;
   yffc_value_t result;
   av_alist alist;
   void *func;
@@ -180,13 +663,6 @@ static void yffc_eval(void *self, int argc)
 
   func = obj->func;
   nargs = obj->nargs;
-  if (nargs == 0) {
-    if (argc != 0 && (argc > 1 || ! yarg_nil(0))) {
-      y_error("expecting one nil argument");
-    }
-  } else if (argc != nargs) {
-    y_error("bad number of arguments");
-  }
   c_type = obj->args[0];
   switch (c_type) {
   case C_VOID:
@@ -260,14 +736,18 @@ static void yffc_eval(void *self, int argc)
       break;
     case C_POINTER:
       {
-        void *value = ygets_p(iarg);
+        void *value = yffc_gets_p(obj, iarg);
         av_ptr(alist, void *, value);
       }
       break;
 #define CASE_ARRAY(TYPE, type, suffix)                  \
     case C_##TYPE##_ARRAY:                              \
       {                                                 \
-        type *ptr = ygeta_##suffix(iarg, NULL, NULL);   \
+        type *ptr = yffc_external_data(iarg, C_##TYPE); \
+        if (ptr == NULL) {                              \
+          yffc_check_array(obj, C_##TYPE, iarg);        \
+          ptr = ygeta_##suffix(iarg, NULL, NULL);       \
+        }                                               \
         av_ptr(alist, type *, ptr);                     \
       }                                                 \
       break
@@ -290,158 +770,3777 @@ static void yffc_eval(void *self, int argc)
   errno = 0;
   av_call(alist);
   last_error = errno;
+  yffc_push_result(obj->args[0], &result);
+}
+
+#endif /* USE_FFCALL */
+
+#ifdef USE_LIBFFI
+
+/* Complex values are passed as a structure of 2 doubles (as with FFCALL). */
+static ffi_type *complex_elements[] = {&ffi_type_double, &ffi_type_double,
+                                       NULL};
+static ffi_type complex_ffi_type = {0, 0, FFI_TYPE_STRUCT, complex_elements};
+
+/* LIBFFI types indexed by the C type identifiers. */
+static ffi_type *const ffi_type_table[] = {
+  &ffi_type_void,      /* C_VOID */
+  &ffi_type_schar,     /* C_CHAR */
+  &ffi_type_sshort,    /* C_SHORT */
+  &ffi_type_sint,      /* C_INT */
+  &ffi_type_slong,     /* C_LONG */
+  &ffi_type_float,     /* C_FLOAT */
+  &ffi_type_double,    /* C_DOUBLE */
+  &complex_ffi_type,   /* C_COMPLEX */
+  &ffi_type_pointer,   /* C_STRING */
+  &ffi_type_pointer,   /* C_POINTER */
+  &ffi_type_pointer,   /* C_CHAR_ARRAY */
+  &ffi_type_pointer,   /* C_SHORT_ARRAY */
+  &ffi_type_pointer,   /* C_INT_ARRAY */
+  &ffi_type_pointer,   /* C_LONG_ARRAY */
+  &ffi_type_pointer,   /* C_FLOAT_ARRAY */
+  &ffi_type_pointer,   /* C_DOUBLE_ARRAY */
+  &ffi_type_pointer,   /* C_COMPLEX_ARRAY */
+  &ffi_type_pointer,   /* C_STRING_ARRAY */
+  &ffi_type_pointer,   /* C_POINTER_ARRAY */
+  &ffi_type_pointer,   /* C_CHAR_OUT */
+  &ffi_type_pointer,   /* C_SHORT_OUT */
+  &ffi_type_pointer,   /* C_INT_OUT */
+  &ffi_type_pointer,   /* C_LONG_OUT */
+  &ffi_type_pointer,   /* C_FLOAT_OUT */
+  &ffi_type_pointer,   /* C_DOUBLE_OUT */
+  &ffi_type_pointer,   /* C_COMPLEX_OUT */
+  &ffi_type_pointer,   /* C_CHAR_INOUT */
+  &ffi_type_pointer,   /* C_SHORT_INOUT */
+  &ffi_type_pointer,   /* C_INT_INOUT */
+  &ffi_type_pointer,   /* C_LONG_INOUT */
+  &ffi_type_pointer,   /* C_FLOAT_INOUT */
+  &ffi_type_pointer,   /* C_DOUBLE_INOUT */
+  &ffi_type_pointer,   /* C_COMPLEX_INOUT */
+  NULL,                /* C_STRUCT (see yffc_struct_type) */
+};
+
+/* Get the LIBFFI type of a structure passed by value.  The type is built
+   when first needed and stored in the layout S. */
+static ffi_type *yffc_struct_type(ydl_struct_t *s)
+{
+  ffi_type *type, **elements;
+  int j;
+
+  if (s->extra == NULL) {
+    type = (ffi_type *)p_malloc(sizeof(ffi_type)
+                                + (s->nfields + 1)*sizeof(ffi_type *));
+    elements = (ffi_type **)(type + 1);
+    for (j = 0; j < s->nfields; ++j) {
+      elements[j] = ffi_type_table[s->fields[j].type];
+    }
+    elements[s->nfields] = NULL;
+    type->size = 0;      /* computed by ffi_prep_cif() */
+    type->alignment = 0; /* idem */
+    type->type = FFI_TYPE_STRUCT;
+    type->elements = elements;
+    s->extra = type;
+  }
+  return (ffi_type *)s->extra;
+}
+
+/* Get the LIBFFI type for the J-th type of a wrapper (J = 0 for the
+   result). */
+static ffi_type *yffc_ffi_type(yffc_instance_t *obj, int j)
+{
+  if (obj->args[j] == C_STRUCT) {
+    return yffc_struct_type(obj->structs[j]);
+  }
+  return ffi_type_table[obj->args[j]];
+}
+
+/* Prepare a call interface.  Calling ffi_prep_cif() may leave some
+   floating-point exception flags set which interrupts Yorick with a SIGFPE;
+   hence floating-point traps are disabled while preparing the call interface
+   and the former environment (with its flags) is restored afterward. */
+static ffi_status yffc_prep_call(ffi_cif *cif, int nargs, ffi_type *rtype,
+                                 ffi_type **atypes)
+{
+  fenv_t env;
+  ffi_status status;
+
+  feholdexcept(&env);
+  status = ffi_prep_cif(cif, FFI_DEFAULT_ABI, nargs, rtype, atypes);
+  fesetenv(&env);
+  return status;
+}
+
+/* Prepare the call interface of a wrapper. */
+static ffi_status yffc_prep_cif(yffc_instance_t *obj)
+{
+  ffi_status status;
+  int j;
+
+  for (j = 0; j < obj->nargs; ++j) {
+    obj->atypes[j] = yffc_ffi_type(obj, j + 1);
+    obj->avalues[j] = &obj->values[j];
+  }
+  status = yffc_prep_call(&obj->cif, obj->nargs, yffc_ffi_type(obj, 0),
+                          obj->atypes);
+  if (status == FFI_OK) {
+    /* Make sure that LIBFFI agrees with the layout of the structures. */
+    for (j = 0; j <= obj->nargs; ++j) {
+      if (obj->args[j] == C_STRUCT &&
+          yffc_ffi_type(obj, j)->size != (size_t)obj->structs[j]->size) {
+        return FFI_BAD_TYPEDEF;
+      }
+    }
+  }
+  return status;
+}
+
+/* LIBFFI widens integral results to the size of a register, this function
+   stores the result in the member corresponding to its type. */
+static void yffc_fix_result(int c_type, yffc_value_t *result)
+{
+  ffi_arg value;
+  switch (c_type) {
+  case C_CHAR:
+    value = result->r;
+    result->c = (char)value;
+    break;
+  case C_SHORT:
+    value = result->r;
+    result->s = (short)value;
+    break;
+  case C_INT:
+    value = result->r;
+    result->i = (int)value;
+    break;
+  }
+}
+
+/* Call a wrapped function with the generic machinery of LIBFFI.  The number
+   of arguments has already been checked. */
+static void yffc_libffi_generic_call(yffc_instance_t *obj, int argc)
+{
+  yffc_value_t result;
+
+  /* The call interface has been prepared by dlwrap(), we just have to store
+     the values of the arguments, call the function and push the result. */
+  yffc_get_args(obj, argc, obj->values);
+  errno = 0;
+  ffi_call(&obj->cif, FFI_FN(obj->func), &result, obj->avalues);
+  last_error = errno;
+  yffc_fix_result(obj->args[0], &result);
+  yffc_push_result(obj->args[0], &result);
+}
+
+/* Call a wrapped function with LIBFFI and arguments stored in native slots
+   (see yffc_invoke). */
+static void yffc_libffi_invoke(const yffc_instance_t *obj, void **avalues,
+                               yffc_value_t *result)
+{
+  ffi_call((ffi_cif *)&obj->cif, FFI_FN(obj->func), result, avalues);
+  yffc_fix_result(obj->args[0], result);
+}
+
+#endif /* USE_LIBFFI */
+
+/* Set the addresses of the argument slots ARGV needed by yffc_invoke.  The
+   slot of a structure passed by value holds the address of the structure
+   which is directly given to the call interface. */
+static void yffc_bind_slots(const yffc_instance_t *obj, yffc_value_t *argv,
+                            void **avalues)
+{
+  int j;
+  for (j = 0; j < obj->nargs; ++j) {
+    avalues[j] = (obj->args[j + 1] == C_STRUCT ? argv[j].p : &argv[j]);
+  }
+}
+
+#ifdef USE_FFCALL
+
+/* Call a wrapped function with FFCALL and arguments stored in native slots
+   (see yffc_invoke). */
+static void yffc_ffcall_invoke(const yffc_instance_t *obj, yffc_value_t *argv,
+                               yffc_value_t *result)
+{
+  av_alist alist;
+  void *func;
+  int j, nargs;
+
+  func = obj->func;
+  nargs = obj->nargs;
   switch (obj->args[0]) {
   case C_VOID:
-    ypush_nil();
+    av_start_void(alist, func);
     break;
   case C_CHAR:
-    {
-      long dims = 0;
-      *ypush_c(&dims) = result.c;
-    }
+    av_start_char(alist, func, &result->c);
     break;
   case C_SHORT:
-    {
-      long dims = 0;
-      *ypush_s(&dims) = result.s;
-    }
+    av_start_short(alist, func, &result->s);
     break;
   case C_INT:
-    ypush_int(result.i);
+    av_start_int(alist, func, &result->i);
     break;
   case C_LONG:
-    ypush_long(result.l);
+    av_start_long(alist, func, &result->l);
     break;
   case C_FLOAT:
-    {
-      long dims = 0;
-      *ypush_f(&dims) = result.f;
-    }
+    av_start_float(alist, func, &result->f);
     break;
   case C_DOUBLE:
-    ypush_double(result.d);
+    av_start_double(alist, func, &result->d);
     break;
   case C_COMPLEX:
-    {
-      long dims = 0;
-      double *dst = ypush_z(&dims);
-      dst[0] = result.z[0];
-      dst[1] = result.z[1];
-    }
+    av_start_struct(alist, func, complex_t,
+                    av_word_splittable_2(double, double),
+                    &result->z);
     break;
   case C_STRING:
-    /* Assumes that a copy of the returned string must be done. */
-    {
-      long dims = 0;
-      *ypush_q(&dims) = (result.q == NULL ? NULL : p_strcpy(result.q));
-    }
+    av_start_ptr(alist, func, char *, &result->q);
+    break;
+  case C_CHAR_ARRAY:
+  case C_SHORT_ARRAY:
+  case C_INT_ARRAY:
+  case C_LONG_ARRAY:
+  case C_FLOAT_ARRAY:
+  case C_DOUBLE_ARRAY:
+  case C_COMPLEX_ARRAY:
+    av_start_ptr(alist, func, void *, &result->p);
     break;
   default:
-    ERROR("unexpected return type (BUG)");
+    return;
+  }
+  for (j = 0; j < nargs; ++j) {
+    switch (obj->args[j + 1]) {
+#define CASE(TYPE, type, member)                \
+    case C_##TYPE:                              \
+      {                                         \
+        type value = argv[j].member;            \
+        av_##type(alist, value);                \
+      }                                         \
+      break
+      CASE(CHAR, char, c);
+      CASE(SHORT, short, s);
+      CASE(INT, int, i);
+      CASE(LONG, long, l);
+      CASE(FLOAT, float, f);
+      CASE(DOUBLE, double, d);
+#undef CASE
+    case C_COMPLEX:
+      {
+        complex_t value;
+        value.re = argv[j].z[0];
+        value.im = argv[j].z[1];
+        av_struct(alist, complex_t, value);
+      }
+      break;
+    case C_STRING:
+      {
+        char *value = argv[j].q;
+        av_ptr(alist, char *, value);
+      }
+      break;
+    default:
+      {
+        void *value = argv[j].p;
+        av_ptr(alist, void *, value);
+      }
+    }
+  }
+  av_call(alist);
+}
+
+#endif /* USE_FFCALL */
+
+/* Call a wrapped function with the generic machinery of its engine.  The
+   number of arguments has already been checked. */
+static void yffc_generic_call(yffc_instance_t *obj, int argc)
+{
+#ifdef USE_FFCALL
+  if (obj->engine == YFFC_FFCALL) {
+    yffc_ffcall_generic_call(obj, argc);
+    return;
+  }
+#endif
+#ifdef USE_LIBFFI
+  yffc_libffi_generic_call(obj, argc);
+#endif
+}
+
+/* Call a wrapped function with arguments stored in native slots ARGV.
+   AVALUES are the addresses of the slots (see yffc_bind_slots).  The
+   result is stored in RESULT. */
+static void yffc_invoke(const yffc_instance_t *obj, yffc_value_t *argv,
+                        void **avalues, yffc_value_t *result)
+{
+  if (obj->code != NULL) {
+    ((ydl_trampoline_t *)obj->code)(argv, result);
+    return;
+  }
+#ifdef USE_FFCALL
+  if (obj->engine == YFFC_FFCALL) {
+    yffc_ffcall_invoke(obj, argv, result);
+    return;
+  }
+#endif
+#ifdef USE_LIBFFI
+  yffc_libffi_invoke(obj, avalues, result);
+#endif
+}
+
+/* Call a wrapped function which has output arguments, which takes or
+   returns structures by value or which returns an array.  The function is
+   given the addresses of native temporaries whose values are stored into
+   the caller's variables after the call.  The number of arguments has
+   already been checked. */
+static void yffc_output_call(yffc_instance_t *obj, int argc)
+{
+  yffc_value_t *argv, *temp, *rbuf, result;
+  const ydl_struct_t *rstruct;
+  void **avalues;
+  long *refs;
+  size_t rsize;
+  int j, iarg, nargs, c_type;
+
+  /* A structure returned by value is stored in the scratch buffer. */
+  nargs = obj->nargs;
+  rstruct = (obj->args[0] == C_STRUCT ? obj->structs[0] : NULL);
+  rsize = (rstruct != NULL ? ROUND_UP(rstruct->size, sizeof(yffc_value_t))
+           : 0);
+  rbuf = (yffc_value_t *)ypush_scratch(rsize + nargs*(2*sizeof(yffc_value_t)
+                                                      + sizeof(void *)
+                                                      + sizeof(long)), NULL);
+  ++argc; /* stack has one more element */
+  argv = rbuf + rsize/sizeof(yffc_value_t);
+  temp = argv + nargs;
+  avalues = (void **)(temp + nargs);
+  refs = (long *)(avalues + nargs);
+  for (j = 0; j < nargs; ++j) {
+    iarg = argc - 1 - j;
+    c_type = obj->args[j + 1];
+    if (C_IS_OUT(c_type)) {
+      refs[j] = yget_ref(iarg);
+      if (refs[j] < 0L) {
+        y_error("output argument must be a simple variable reference");
+      }
+      if (C_IS_INOUT(c_type)) {
+        yffc_get_arg(obj, C_TARGET_OF(c_type), iarg, &temp[j]);
+      } else {
+        memset(&temp[j], 0, sizeof(temp[j]));
+      }
+      argv[j].p = &temp[j];
+    } else if (c_type == C_STRUCT) {
+      argv[j].p = ydl_struct_data(iarg, obj->structs[j + 1]);
+    } else {
+      yffc_get_arg(obj, c_type, iarg, &argv[j]);
+    }
+  }
+  yffc_bind_slots(obj, argv, avalues);
+  errno = 0;
+  yffc_invoke(obj, argv, avalues, (rstruct != NULL ? rbuf : &result));
+  last_error = errno;
+  for (j = 0; j < nargs; ++j) {
+    c_type = obj->args[j + 1];
+    if (C_IS_OUT(c_type)) {
+      yffc_push_result(C_TARGET_OF(c_type), &temp[j]);
+      yput_global(refs[j], 0);
+      yarg_drop(1);
+    }
+  }
+  if (rstruct != NULL) {
+    memcpy(ydl_struct_push(rstruct), rbuf, rstruct->size);
+  } else if (IS_ARRAY_RESULT(obj->args[0])) {
+    yffc_push_external(obj, argv, temp, &result);
+  } else {
+    yffc_push_result(obj->args[0], &result);
+  }
+}
+
+/* Call a wrapped function with its native trampoline.  The number of
+   arguments has already been checked. */
+static void yffc_native_call(yffc_instance_t *obj, int argc)
+{
+  yffc_value_t argv[YDL_JIT_MAX_ARGS];
+  yffc_value_t result;
+
+  yffc_get_args(obj, argc, argv);
+  errno = 0;
+  ((ydl_trampoline_t *)obj->code)(argv, &result);
+  last_error = errno;
+  yffc_push_result(obj->args[0], &result);
+}
+
+/*-----------------------------------------------------------------------------
+** Memoization
+** ===========
+**
+** The results of a wrapped function declared pure (attribute DL_PURE) are
+** stored in a bounded cache keyed on the values of the arguments (all
+** numerical scalars) as stored in the native slots.  The entries are kept in
+** a hash table (with chaining) and in a doubly linked list ordered by
+** recency of use (policy "lru") or of insertion (policy "fifo"); when the
+** cache is full, the entry at the tail of the list is evicted.
+*/
+
+#define YFFC_CACHE_LRU   1
+#define YFFC_CACHE_FIFO  2
+#define YFFC_CACHE_DEFAULT_CAPACITY 256
+#define YFFC_CACHE_NONE  (-1L)
+
+typedef struct _yffc_cache_entry yffc_cache_entry_t;
+struct _yffc_cache_entry {
+  long prev, next;       /* neighbors in the list */
+  long chain;            /* next entry in the same bucket */
+  unsigned long hash;    /* hash code of the key */
+  yffc_value_t result;   /* cached result */
+  yffc_value_t key[1];   /* values of the arguments */
+};
+
+#define CACHE_ENTRY(c, i) \
+  ((yffc_cache_entry_t *)((c)->entries + (i)*(c)->size))
+
+/* Create a cache for a wrapper with NARGS arguments.  The cache is stored in
+   a single block of memory which can be freed by p_free(). */
+static yffc_cache_t *yffc_cache_new(long capacity, int policy, int nargs)
+{
+  yffc_cache_t *cache;
+  size_t size;
+  long j, nbuckets;
+
+  nbuckets = 1;
+  while (nbuckets < capacity) {
+    nbuckets *= 2;
+  }
+  size = ROUND_UP(OFFSET_OF(yffc_cache_entry_t, key)
+                  + (nargs > 0 ? nargs : 1)*sizeof(yffc_value_t),
+                  sizeof(yffc_value_t));
+  cache = (yffc_cache_t *)p_malloc(ROUND_UP(sizeof(yffc_cache_t),
+                                            sizeof(yffc_value_t))
+                                   + capacity*size + nbuckets*sizeof(long));
+  cache->capacity = capacity;
+  cache->count = 0;
+  cache->hits = 0;
+  cache->misses = 0;
+  cache->head = YFFC_CACHE_NONE;
+  cache->tail = YFFC_CACHE_NONE;
+  cache->mask = nbuckets - 1;
+  cache->entries = (char *)cache + ROUND_UP(sizeof(yffc_cache_t),
+                                            sizeof(yffc_value_t));
+  cache->buckets = (long *)(cache->entries + capacity*size);
+  cache->size = size;
+  cache->policy = policy;
+  cache->nargs = nargs;
+  for (j = 0; j < nbuckets; ++j) {
+    cache->buckets[j] = YFFC_CACHE_NONE;
+  }
+  return cache;
+}
+
+/* FNV-1a hash of the argument values. */
+static unsigned long yffc_cache_hash(const yffc_value_t *key, int nargs)
+{
+  const unsigned char *p = (const unsigned char *)key;
+  size_t j, n = nargs*sizeof(yffc_value_t);
+  unsigned long hash = 2166136261UL;
+  for (j = 0; j < n; ++j) {
+    hash = (hash ^ p[j])*16777619UL;
+  }
+  return hash;
+}
+
+static void yffc_cache_unlink(yffc_cache_t *cache, long i)
+{
+  yffc_cache_entry_t *entry = CACHE_ENTRY(cache, i);
+  if (entry->prev != YFFC_CACHE_NONE) {
+    CACHE_ENTRY(cache, entry->prev)->next = entry->next;
+  } else {
+    cache->head = entry->next;
+  }
+  if (entry->next != YFFC_CACHE_NONE) {
+    CACHE_ENTRY(cache, entry->next)->prev = entry->prev;
+  } else {
+    cache->tail = entry->prev;
+  }
+}
+
+static void yffc_cache_push_front(yffc_cache_t *cache, long i)
+{
+  yffc_cache_entry_t *entry = CACHE_ENTRY(cache, i);
+  entry->prev = YFFC_CACHE_NONE;
+  entry->next = cache->head;
+  if (cache->head != YFFC_CACHE_NONE) {
+    CACHE_ENTRY(cache, cache->head)->prev = i;
+  } else {
+    cache->tail = i;
+  }
+  cache->head = i;
+}
+
+/* Remove entry I from its bucket. */
+static void yffc_cache_unchain(yffc_cache_t *cache, long i)
+{
+  long *link = &cache->buckets[CACHE_ENTRY(cache, i)->hash & cache->mask];
+  while (*link != i) {
+    link = &CACHE_ENTRY(cache, *link)->chain;
+  }
+  *link = CACHE_ENTRY(cache, i)->chain;
+}
+
+/* Call a pure function, the result is taken from the cache if possible.
+   The number of arguments has already been checked. */
+static void yffc_cached_call(yffc_instance_t *obj, int argc)
+{
+  yffc_value_t argv[YDL_JIT_MAX_ARGS];
+  void *avalues[YDL_JIT_MAX_ARGS];
+  yffc_value_t result;
+  yffc_cache_t *cache = obj->cache;
+  yffc_cache_entry_t *entry;
+  size_t nbytes = obj->nargs*sizeof(yffc_value_t);
+  unsigned long hash;
+  long i, *bucket;
+
+  /* Slots are zeroed so that keys can be compared bytewise. */
+  memset(argv, 0, sizeof(argv));
+  yffc_get_args(obj, argc, argv);
+  hash = yffc_cache_hash(argv, obj->nargs);
+  bucket = &cache->buckets[hash & cache->mask];
+  for (i = *bucket; i != YFFC_CACHE_NONE; i = entry->chain) {
+    entry = CACHE_ENTRY(cache, i);
+    if (entry->hash == hash && memcmp(entry->key, argv, nbytes) == 0) {
+      ++cache->hits;
+      if (cache->policy == YFFC_CACHE_LRU && cache->head != i) {
+        yffc_cache_unlink(cache, i);
+        yffc_cache_push_front(cache, i);
+      }
+      last_error = 0;
+      yffc_push_result(obj->args[0], &entry->result);
+      return;
+    }
+  }
+
+  /* Not found, call the function and store the result. */
+  ++cache->misses;
+  yffc_bind_slots(obj, argv, avalues);
+  errno = 0;
+  yffc_invoke(obj, argv, avalues, &result);
+  last_error = errno;
+  if (cache->count < cache->capacity) {
+    i = cache->count++;
+  } else {
+    i = cache->tail;
+    yffc_cache_unlink(cache, i);
+    yffc_cache_unchain(cache, i);
+  }
+  entry = CACHE_ENTRY(cache, i);
+  entry->hash = hash;
+  entry->result = result;
+  memcpy(entry->key, argv, nbytes);
+  entry->chain = *bucket;
+  *bucket = i;
+  yffc_cache_push_front(cache, i);
+  yffc_push_result(obj->args[0], &result);
+}
+
+/*-----------------------------------------------------------------------------
+** Profiling and Tracing
+** =====================
+**
+** When profiling is enabled (see dlwrap_profile), direct calls to wrapped
+** functions are timed.  To separate the time spent converting the arguments
+** from the time spent in native code, profiled calls do not use the thunks
+** and store the arguments before calling the function.  Calls through the
+** cache of a pure function or needing temporaries are timed as a whole and
+** accounted as spent in native code.  When profiling and tracing are
+** disabled, the cost is a single test of a global flag.
+**
+** When tracing is enabled (see dlwrap_trace), an entry is recorded for each
+** direct call in a ring buffer of fixed size (a power of 2) whose oldest
+** entries are overwritten.  Only the main thread records and reads the
+** entries, so no locks are needed: recording an entry amounts to reading
+** the clock twice and storing a few values.  Entries refer to the symbol
+** names by an index in a table owned by the tracer so that the names remain
+** valid after the wrappers have been destroyed.  A wrapper stores the index
+** of its name with the generation of the table (which is incremented when
+** the table is cleared) to only add its name to the table once.
+*/
+
+typedef struct _yffc_trace_entry yffc_trace_entry_t;
+struct _yffc_trace_entry {
+  long start;   /* start time of the call (ns) */
+  long end;     /* end time of the call (ns) */
+  int  symbol;  /* index of the symbol name */
+  int  error;   /* value of errno after the call */
+  int  rtype;   /* C type of the result */
+  int  pad;     /* unused, for alignment */
+};
+
+static struct {
+  yffc_trace_entry_t *entries; /* ring buffer */
+  unsigned long mask;          /* number of entries minus one */
+  unsigned long count;         /* total number of recorded calls */
+  long origin;                 /* time when tracing was started (ns) */
+  char **names;                /* symbol names */
+  int nnames;                  /* number of symbol names */
+  int maxnames;                /* maximum number of names before resizing */
+  unsigned int generation;     /* generation of the table of names */
+} trace = {NULL, 0, 0, 0, NULL, 0, 0, 1};
+
+/* Yield a monotonic time in nanoseconds. */
+static long yffc_clock(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+    return (long)ts.tv_sec*1000000000L + (long)ts.tv_nsec;
+  }
+#endif
+  {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long)tv.tv_sec*1000000000L + (long)tv.tv_usec*1000L;
+  }
+}
+
+/* Add the symbol name of a wrapper to the table of the tracer. */
+static void yffc_trace_add_symbol(yffc_instance_t *obj)
+{
+  if (trace.nnames >= trace.maxnames) {
+    trace.maxnames = (trace.maxnames > 0 ? 2*trace.maxnames : 64);
+    trace.names = (char **)p_realloc(trace.names,
+                                     trace.maxnames*sizeof(char *));
+  }
+  trace.names[trace.nnames] = p_strcpy(obj->symbol);
+  obj->trace_symbol = trace.nnames++;
+  obj->trace_generation = trace.generation;
+}
+
+/* Clear the tracer and allocate a ring buffer of SIZE entries (a power of 2,
+   or 0 to free all resources). */
+static void yffc_trace_clear(unsigned long size)
+{
+  int k;
+
+  for (k = 0; k < trace.nnames; ++k) {
+    p_free(trace.names[k]);
+  }
+  if (trace.names != NULL) p_free(trace.names);
+  if (trace.entries != NULL) p_free(trace.entries);
+  trace.names = NULL;
+  trace.nnames = 0;
+  trace.maxnames = 0;
+  ++trace.generation;
+  trace.entries = (size > 0 ? (yffc_trace_entry_t *)
+                   p_malloc(size*sizeof(yffc_trace_entry_t)) : NULL);
+  trace.mask = (size > 0 ? size - 1 : 0);
+  trace.count = 0;
+  trace.origin = yffc_clock();
+}
+
+/* Call a wrapped function and update its profiling counters and/or record
+   the call in the trace.  The number of arguments has already been
+   checked. */
+static void yffc_instrumented_call(yffc_instance_t *obj, int argc)
+{
+  yffc_trace_entry_t *entry;
+  yffc_value_t argv[YDL_JIT_MAX_ARGS];
+  void *avalues[YDL_JIT_MAX_ARGS];
+  yffc_value_t result;
+  long t0, t1, t2;
+
+  t0 = yffc_clock();
+  if (obj->cache != NULL || NEEDS_TEMPORARIES(obj)
+      || obj->nargs > YDL_JIT_MAX_ARGS) {
+    t1 = t0;
+    if (obj->cache != NULL) {
+      yffc_cached_call(obj, argc);
+    } else if (NEEDS_TEMPORARIES(obj)) {
+      yffc_output_call(obj, argc);
+    } else {
+      yffc_generic_call(obj, argc);
+    }
+    t2 = yffc_clock();
+  } else {
+    yffc_get_args(obj, argc, argv);
+    yffc_bind_slots(obj, argv, avalues);
+    t1 = yffc_clock();
+    errno = 0;
+    yffc_invoke(obj, argv, avalues, &result);
+    last_error = errno;
+    t2 = yffc_clock();
+    yffc_push_result(obj->args[0], &result);
+  }
+  if (profiling) {
+    ++obj->ncalls;
+    if (last_error != 0) ++obj->nerrors;
+    obj->ns_marshal += t1 - t0;
+    obj->ns_total += t2 - t1;
+    if (t2 - t1 > obj->ns_max) obj->ns_max = t2 - t1;
+  }
+  if (tracing) {
+    if (obj->trace_generation != trace.generation) {
+      yffc_trace_add_symbol(obj);
+    }
+    entry = &trace.entries[trace.count & trace.mask];
+    ++trace.count;
+    entry->start = t0;
+    entry->end = t2;
+    entry->symbol = obj->trace_symbol;
+    entry->error = last_error;
+    entry->rtype = obj->args[0];
+  }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/* Resolve the symbol of a wrapper and prepare the calls (thunk, native
+   trampoline and call interface).  This is done by dlwrap unless the
+   wrapper is created lazily in which case this is done on first use.  The
+   address of the function is set last so that the binding is done again if
+   it fails. */
+static void yffc_bind(yffc_instance_t *obj)
+{
+  yffc_thunk_t *thunk = NULL;
+  void *func;
+
+  ykeep_use(obj->module);
+  func = ydl_find(0, obj->symbol);
+  yarg_drop(1);
+  if (func == NULL) {
+    ERROR("symbol not found in dynamic module object (see dlsym)");
+  }
+  obj->func = NULL;
+  if ((obj->attr & YFFC_PURE) == 0 &&
+      (obj->backend == YFFC_AUTO || obj->backend == YFFC_THUNK)) {
+    /* Calls to pure functions must go through the cache. */
+    thunk = yffc_find_thunk(obj);
+    if (thunk == NULL && obj->backend == YFFC_THUNK) {
+      ERROR("no thunk for this signature");
+    }
+  }
+  if (thunk == NULL && obj->code == NULL &&
+      (obj->backend == YFFC_TRAMPOLINE ||
+       (obj->backend == YFFC_AUTO && (obj->attr & YFFC_JIT) != 0))) {
+    /* Native trampoline may not be available for this signature, the
+       generic machinery is used in that case unless it has been
+       explicitly requested. */
+    obj->code = ydl_jit_compile(func, obj->args, obj->nargs,
+                                sizeof(yffc_value_t));
+    if (obj->code == NULL && obj->backend == YFFC_TRAMPOLINE) {
+      ERROR("no native trampoline for this signature");
+    }
+  }
+#ifdef USE_LIBFFI
+  if (obj->engine == YFFC_LIBFFI && yffc_prep_cif(obj) != FFI_OK) {
+    ERROR("failed to prepare the call interface");
+  }
+#endif
+  obj->thunk = thunk;
+  obj->func = func;
+}
+
+/* Get the wrapper at position IARG in the stack, binding it if needed. */
+static yffc_instance_t *yffc_get(int iarg)
+{
+  yffc_instance_t *obj = GET_OBJ(yffc_instance_t, yffc_class, iarg);
+  if (obj->func == NULL) yffc_bind(obj);
+  return obj;
+}
+
+static void yffc_eval(void *self, int argc)
+{
+  yffc_instance_t *obj = (yffc_instance_t *)self;
+
+  if (obj->thunk != NULL && ! instrumented) {
+    obj->thunk(obj, argc);
+    return;
+  }
+  if (obj->func == NULL) {
+    /* The wrapper has been created lazily. */
+    yffc_bind(obj);
+    if (obj->thunk != NULL && ! instrumented) {
+      obj->thunk(obj, argc);
+      return;
+    }
+  }
+  if (obj->nargs == 0) {
+    if (argc != 0 && (argc > 1 || ! yarg_nil(0))) {
+      y_error("expecting one nil argument");
+    }
+  } else if (argc != obj->nargs) {
+    y_error("bad number of arguments");
+  }
+  if (instrumented) {
+    yffc_instrumented_call(obj, argc);
+  } else if (obj->cache != NULL) {
+    yffc_cached_call(obj, argc);
+  } else if (NEEDS_TEMPORARIES(obj)) {
+    yffc_output_call(obj, argc);
+  } else if (obj->code != NULL) {
+    yffc_native_call(obj, argc);
+  } else {
+    yffc_generic_call(obj, argc);
+  }
+}
+
+/*-----------------------------------------------------------------------------
+** Elementwise Calls
+** =================
+**
+** A wrapped function whose arguments and result are numerical scalars can be
+** applied elementwise to conformable arrays.  The arguments are broadcast
+** following Yorick's rules and the loop over the elements is done in C.  The
+** elements of the result are computed by ranges of linear indices so that
+** the work can be split in several parts.
+*/
+
+/* Yield the size of a numerical scalar C type, 0 if not a numerical scalar
+   type. */
+static size_t yffc_scalar_size(int c_type)
+{
+  switch (c_type) {
+  case C_CHAR:    return sizeof(char);
+  case C_SHORT:   return sizeof(short);
+  case C_INT:     return sizeof(int);
+  case C_LONG:    return sizeof(long);
+  case C_FLOAT:   return sizeof(float);
+  case C_DOUBLE:  return sizeof(double);
+  case C_COMPLEX: return 2*sizeof(double);
+  default:        return 0;
+  }
+}
+
+typedef struct _yffc_map_arg yffc_map_arg_t;
+struct _yffc_map_arg {
+  const char *data;        /* address of first element */
+  size_t size;             /* size of an element */
+  long dims[Y_DIMSIZE];    /* dimension list */
+  long stride[Y_DIMSIZE];  /* strides (in bytes) along iteration dimensions */
+};
+
+typedef struct _yffc_map yffc_map_t;
+struct _yffc_map {
+  const yffc_instance_t *obj; /* wrapped function */
+  yffc_map_arg_t *args;       /* arguments */
+  long number;                /* number of elements of the result */
+  long dims[Y_DIMSIZE];       /* dimension list of the result */
+  long len[Y_DIMSIZE];        /* lengths of iteration dimensions */
+  int rank;                   /* number of iteration dimensions (at least 1) */
+  size_t size;                /* size of an element of the result */
+  ydl_vector_t vector;        /* vector variant of the function */
+};
+
+/* Workspace needed to compute a range of elements, each thread of execution
+   must have its own. */
+typedef struct _yffc_map_work yffc_map_work_t;
+struct _yffc_map_work {
+  yffc_value_t *argv; /* argument slots */
+  void **avalues;     /* addresses of argument slots */
+  const char **ptr;   /* addresses of current arguments */
+  int error;          /* value of errno for the last failed chunk */
+  long index;         /* first index of the last failed chunk */
+};
+
+#define YFFC_MAP_WORK_SIZE(nargs) \
+  ((nargs)*(sizeof(yffc_value_t) + sizeof(void *) + sizeof(char *)))
+
+static void yffc_map_work_init(const yffc_map_t *map, yffc_map_work_t *work,
+                               void *buffer)
+{
+  int nargs = map->obj->nargs;
+  work->argv = (yffc_value_t *)buffer;
+  work->avalues = (void **)(work->argv + nargs);
+  work->ptr = (const char **)(work->avalues + nargs);
+  work->error = 0;
+  work->index = -1;
+  yffc_bind_slots(map->obj, work->argv, work->avalues);
+}
+
+/* Look for the vector variant of a wrapped function whose arguments and
+   result are all double or all float.  This is done once, the first time
+   the function is mapped. */
+static void yffc_find_vector(yffc_instance_t *obj)
+{
+  int k, type = obj->args[0];
+
+  obj->vector_checked = TRUE;
+  for (k = 1; k <= obj->nargs; ++k) {
+    if (obj->args[k] != type) return;
+  }
+  if ((type == C_DOUBLE || type == C_FLOAT) && obj->module != NULL) {
+    ykeep_use(obj->module);
+    ydl_vec_find(0, obj->symbol, obj->func, type, obj->nargs,
+                 &obj->vector);
+    yarg_drop(1);
+  }
+}
+
+/* Compute N consecutive elements of the result along the first iteration
+   dimension and store them at DST.  The addresses of the first elements of
+   the arguments are in WORK->PTR. */
+static void yffc_map_segment(const yffc_map_t *map, yffc_map_work_t *work,
+                             long n, char *dst)
+{
+  const yffc_instance_t *obj = map->obj;
+  const yffc_map_arg_t *args = map->args;
+  yffc_value_t result;
+  long i, i0;
+  int k, nargs;
+
+  /* The bulk of the elements is processed by the vector variant of the
+     function (if any), the remaining ones by the scalar function. */
+  i0 = 0;
+  if (map->vector.func != NULL) {
+    i0 = ydl_vec_apply(&map->vector, n, dst,
+                       work->ptr[0], args[0].stride[0]/args[0].size,
+                       (map->vector.nargs > 1 ? work->ptr[1] : NULL),
+                       (map->vector.nargs > 1 ?
+                        args[1].stride[0]/args[1].size : 0));
+  }
+
+  /* Loops for the most common signatures. */
+  if (obj->thunk == thunk_d_d) {
+    double (*func)(double) = (double (*)(double))obj->func;
+    const double *x = (const double *)work->ptr[0];
+    long sx = args[0].stride[0]/sizeof(double);
+    double *y = (double *)dst;
+    if (sx == 1) {
+      for (i = i0; i < n; ++i) y[i] = func(x[i]);
+    } else {
+      for (i = i0; i < n; ++i) y[i] = func(x[i*sx]);
+    }
+    return;
+  }
+  if (obj->thunk == thunk_d_dd) {
+    double (*func)(double, double) = (double (*)(double, double))obj->func;
+    const double *x1 = (const double *)work->ptr[0];
+    const double *x2 = (const double *)work->ptr[1];
+    long s1 = args[0].stride[0]/sizeof(double);
+    long s2 = args[1].stride[0]/sizeof(double);
+    double *y = (double *)dst;
+    for (i = i0; i < n; ++i) y[i] = func(x1[i*s1], x2[i*s2]);
+    return;
+  }
+
+  /* Generic loop. */
+  nargs = obj->nargs;
+  for (i = i0; i < n; ++i) {
+    for (k = 0; k < nargs; ++k) {
+      memcpy(&work->argv[k], work->ptr[k] + i*args[k].stride[0], args[k].size);
+    }
+    yffc_invoke(obj, work->argv, work->avalues, &result);
+    memcpy(dst + i*map->size, &result, map->size);
+  }
+}
+
+/* Compute the elements of the result whose linear indices are in the range
+   [I0,I1) and store them at DST (the address where to store the element of
+   index I0). */
+static void yffc_map_range(const yffc_map_t *map, yffc_map_work_t *work,
+                           long i0, long i1, char *dst)
+{
+  long index[Y_DIMSIZE];
+  long n, r;
+  int d, k, nargs = map->obj->nargs;
+
+  /* Convert linear index into a multi-dimensional one. */
+  r = i0;
+  for (d = 0; d < map->rank; ++d) {
+    index[d] = r % map->len[d];
+    r /= map->len[d];
+  }
+  while (i0 < i1) {
+    n = map->len[0] - index[0];
+    if (n > i1 - i0) n = i1 - i0;
+    for (k = 0; k < nargs; ++k) {
+      const char *ptr = map->args[k].data;
+      for (d = 0; d < map->rank; ++d) {
+        ptr += index[d]*map->args[k].stride[d];
+      }
+      work->ptr[k] = ptr;
+    }
+    yffc_map_segment(map, work, n, dst);
+    dst += n*map->size;
+    i0 += n;
+    index[0] = 0;
+    for (d = 1; d < map->rank; ++d) {
+      if (++index[d] < map->len[d]) break;
+      index[d] = 0;
+    }
+  }
+}
+
+/* Same as yffc_map_range but keep track of errors. */
+static void yffc_map_chunk(const yffc_map_t *map, yffc_map_work_t *work,
+                           long i0, long i1, char *dst)
+{
+  errno = 0;
+  yffc_map_range(map, work, i0, i1, dst);
+  if (errno != 0 && i0 > work->index) {
+    work->error = errno;
+    work->index = i0;
+  }
+}
+
+/* Data for computing the elements of the result by chunks, possibly in
+   parallel. */
+typedef struct _yffc_map_task yffc_map_task_t;
+struct _yffc_map_task {
+  const yffc_map_t *map;
+  yffc_map_work_t *work; /* one workspace per worker */
+  int nworkers;          /* number of workers */
+  char *extra;           /* extra workspace for each worker */
+  size_t extra_size;     /* size of extra workspace per worker */
+  char *dst;             /* address of the result */
+  int op;                /* reduction operation (see dlwrap_reduce) */
+};
+
+static void yffc_map_task(void *data, long i0, long i1, int worker)
+{
+  yffc_map_task_t *task = (yffc_map_task_t *)data;
+  yffc_map_chunk(task->map, &task->work[worker], i0, i1,
+                 task->dst + i0*task->map->size);
+}
+
+/* Run task FUNC (possibly in parallel) and set last_error.  The error of
+   the last failed chunk is retained to mimic a sequential loop. */
+static void yffc_map_run(yffc_map_task_t *task, ydl_task_t *func)
+{
+  long last;
+  int k;
+
+  if (task->nworkers > 1) {
+    ydl_pool_run(func, task, task->map->number);
+  } else {
+    func(task, 0, task->map->number, 0);
+  }
+  last_error = 0;
+  last = -1;
+  for (k = 0; k < task->nworkers; ++k) {
+    if (task->work[k].error != 0 && task->work[k].index > last) {
+      last_error = task->work[k].error;
+      last = task->work[k].index;
+    }
+  }
+}
+
+/* Merge dimension list DIMS into the dimension list RESULT following
+   Yorick's broadcasting rules.  Return FALSE if not conformable. */
+static int yffc_broadcast(long result[], const long dims[])
+{
+  long d, rank;
+  if (dims[0] > result[0]) {
+    for (d = result[0] + 1; d <= dims[0]; ++d) {
+      result[d] = 1;
+    }
+    result[0] = dims[0];
+  }
+  rank = dims[0];
+  for (d = 1; d <= rank; ++d) {
+    if (dims[d] != result[d]) {
+      if (result[d] == 1) {
+        result[d] = dims[d];
+      } else if (dims[d] != 1) {
+        return FALSE;
+      }
+    }
+  }
+  return TRUE;
+}
+
+/* Setup the iteration dimensions and the strides of the arguments.  The
+   dimension list of the result and of the arguments must have been set. */
+static void yffc_map_setup(yffc_map_t *map)
+{
+  yffc_map_arg_t *arg;
+  long d, ntot, number, stride;
+  int k, nargs = map->obj->nargs, simple = TRUE;
+
+  number = 1;
+  for (d = 1; d <= map->dims[0]; ++d) {
+    number *= map->dims[d];
+  }
+  map->number = number;
+
+  /* When all arguments are either scalars or have as many elements as the
+     result, a single iteration dimension is enough. */
+  for (k = 0; k < nargs && simple; ++k) {
+    arg = &map->args[k];
+    ntot = 1;
+    for (d = 1; d <= arg->dims[0]; ++d) {
+      ntot *= arg->dims[d];
+    }
+    simple = (ntot == 1 || ntot == number);
+  }
+  if (simple) {
+    map->rank = 1;
+    map->len[0] = number;
+    for (k = 0; k < nargs; ++k) {
+      arg = &map->args[k];
+      ntot = 1;
+      for (d = 1; d <= arg->dims[0]; ++d) {
+        ntot *= arg->dims[d];
+      }
+      arg->stride[0] = (ntot == 1 ? 0 : arg->size);
+    }
+    return;
+  }
+  map->rank = map->dims[0];
+  for (d = 0; d < map->rank; ++d) {
+    map->len[d] = map->dims[d + 1];
+  }
+  for (k = 0; k < nargs; ++k) {
+    arg = &map->args[k];
+    stride = arg->size;
+    for (d = 0; d < map->rank; ++d) {
+      if (d < arg->dims[0] && arg->dims[d + 1] != 1) {
+        arg->stride[d] = stride;
+        stride *= arg->dims[d + 1];
+      } else {
+        arg->stride[d] = 0;
+      }
+    }
+  }
+}
+
+/* Get the elements of argument at stack position IARG converted to the
+   numerical C type C_TYPE. */
+static const void *yffc_get_array(int iarg, int c_type, long dims[])
+{
+  switch (c_type) {
+  case C_CHAR:    return ygeta_c(iarg, NULL, dims);
+  case C_SHORT:   return ygeta_s(iarg, NULL, dims);
+  case C_INT:     return ygeta_i(iarg, NULL, dims);
+  case C_LONG:    return ygeta_l(iarg, NULL, dims);
+  case C_FLOAT:   return ygeta_f(iarg, NULL, dims);
+  case C_DOUBLE:  return ygeta_d(iarg, NULL, dims);
+  case C_COMPLEX: return ygeta_z(iarg, NULL, dims);
+  default:        return NULL;
+  }
+}
+
+/* Push a new array of C type C_TYPE and dimension list DIMS. */
+static void *yffc_push_array(int c_type, long dims[])
+{
+  switch (c_type) {
+  case C_CHAR:    return ypush_c(dims);
+  case C_SHORT:   return ypush_s(dims);
+  case C_INT:     return ypush_i(dims);
+  case C_LONG:    return ypush_l(dims);
+  case C_FLOAT:   return ypush_f(dims);
+  case C_DOUBLE:  return ypush_d(dims);
+  case C_COMPLEX: return ypush_z(dims);
+  default:        return NULL;
+  }
+}
+
+/* Reductions
+   ----------
+
+   The elements of the result are computed by small blocks which are folded
+   on the fly, the result is never stored as a whole.  Each worker has its
+   own accumulator, the accumulators are combined when all chunks have been
+   processed. */
+
+#define YFFC_REDUCE_BLOCK 256 /* number of elements computed at a time */
+
+#define YFFC_SUM    1
+#define YFFC_PROD   2
+#define YFFC_MIN    3
+#define YFFC_MAX    4
+#define YFFC_AVG    5
+#define YFFC_COUNT  6
+
+static const struct {
+  const char *name;
+  int op;
+} reduce_table[] = {
+  {"sum",   YFFC_SUM},
+  {"prod",  YFFC_PROD},
+  {"min",   YFFC_MIN},
+  {"max",   YFFC_MAX},
+  {"avg",   YFFC_AVG},
+  {"count", YFFC_COUNT},
+  {NULL,    0}
+};
+
+typedef struct _yffc_fold yffc_fold_t;
+struct _yffc_fold {
+  double re, im; /* accumulator for floating-point or complex values */
+  long l;        /* accumulator for integer values or count */
+  long n;        /* number of folded elements */
+};
+
+#define YFFC_FOLD_SIZE ROUND_UP(sizeof(yffc_fold_t), sizeof(double))
+
+static void yffc_fold_init(int op, yffc_fold_t *acc)
+{
+  acc->re = (op == YFFC_PROD ? 1.0 : 0.0);
+  acc->im = 0.0;
+  acc->l = (op == YFFC_PROD ? 1L : 0L);
+  acc->n = 0;
+}
+
+/* Fold N values of C type C_TYPE stored in BUF into accumulator ACC. */
+static void yffc_fold(int op, int c_type, const char *buf, long n,
+                      yffc_fold_t *acc)
+{
+  long i;
+
+  if (n <= 0) return;
+  switch (c_type) {
+#define FOLD(TYPE, type, m)                                     \
+  case C_##TYPE:                                                \
+    {                                                           \
+      const type *x = (const type *)buf;                        \
+      switch (op) {                                             \
+      case YFFC_SUM:                                            \
+      case YFFC_AVG:                                            \
+        for (i = 0; i < n; ++i) acc->m += x[i];                 \
+        break;                                                  \
+      case YFFC_PROD:                                           \
+        for (i = 0; i < n; ++i) acc->m *= x[i];                 \
+        break;                                                  \
+      case YFFC_MIN:                                            \
+        i = 0;                                                  \
+        if (acc->n == 0) acc->m = x[i++];                       \
+        for (; i < n; ++i) if (x[i] < acc->m) acc->m = x[i];    \
+        break;                                                  \
+      case YFFC_MAX:                                            \
+        i = 0;                                                  \
+        if (acc->n == 0) acc->m = x[i++];                       \
+        for (; i < n; ++i) if (x[i] > acc->m) acc->m = x[i];    \
+        break;                                                  \
+      case YFFC_COUNT:                                          \
+        for (i = 0; i < n; ++i) if (x[i] != 0) ++acc->l;        \
+        break;                                                  \
+      }                                                         \
+    }                                                           \
+    break
+    FOLD(CHAR, char, l);
+    FOLD(SHORT, short, l);
+    FOLD(INT, int, l);
+    FOLD(LONG, long, l);
+    FOLD(FLOAT, float, re);
+    FOLD(DOUBLE, double, re);
+#undef FOLD
+  case C_COMPLEX:
+    {
+      const double *z = (const double *)buf;
+      double re, im;
+      switch (op) {
+      case YFFC_SUM:
+      case YFFC_AVG:
+        for (i = 0; i < n; ++i) {
+          acc->re += z[2*i];
+          acc->im += z[2*i + 1];
+        }
+        break;
+      case YFFC_PROD:
+        for (i = 0; i < n; ++i) {
+          re = acc->re*z[2*i] - acc->im*z[2*i + 1];
+          im = acc->re*z[2*i + 1] + acc->im*z[2*i];
+          acc->re = re;
+          acc->im = im;
+        }
+        break;
+      case YFFC_COUNT:
+        for (i = 0; i < n; ++i) {
+          if (z[2*i] != 0 || z[2*i + 1] != 0) ++acc->l;
+        }
+        break;
+      }
+    }
+    break;
+  }
+  acc->n += n;
+}
+
+/* Combine accumulator SRC into accumulator DST. */
+static void yffc_fold_merge(int op, int c_type, yffc_fold_t *dst,
+                            const yffc_fold_t *src)
+{
+  int integral = (c_type <= C_LONG);
+  double re, im;
+
+  if (src->n == 0) return;
+  if (dst->n == 0) {
+    *dst = *src;
+    return;
+  }
+  switch (op) {
+  case YFFC_SUM:
+  case YFFC_AVG:
+  case YFFC_COUNT:
+    dst->re += src->re;
+    dst->im += src->im;
+    dst->l += src->l;
+    break;
+  case YFFC_PROD:
+    re = dst->re*src->re - dst->im*src->im;
+    im = dst->re*src->im + dst->im*src->re;
+    dst->re = re;
+    dst->im = im;
+    dst->l *= src->l;
+    break;
+  case YFFC_MIN:
+    if (integral ? src->l < dst->l : src->re < dst->re) {
+      dst->re = src->re;
+      dst->l = src->l;
+    }
+    break;
+  case YFFC_MAX:
+    if (integral ? src->l > dst->l : src->re > dst->re) {
+      dst->re = src->re;
+      dst->l = src->l;
+    }
+    break;
+  }
+  dst->n += src->n;
+}
+
+static void yffc_reduce_task(void *data, long i0, long i1, int worker)
+{
+  yffc_map_task_t *task = (yffc_map_task_t *)data;
+  const yffc_map_t *map = task->map;
+  char *extra = task->extra + worker*task->extra_size;
+  yffc_fold_t *acc = (yffc_fold_t *)extra;
+  char *buf = extra + YFFC_FOLD_SIZE;
+  long j0, j1;
+
+  for (j0 = i0; j0 < i1; j0 = j1) {
+    j1 = (i1 - j0 > YFFC_REDUCE_BLOCK ? j0 + YFFC_REDUCE_BLOCK : i1);
+    yffc_map_chunk(map, &task->work[worker], j0, j1, buf);
+    yffc_fold(task->op, map->obj->args[0], buf, j1 - j0, acc);
+  }
+}
+
+/* Parse the arguments of an elementwise call and prepare for computing the
+   result.  The function wrapper is the first positional argument, it is
+   followed by NOPTS positional options and by the arguments of the function
+   (there are ARGC elements on the stack).  KEY is the index of the only
+   allowed keyword (-1 if none), its stack position is stored in KEY_IARG
+   (-1 if not specified).  The stack positions of the options are stored in
+   OPT_IARG.  A scratch buffer with the workspaces (and EXTRA_SIZE bytes per
+   worker for the caller) is pushed on the stack, the returned stack
+   positions account for this. */
+static yffc_instance_t *yffc_map_init(int argc, int nopts, int opt_iarg[],
+                                      long key, int *key_iarg,
+                                      size_t extra_size, yffc_map_t *map,
+                                      yffc_map_task_t *task)
+{
+  yffc_instance_t *obj;
+  char *buffer;
+  size_t work_size;
+  int iarg, k, pass, npos, nargs, nworkers, fn_iarg;
+
+  /* First pass to find the function wrapper, second pass (after having
+     pushed the workspace, which is then at the bottom of the arguments) to
+     fetch the arguments. */
+  obj = NULL;
+  nargs = 0;
+  for (pass = 1; pass <= 2; ++pass) {
+    npos = 0;
+    fn_iarg = -1;
+    if (key_iarg != NULL) *key_iarg = -1;
+    for (iarg = argc - 1; iarg >= pass - 1; --iarg) {
+      long index = yarg_key(iarg);
+      if (index >= 0L) {
+        --iarg;
+        if (index == key && key_iarg != NULL) {
+          *key_iarg = iarg;
+        } else {
+          y_error("unknown keyword");
+        }
+      } else if (npos == 0) {
+        fn_iarg = iarg;
+        ++npos;
+      } else if (npos <= nopts) {
+        opt_iarg[npos - 1] = iarg;
+        ++npos;
+      } else {
+        if (pass == 2 && npos <= nopts + nargs) {
+          yffc_map_arg_t *arg = &map->args[npos - nopts - 1];
+          int c_type = obj->args[npos - nopts];
+          yffc_check_array(obj, c_type, iarg);
+          arg->data = yffc_get_array(iarg, c_type, arg->dims);
+          arg->size = yffc_scalar_size(c_type);
+          if (! yffc_broadcast(map->dims, arg->dims)) {
+            y_error("non-conformable arguments");
+          }
+        }
+        ++npos;
+      }
+    }
+    if (pass == 1) {
+      if (fn_iarg < 0) y_error("expecting a function wrapper");
+      obj = yffc_get(fn_iarg);
+      nargs = obj->nargs;
+      if (nargs < 1) y_error("function must have at least one argument");
+      if (yffc_scalar_size(obj->args[0]) == 0) {
+        y_error("function must return a numerical scalar");
+      }
+      for (k = 1; k <= nargs; ++k) {
+        if (yffc_scalar_size(obj->args[k]) == 0) {
+          y_error("function arguments must be numerical scalars");
+        }
+      }
+      if (npos != nopts + nargs + 1) y_error("bad number of arguments");
+
+      /* Only thread-safe functions can be called by the worker threads,
+         each worker has its own workspace. */
+      nworkers = ((obj->attr & YFFC_THREADSAFE) != 0 ?
+                  ydl_pool_get_threads() : 1);
+      extra_size = ROUND_UP(extra_size, sizeof(double));
+      work_size = sizeof(yffc_map_work_t) + YFFC_MAP_WORK_SIZE(nargs);
+      buffer = (char *)ypush_scratch(nargs*sizeof(yffc_map_arg_t)
+                                     + nworkers*(work_size + extra_size),
+                                     NULL);
+      ++argc; /* stack has one more element */
+      map->obj = obj;
+      map->args = (yffc_map_arg_t *)buffer;
+      map->size = yffc_scalar_size(obj->args[0]);
+      map->dims[0] = 0;
+      if (! obj->vector_checked) {
+        yffc_find_vector(obj);
+      }
+      map->vector = obj->vector;
+      task->map = map;
+      task->nworkers = nworkers;
+      task->work = (yffc_map_work_t *)(map->args + nargs);
+      buffer = (char *)(task->work + nworkers);
+      for (k = 0; k < nworkers; ++k) {
+        yffc_map_work_init(map, &task->work[k], buffer);
+        buffer += YFFC_MAP_WORK_SIZE(nargs);
+      }
+      task->extra = buffer;
+      task->extra_size = extra_size;
+      task->dst = NULL;
+      task->op = 0;
+    }
+  }
+  yffc_map_setup(map);
+  return obj;
+}
+
+/*-----------------------------------------------------------------------------
+** External Arrays
+** ===============
+**
+** A wrapped function may return an array allocated by the C code.  The
+** result is an external array object which owns the C memory (and calls the
+** deallocator of the wrapper, if any, when the object is dropped).  External
+** arrays can be passed to array arguments of wrapped functions without any
+** copy, their elements are copied into Yorick arrays when indexed.
+*/
+
+typedef struct _yffc_array yffc_array_t;
+struct _yffc_array {
+  void *data;             /* address of first element */
+  yffc_instance_t *free;  /* NULL or deallocator */
+  void *use;              /* reference on the deallocator */
+  long ntot;              /* number of elements */
+  long dims[Y_DIMSIZE];   /* dimension list */
+  int c_type;             /* C type of the elements */
+};
+
+static void yffc_array_free(void *);
+static void yffc_array_print(void *);
+static void yffc_array_eval(void *, int);
+static void yffc_array_extract(void *, char *);
+
+static y_userobj_t yffc_array_class = {
+  "DLArray",
+  yffc_array_free,
+  yffc_array_print,
+  yffc_array_eval,
+  yffc_array_extract,
+  NULL
+};
+
+static void yffc_array_free(void *self)
+{
+  yffc_array_t *arr = (yffc_array_t *)self;
+  yffc_value_t argv[1], result;
+  void *avalues[1];
+
+  if (arr->data != NULL && arr->free != NULL) {
+    if (arr->free->args[1] == C_LONG) {
+      argv[0].l = (long)arr->data;
+    } else {
+      argv[0].p = arr->data;
+    }
+    yffc_bind_slots(arr->free, argv, avalues);
+    yffc_invoke(arr->free, argv, avalues, &result);
+  }
+  if (arr->use != NULL) ydrop_use(arr->use);
+}
+
+static void yffc_array_print(void *self)
+{
+  yffc_array_t *arr = (yffc_array_t *)self;
+  char buf[100];
+  y_print(yffc_array_class.type_name, 0);
+  sprintf(buf, " object (external array) with %ld element(s) of type %s",
+          arr->ntot, type_table[arr->c_type].c_name);
+  y_print(buf, 1);
+}
+
+static void yffc_array_extract(void *addr, char *member)
+{
+  yffc_array_t *arr = (yffc_array_t *)addr;
+  int c = (member != NULL ? member[0] : '\0');
+  if (c == 'a' && strcmp(member, "address") == 0) {
+    ypush_long((long)arr->data);
+  } else if (c == 'd' && strcmp(member, "dims") == 0) {
+    long dims[2], *dst;
+    int k;
+    dims[0] = 1;
+    dims[1] = arr->dims[0] + 1;
+    dst = ypush_l(dims);
+    for (k = 0; k <= arr->dims[0]; ++k) {
+      dst[k] = arr->dims[k];
+    }
+  } else if (c == 'n' && strcmp(member, "number") == 0) {
+    ypush_long(arr->ntot);
+  } else if (c == 't' && strcmp(member, "type") == 0) {
+    ypush_long((long)(type_table[arr->c_type].y_type));
+  } else {
+    ERROR("bad member name");
+  }
+}
+
+static void yffc_array_eval(void *self, int argc)
+{
+  yffc_array_t *arr = (yffc_array_t *)self;
+  long dims[Y_DIMSIZE], i, k, n;
+  const long *index;
+  size_t size;
+  char *dst;
+
+  size = yffc_scalar_size(arr->c_type);
+  if (argc == 0 || (argc == 1 && yarg_nil(0))) {
+    /* Copy all elements. */
+    if (arr->ntot == 0) {
+      ypush_nil();
+    } else {
+      dst = (char *)yffc_push_array(arr->c_type, arr->dims);
+      memcpy(dst, arr->data, arr->ntot*size);
+    }
+  } else if (argc == 1) {
+    /* Copy the elements at the given linear indices (1-based, with
+       indices less or equal zero relative to the end as in Yorick). */
+    index = ygeta_l(0, &n, dims);
+    dst = (char *)yffc_push_array(arr->c_type, dims);
+    for (i = 0; i < n; ++i) {
+      k = index[i];
+      if (k <= 0) k += arr->ntot;
+      if (k < 1 || k > arr->ntot) y_error("index out of range");
+      memcpy(dst + i*size, (const char *)arr->data + (k - 1)*size, size);
+    }
+  } else {
+    y_error("too many indices");
+  }
+}
+
+/* Yield the address of the data of the external array at position IARG in
+   the stack, NULL if it is not an external array.  C_TYPE is the expected
+   type of the elements. */
+static void *yffc_external_data(int iarg, int c_type)
+{
+  yffc_array_t *arr;
+  if (yget_obj(iarg, NULL) != (void *)yffc_array_class.type_name) {
+    return NULL;
+  }
+  arr = (yffc_array_t *)yget_obj(iarg, &yffc_array_class);
+  if (arr->c_type != c_type) {
+    y_error("bad element type of external array");
+  }
+  return arr->data;
+}
+
+/* Push the array returned by wrapper OBJ as an external array.  ARGV are
+   the argument slots and TEMP the temporaries of output arguments (see
+   yffc_output_call) which may give the number of elements. */
+static void yffc_push_external(yffc_instance_t *obj, const yffc_value_t *argv,
+                               const yffc_value_t *temp,
+                               const yffc_value_t *result)
+{
+  const yffc_value_t *slot;
+  yffc_array_t *arr;
+  long n;
+  int j, k, c_type;
+
+  if (result->p == NULL) {
+    ypush_nil();
+    return;
+  }
+  arr = (yffc_array_t *)ypush_obj(&yffc_array_class, sizeof(yffc_array_t));
+  arr->data = result->p;
+  if (obj->rfree != NULL) {
+    ykeep_use(obj->rfree_use);
+    arr->use = yget_use(0);
+    arr->free = obj->rfree;
+    yarg_drop(1);
+  }
+  arr->c_type = obj->args[0] - C_CHAR_ARRAY + C_CHAR;
+  if (obj->rsize > 0) {
+    j = obj->rsize - 1;
+    c_type = obj->args[j + 1];
+    if (C_IS_OUT(c_type)) {
+      slot = &temp[j];
+      c_type = C_TARGET_OF(c_type);
+    } else {
+      slot = &argv[j];
+    }
+    switch (c_type) {
+    case C_CHAR:  n = slot->c; break;
+    case C_SHORT: n = slot->s; break;
+    case C_INT:   n = slot->i; break;
+    default:      n = slot->l; break;
+    }
+    if (n < 0) y_error("negative number of elements");
+    arr->dims[0] = 1;
+    arr->dims[1] = n;
+  } else {
+    for (k = 0; k <= obj->rdims[0]; ++k) {
+      arr->dims[k] = obj->rdims[k];
+    }
+  }
+  arr->ntot = 1;
+  for (k = 1; k <= arr->dims[0]; ++k) {
+    arr->ntot *= arr->dims[k];
+  }
+}
+
+/*-----------------------------------------------------------------------------
+** Pipelines
+** =========
+**
+** A pipeline is a sequence of wrapped functions (the stages) called one
+** after the other in a single call.  The arguments of each stage are taken
+** from the arguments of the pipeline or from the results of the previous
+** stages; the intermediate results are stored in native slots.
+*/
+
+/* Predicates to stop the execution of a pipeline after a stage. */
+#define YFFC_STOP_NONE      0
+#define YFFC_STOP_NEGATIVE  1 /* result < 0 */
+#define YFFC_STOP_ZERO      2 /* result == 0 (or NULL) */
+#define YFFC_STOP_NONZERO   3 /* result != 0 (or not NULL) */
+#define YFFC_STOP_ERRNO     4 /* errno != 0 */
+
+static const struct {
+  const char *name;
+  int stop;
+} stop_table[] = {
+  {"none",     YFFC_STOP_NONE},
+  {"negative", YFFC_STOP_NEGATIVE},
+  {"zero",     YFFC_STOP_ZERO},
+  {"nonzero",  YFFC_STOP_NONZERO},
+  {"errno",    YFFC_STOP_ERRNO},
+  {NULL,       0}
+};
+
+typedef struct _yffc_stage yffc_stage_t;
+struct _yffc_stage {
+  yffc_instance_t *obj;       /* wrapped function */
+  void *use;                  /* reference on the wrapper object */
+  int *src;                   /* sources of the arguments */
+  yffc_value_t *argv;         /* argument slots */
+  void **avalues;             /* addresses of argument slots */
+  int stop;                   /* stop predicate */
+};
+
+/* The source of an argument is J > 0 for the J-th argument of the pipeline
+   and -K < 0 for the result of the K-th stage. */
+typedef struct _yffc_pipeline yffc_pipeline_t;
+struct _yffc_pipeline {
+  yffc_stage_t *stages;  /* stages of the pipeline */
+  yffc_value_t *results; /* results of the stages */
+  int nstages;           /* number of stages */
+  int ninputs;           /* number of arguments of the pipeline */
+  int last;              /* last executed stage (1-based, 0 if none) */
+};
+
+static void yffc_pipeline_free(void *);
+static void yffc_pipeline_print(void *);
+static void yffc_pipeline_eval(void *, int);
+static void yffc_pipeline_extract(void *, char *);
+
+static y_userobj_t yffc_pipeline_class = {
+  "DLPipeline",
+  yffc_pipeline_free,
+  yffc_pipeline_print,
+  yffc_pipeline_eval,
+  yffc_pipeline_extract,
+  NULL
+};
+
+static void yffc_pipeline_free(void *self)
+{
+  yffc_pipeline_t *pl = (yffc_pipeline_t *)self;
+  int k;
+  for (k = 0; k < pl->nstages; ++k) {
+    if (pl->stages[k].use != NULL) ydrop_use(pl->stages[k].use);
+  }
+}
+
+static void yffc_pipeline_print(void *self)
+{
+  yffc_pipeline_t *pl = (yffc_pipeline_t *)self;
+  int k;
+  char buf[100];
+  y_print(yffc_pipeline_class.type_name, 0);
+  sprintf(buf, " object (pipeline of %d wrapped function(s)):", pl->nstages);
+  y_print(buf, 1);
+  for (k = 0; k < pl->nstages; ++k) {
+    sprintf(buf, "  %d: ", k + 1);
+    y_print(buf, 0);
+    y_print(pl->stages[k].obj->symbol, 1);
+  }
+}
+
+static void yffc_pipeline_extract(void *addr, char *member)
+{
+  yffc_pipeline_t *pl = (yffc_pipeline_t *)addr;
+  int c = (member != NULL ? member[0] : '\0');
+  if (c == 'n' && strcmp(member, "nstages") == 0) {
+    ypush_long((long)pl->nstages);
+  } else if (c == 'n' && strcmp(member, "ninputs") == 0) {
+    ypush_long((long)pl->ninputs);
+  } else if (c == 's' && strcmp(member, "stage") == 0) {
+    ypush_long((long)pl->last);
+  } else {
+    ERROR("bad member name");
+  }
+}
+
+#define IS_INTEGRAL(c_type) ((c_type) >= C_CHAR && (c_type) <= C_LONG)
+#define IS_FLOATING(c_type) ((c_type) == C_FLOAT || (c_type) == C_DOUBLE)
+
+/* Check whether a result of C type FROM can be passed as an argument of C
+   type TO. */
+static int yffc_convertible(int from, int to)
+{
+  if (IS_INTEGRAL(from) || IS_FLOATING(from)) {
+    return (IS_INTEGRAL(to) || IS_FLOATING(to) ||
+            (IS_INTEGRAL(from) && to == C_POINTER));
+  }
+  if (from == C_STRING) {
+    return (to == C_STRING || to == C_POINTER);
+  }
+  return (from == C_COMPLEX && to == C_COMPLEX);
+}
+
+/* Convert value SRC of C type FROM into DST of C type TO (which must be
+   convertible). */
+static void yffc_convert(int from, const yffc_value_t *src,
+                         int to, yffc_value_t *dst)
+{
+  long l;
+  double d;
+
+  if (from == to) {
+    *dst = *src;
+    return;
+  }
+  switch (from) {
+  case C_CHAR:   l = src->c; d = l; break;
+  case C_SHORT:  l = src->s; d = l; break;
+  case C_INT:    l = src->i; d = l; break;
+  case C_LONG:   l = src->l; d = l; break;
+  case C_FLOAT:  d = src->f; l = (long)d; break;
+  case C_DOUBLE: d = src->d; l = (long)d; break;
+  case C_STRING: dst->p = src->q; return;
+  default:       *dst = *src; return;
+  }
+  switch (to) {
+  case C_CHAR:    dst->c = (char)l; break;
+  case C_SHORT:   dst->s = (short)l; break;
+  case C_INT:     dst->i = (int)l; break;
+  case C_LONG:    dst->l = l; break;
+  case C_FLOAT:   dst->f = (float)d; break;
+  case C_DOUBLE:  dst->d = d; break;
+  case C_POINTER: dst->p = (void *)l; break;
+  }
+}
+
+/* Check whether the stop predicate STOP is true for the result of C type
+   C_TYPE of a stage and the value of errno ERROR. */
+static int yffc_must_stop(int stop, int c_type, const yffc_value_t *result,
+                          int error)
+{
+  double value;
+
+  switch (stop) {
+  case YFFC_STOP_NONE:
+    return FALSE;
+  case YFFC_STOP_ERRNO:
+    return (error != 0);
+  }
+  switch (c_type) {
+  case C_CHAR:    value = result->c; break;
+  case C_SHORT:   value = result->s; break;
+  case C_INT:     value = result->i; break;
+  case C_LONG:    value = result->l; break;
+  case C_FLOAT:   value = result->f; break;
+  case C_DOUBLE:  value = result->d; break;
+  case C_COMPLEX: value = (result->z[0] != 0 || result->z[1] != 0); break;
+  case C_STRING:  value = (result->q != NULL); break;
+  default:        return FALSE;
+  }
+  switch (stop) {
+  case YFFC_STOP_NEGATIVE: return (value < 0);
+  case YFFC_STOP_ZERO:     return (value == 0);
+  case YFFC_STOP_NONZERO:  return (value != 0);
+  default:                 return FALSE;
+  }
+}
+
+static void yffc_pipeline_eval(void *self, int argc)
+{
+  yffc_pipeline_t *pl = (yffc_pipeline_t *)self;
+  yffc_stage_t *stage;
+  yffc_instance_t *obj;
+  int j, k, src, error;
+
+  if (pl->ninputs == 0) {
+    if (argc != 0 && (argc > 1 || ! yarg_nil(0))) {
+      y_error("expecting one nil argument");
+    }
+  } else if (argc != pl->ninputs) {
+    y_error("bad number of arguments");
+  }
+  pl->last = 0;
+  for (k = 0; k < pl->nstages; ++k) {
+    stage = &pl->stages[k];
+    obj = stage->obj;
+    for (j = 0; j < obj->nargs; ++j) {
+      src = stage->src[j];
+      if (src > 0) {
+        yffc_get_arg(obj, obj->args[j + 1], argc - src, &stage->argv[j]);
+      } else {
+        yffc_convert(pl->stages[-src - 1].obj->args[0],
+                     &pl->results[-src - 1],
+                     obj->args[j + 1], &stage->argv[j]);
+      }
+    }
+    errno = 0;
+    yffc_invoke(obj, stage->argv, stage->avalues, &pl->results[k]);
+    error = errno;
+    last_error = error;
+    pl->last = k + 1;
+    if (yffc_must_stop(stage->stop, obj->args[0], &pl->results[k], error)) {
+      break;
+    }
+  }
+  if (pl->last > 0) {
+    yffc_push_result(pl->stages[pl->last - 1].obj->args[0],
+                     &pl->results[pl->last - 1]);
+  } else {
+    ypush_nil();
+  }
+}
+
+/*-----------------------------------------------------------------------------
+** Callbacks
+** =========
+**
+** A callback is the address of a function which can be given to a wrapped
+** function (for instance, the comparison function of qsort).  A callback made
+** from a wrapped function is directly the address of the compiled function.
+** A callback made from a Yorick function is a LIBFFI closure: when called,
+** its arguments are stored into global variables and a private interpreted
+** function (parsed once for each number of arguments) calls the Yorick
+** function, the result is then taken from another global variable.
+** Callbacks can only be called by the main thread while a wrapped function
+** is running.
+*/
+
+#define YFFC_CALLBACK_MAX_ARGS 8
+
+typedef struct _yffc_callback yffc_callback_t;
+struct _yffc_callback {
+  void *code;    /* address of the function to call back */
+  void *use;     /* reference on the Yorick function or on the wrapper */
+  int native;    /* the callback is a wrapped function */
+  int nargs;     /* number of arguments */
+  short args[YFFC_CALLBACK_MAX_ARGS + 1]; /* return and argument types */
+  long task;     /* index of the private function calling the Yorick one */
+#ifdef USE_LIBFFI
+  void *closure;
+  ffi_cif cif;
+  ffi_type *atypes[YFFC_CALLBACK_MAX_ARGS];
+#endif
+};
+
+static void yffc_callback_free(void *);
+static void yffc_callback_print(void *);
+static void yffc_callback_extract(void *, char *);
+
+static y_userobj_t yffc_callback_class = {
+  "DLCallback",
+  yffc_callback_free,
+  yffc_callback_print,
+  NULL,
+  yffc_callback_extract,
+  NULL
+};
+
+/* Indices of the global variables used to call Yorick functions. */
+static long callback_func_index = -1L;
+static long callback_result_index = -1L;
+static long callback_arg_index[YFFC_CALLBACK_MAX_ARGS];
+
+/* Indices of the private functions calling the Yorick functions, for each
+   number of arguments, as a subroutine (first row) or as a function (second
+   row).  They are defined as needed. */
+static long callback_task_index[2][YFFC_CALLBACK_MAX_ARGS + 1];
+
+static void yffc_callback_free(void *self)
+{
+  yffc_callback_t *cb = (yffc_callback_t *)self;
+#ifdef USE_LIBFFI
+  if (cb->closure != NULL) ffi_closure_free(cb->closure);
+#endif
+  if (cb->use != NULL) ydrop_use(cb->use);
+}
+
+static void yffc_callback_print(void *self)
+{
+  yffc_callback_t *cb = (yffc_callback_t *)self;
+  char buf[100];
+  y_print(yffc_callback_class.type_name, 0);
+  sprintf(buf, " object (%s callback) at %p",
+          (cb->native ? "native" : "Yorick"), cb->code);
+  y_print(buf, 1);
+}
+
+static void yffc_callback_extract(void *addr, char *member)
+{
+  yffc_callback_t *cb = (yffc_callback_t *)addr;
+  int c = (member != NULL ? member[0] : '\0');
+  if (c == 'a' && strcmp(member, "address") == 0) {
+    ypush_long((long)cb->code);
+  } else if (c == 'f' && strcmp(member, "function") == 0) {
+    ykeep_use(cb->use);
+  } else if (c == 'n' && strcmp(member, "nargs") == 0) {
+    ypush_long(cb->nargs);
+  } else if (c == 'n' && strcmp(member, "native") == 0) {
+    ypush_int(cb->native);
+  } else {
+    ERROR("bad member name");
+  }
+}
+
+/* Get the address given by the argument at position IARG in the stack for a
+   DL_POINTER argument of wrapper OBJ.  A callback made from a Yorick function
+   cannot be given to a thread-safe function (which may be run by worker
+   threads) as the interpreter can only be entered by the main thread. */
+static void *yffc_gets_p(const yffc_instance_t *obj, int iarg)
+{
+  if (yarg_typeid(iarg) == Y_OPAQUE) {
+    const char *type_name = (const char *)yget_obj(iarg, NULL);
+    if (type_name == yffc_callback_class.type_name) {
+      yffc_callback_t *cb = (yffc_callback_t *)yget_obj(iarg,
+                                                       &yffc_callback_class);
+      if (! cb->native && (obj->attr & YFFC_THREADSAFE) != 0) {
+        y_error("callbacks made from Yorick functions cannot be given to "
+                "thread-safe functions");
+      }
+      return cb->code;
+    }
+    if (type_name == yffc_class.type_name) {
+      return yffc_get(iarg)->func;
+    }
+  }
+  return ygets_p(iarg);
+}
+
+#ifdef USE_LIBFFI
+
+/* Function called by the closure of a callback made from a Yorick
+   function. */
+static void yffc_callback_handler(ffi_cif *cif, void *ret, void **args,
+                                  void *data)
+{
+  const yffc_callback_t *cb = (const yffc_callback_t *)data;
+  const double *z;
+  long dims[Y_DIMSIZE];
+  int j;
+
+  /* The interpreter cannot be entered by another thread (nor can an error
+     be raised), the result is zero.  The callbacks are refused by the
+     thread-safe and asynchronous calls, so this only happens if the
+     compiled code starts threads of its own. */
+  if (! ydl_is_main_thread()) {
+    if (cb->args[0] != C_VOID) {
+      memset(ret, 0, (cb->args[0] == C_COMPLEX ? 2*sizeof(double)
+                      : sizeof(yffc_value_t)));
+    }
+    return;
+  }
+
+  /* Store the function and its arguments in global variables. */
+  ykeep_use(cb->use);
+  yput_global(callback_func_index, 0);
+  yarg_drop(1);
+  for (j = 1; j <= cb->nargs; ++j) {
+    if (cb->args[j] == C_POINTER) {
+      /* Addresses are given to Yorick as integers. */
+      ypush_long((long)*(void **)args[j - 1]);
+    } else {
+      yffc_push_result(cb->args[j], (const yffc_value_t *)args[j - 1]);
+    }
+    yput_global(callback_arg_index[j - 1], 0);
+    yarg_drop(1);
+  }
+
+  /* Call the function. */
+  ydl_run_global(cb->task);
+
+  /* Fetch the result. */
+  if (cb->args[0] == C_VOID) return;
+  ypush_global(callback_result_index);
+  switch (cb->args[0]) {
+  case C_CHAR:
+  case C_SHORT:
+  case C_INT:
+    /* Small integral results are widened by LIBFFI. */
+    *(ffi_sarg *)ret = (ffi_sarg)ygets_l(0);
+    break;
+  case C_LONG:
+    *(long *)ret = ygets_l(0);
+    break;
+  case C_FLOAT:
+    *(float *)ret = ygets_f(0);
+    break;
+  case C_DOUBLE:
+    *(double *)ret = ygets_d(0);
+    break;
+  case C_COMPLEX:
+    z = ygeta_z(0, NULL, dims);
+    if (dims[0] != 0) y_error("expecting a scalar complex result");
+    ((double *)ret)[0] = z[0];
+    ((double *)ret)[1] = z[1];
+    break;
+  }
+  yarg_drop(1);
+}
+
+#endif /* USE_LIBFFI */
+
+/*-----------------------------------------------------------------------------
+** Bound Wrappers
+** ==============
+**
+** A bound wrapper is a wrapped function with some arguments fixed.  The
+** values of the bound arguments are converted once and stored in the
+** argument slots, only the other (free) arguments are fetched when the
+** bound wrapper is called.
+*/
+
+typedef struct _yffc_bound yffc_bound_t;
+struct _yffc_bound {
+  yffc_instance_t *obj;       /* wrapped function */
+  void *use;                  /* reference on the wrapper object */
+  void **uses;                /* references on the bound values */
+  yffc_value_t *argv;         /* argument slots */
+  void **avalues;             /* addresses of argument slots */
+  int *free;                  /* indices of the free arguments */
+  int nfree;                  /* number of free arguments */
+};
+
+static void yffc_bound_free(void *);
+static void yffc_bound_print(void *);
+static void yffc_bound_eval(void *, int);
+static void yffc_bound_extract(void *, char *);
+
+static y_userobj_t yffc_bound_class = {
+  "DLBound",
+  yffc_bound_free,
+  yffc_bound_print,
+  yffc_bound_eval,
+  yffc_bound_extract,
+  NULL
+};
+
+static void yffc_bound_free(void *self)
+{
+  yffc_bound_t *b = (yffc_bound_t *)self;
+  int j;
+  if (b->obj != NULL) {
+    for (j = 0; j < b->obj->nargs; ++j) {
+      if (b->uses[j] != NULL) ydrop_use(b->uses[j]);
+    }
+  }
+  if (b->use != NULL) ydrop_use(b->use);
+}
+
+static void yffc_bound_print(void *self)
+{
+  yffc_bound_t *b = (yffc_bound_t *)self;
+  yffc_instance_t *obj = b->obj;
+  int j, k;
+  char buf[100];
+  y_print(yffc_bound_class.type_name, 0);
+  y_print(" object (bound function wrapper) to:", 1);
+  sprintf(buf, "%s ", type_table[obj->args[0]].c_name);
+  y_print(buf, 0);
+  y_print(obj->symbol, 0);
+  if (obj->nargs == 0) {
+    y_print("(void);", 1);
+  } else {
+    for (j = 1, k = 0; j <= obj->nargs; ++j) {
+      if (k < b->nfree && b->free[k] == j - 1) {
+        sprintf(buf, (j == 1? "(%s" : ", %s"),
+                type_table[obj->args[j]].c_name);
+        ++k;
+      } else {
+        sprintf(buf, (j == 1? "(<bound>" : ", <bound>"));
+      }
+      y_print(buf, 0);
+    }
+    y_print(");", 1);
+  }
+}
+
+static void yffc_bound_extract(void *addr, char *member)
+{
+  yffc_bound_t *b = (yffc_bound_t *)addr;
+  int c = (member != NULL ? member[0] : '\0');
+  if (c == 'n' && strcmp(member, "nargs") == 0) {
+    ypush_long((long)b->nfree);
+  } else if (c == 'w' && strcmp(member, "wrapper") == 0) {
+    ykeep_use(b->use);
+  } else if (c == 'b' && strcmp(member, "bound") == 0) {
+    long dims[2], *list;
+    int j, k, n = b->obj->nargs - b->nfree;
+    if (n > 0) {
+      dims[0] = 1;
+      dims[1] = n;
+      list = ypush_l(dims);
+      for (j = 0, k = 0; j < b->obj->nargs; ++j) {
+        if (k < b->nfree && b->free[k] == j) {
+          ++k;
+        } else {
+          *list++ = j + 1;
+        }
+      }
+    } else {
+      ypush_nil();
+    }
+  } else {
+    ERROR("bad member name");
+  }
+}
+
+static void yffc_bound_eval(void *self, int argc)
+{
+  yffc_bound_t *b = (yffc_bound_t *)self;
+  yffc_instance_t *obj = b->obj;
+  yffc_value_t result;
+  int k;
+
+  if (b->nfree == 0) {
+    if (argc != 0 && (argc > 1 || ! yarg_nil(0))) {
+      y_error("expecting one nil argument");
+    }
+  } else if (argc != b->nfree) {
+    y_error("bad number of arguments");
+  }
+  for (k = 0; k < b->nfree; ++k) {
+    yffc_get_arg(obj, obj->args[b->free[k] + 1], argc - 1 - k,
+                 &b->argv[b->free[k]]);
+  }
+  errno = 0;
+  yffc_invoke(obj, b->argv, b->avalues, &result);
+  last_error = errno;
+  yffc_push_result(obj->args[0], &result);
+}
+
+/*-----------------------------------------------------------------------------
+** Asynchronous Calls
+** ==================
+**
+** An asynchronous call is made in two steps.  The arguments are converted by
+** the main thread and stored in the argument slots of a future object which
+** keeps references on the arguments (possibly converted) so that their data
+** are not released while the function runs.  The function is then called by
+** a background thread (see ydl_job_start) and its result and the value of
+** errno are stored in the future object.  The result is pushed on Yorick's
+** stack by the main thread when requested.
+*/
+
+typedef struct _yffc_future yffc_future_t;
+struct _yffc_future {
+  ydl_job_t *job;             /* running job, NULL when finished */
+  yffc_instance_t *obj;       /* wrapped function */
+  void *use;                  /* reference on the wrapper object */
+  void **uses;                /* references on the arguments */
+  yffc_value_t *argv;         /* argument slots */
+  void **avalues;             /* addresses of argument slots */
+  yffc_value_t *result;       /* storage for the result */
+  int error;                  /* value of errno after the call */
+};
+
+static void yffc_future_free(void *);
+static void yffc_future_print(void *);
+static void yffc_future_eval(void *, int);
+static void yffc_future_extract(void *, char *);
+
+static y_userobj_t yffc_future_class = {
+  "DLFuture",
+  yffc_future_free,
+  yffc_future_print,
+  yffc_future_eval,
+  yffc_future_extract,
+  NULL
+};
+
+/* Function run by the background thread. */
+static void yffc_future_run(void *data)
+{
+  yffc_future_t *fut = (yffc_future_t *)data;
+  errno = 0;
+  yffc_invoke(fut->obj, fut->argv, fut->avalues, fut->result);
+  fut->error = errno;
+}
+
+/* Wait for the call to finish. */
+static void yffc_future_wait(yffc_future_t *fut)
+{
+  if (fut->job != NULL) {
+    ydl_job_wait(fut->job);
+    fut->job = NULL;
+  }
+}
+
+static void yffc_future_push_result(yffc_future_t *fut)
+{
+  const ydl_struct_t *rstruct;
+
+  yffc_future_wait(fut);
+  last_error = fut->error;
+  if (fut->obj->args[0] == C_STRUCT) {
+    rstruct = fut->obj->structs[0];
+    memcpy(ydl_struct_push(rstruct), fut->result, rstruct->size);
+  } else {
+    yffc_push_result(fut->obj->args[0], fut->result);
+  }
+}
+
+static void yffc_future_free(void *self)
+{
+  yffc_future_t *fut = (yffc_future_t *)self;
+  int j;
+
+  /* The call must be finished before releasing the arguments. */
+  yffc_future_wait(fut);
+  if (fut->obj != NULL) {
+    for (j = 0; j < fut->obj->nargs; ++j) {
+      if (fut->uses[j] != NULL) ydrop_use(fut->uses[j]);
+    }
+  }
+  if (fut->use != NULL) ydrop_use(fut->use);
+}
+
+static void yffc_future_print(void *self)
+{
+  yffc_future_t *fut = (yffc_future_t *)self;
+  int ready = (fut->job == NULL || ydl_job_done(fut->job));
+  y_print(yffc_future_class.type_name, 0);
+  y_print((ready ? " object (finished call to " : " object (running call to "),
+          0);
+  y_print(fut->obj->symbol, 0);
+  y_print(")", 1);
+}
+
+static void yffc_future_eval(void *self, int argc)
+{
+  if (argc != 0 && (argc > 1 || ! yarg_nil(0))) {
+    y_error("expecting one nil argument");
+  }
+  yffc_future_push_result((yffc_future_t *)self);
+}
+
+static void yffc_future_extract(void *addr, char *member)
+{
+  yffc_future_t *fut = (yffc_future_t *)addr;
+  int c = (member != NULL ? member[0] : '\0');
+  if (c == 'r' && strcmp(member, "ready") == 0) {
+    ypush_int(fut->job == NULL || ydl_job_done(fut->job));
+  } else if (c == 'w' && strcmp(member, "wait") == 0) {
+    yffc_future_wait(fut);
+    ypush_int(TRUE);
+  } else if (c == 'r' && strcmp(member, "result") == 0) {
+    yffc_future_push_result(fut);
+  } else if (c == 'e' && strcmp(member, "errno") == 0) {
+    yffc_future_wait(fut);
+    ypush_int(fut->error);
+  } else if (c == 'w' && strcmp(member, "wrapper") == 0) {
+    ykeep_use(fut->use);
+  } else {
+    ERROR("bad member name");
+  }
+}
+
+/*-----------------------------------------------------------------------------
+** Interned Wrappers
+** =================
+**
+** Identical requests to dlwrap (same module handle, symbol, types,
+** attributes and keywords) yield the same shared wrapper object.  The key
+** of a request is built from the arguments of dlwrap before anything is
+** parsed or allocated, the interned wrappers are stored in a hash table
+** (with chaining).  The table holds no references: a wrapper is removed from
+** the table when it is freed, so interning does not change the lifetime of
+** the wrappers (nor of their modules).  Requests with structures passed by
+** value, with more than YFFC_INTERN_MAX_ARGS arguments or with invalid
+** values are not interned.
+*/
+
+#define YFFC_INTERN_MAX_ARGS 32
+
+/* Layout of a key: module handle, number of arguments, raw values of the
+   types (with attributes), keywords (0 if not specified) and symbol name
+   (stored after the key in an entry). */
+#define KEY_HANDLE  0
+#define KEY_NARGS   1
+#define KEY_SIZE    2
+#define KEY_CACHE   3
+#define KEY_EVICT   4
+#define KEY_BACKEND 5
+#define KEY_FREE    6
+#define KEY_DIMS    7 /* number of values, then the values */
+#define KEY_TYPES   (KEY_DIMS + 1 + Y_DIMSIZE)
+#define KEY_SIZE_MAX (KEY_TYPES + YFFC_INTERN_MAX_ARGS + 1)
+
+struct _yffc_intern {
+  yffc_intern_t *next;  /* next entry in the same bucket */
+  yffc_instance_t *obj; /* interned wrapper */
+  void *use;            /* handle of the wrapper (not a reference) */
+  unsigned long hash;   /* hash code of the key */
+  long hits;            /* number of requests answered by this entry */
+  char *symbol;         /* name of the symbol (stored after the key) */
+  int length;           /* number of elements in the key */
+  long key[1];          /* key of the request */
+};
+
+static struct {
+  yffc_intern_t **buckets;
+  long nbuckets;        /* number of buckets (a power of 2) */
+  long count;           /* number of interned wrappers */
+  long hits;            /* number of requests answered by the table */
+  long misses;          /* number of interned requests not answered */
+  int enabled;          /* interning is enabled */
+} interned = {NULL, 0, 0, 0, 0, TRUE};
+
+/* Build the key of a request to dlwrap with NARGS arguments (not counting
+   the keywords which are on top of the stack).  KEYWORDS are the indices of
+   the keywords size, cache, evict, backend, free, dims and lazy.  Returns the
+   length of the key or 0 if the request cannot be interned. */
+static int yffc_intern_key(int argc, int nargs, int nkeys,
+                           const long keywords[], long key[])
+{
+  long ntot, dims[Y_DIMSIZE];
+  const long *list;
+  const char *name;
+  int iarg, j, k, slot;
+
+  if (nargs > YFFC_INTERN_MAX_ARGS) return 0;
+  memset(key, 0, KEY_TYPES*sizeof(long));
+  key[KEY_HANDLE] = (long)ydl_handle(argc - 1);
+  key[KEY_NARGS] = nargs;
+  for (j = 0; j <= nargs; ++j) {
+    iarg = (j == 0 ? argc - 2 : argc - 3 - j);
+    if (yarg_rank(iarg) != 0 || yarg_typeid(iarg) > Y_LONG) return 0;
+    key[KEY_TYPES + j] = ygets_l(iarg);
+  }
+  /* The keywords have been moved on top of the stack: the markers are at odd
+     positions and their values just below. */
+  for (iarg = 2*nkeys - 1; iarg >= 1; iarg -= 2) {
+    for (slot = 0; slot < 7; ++slot) {
+      if (yarg_key(iarg) == keywords[slot]) break;
+    }
+    if (slot >= 7) return 0;
+    if (slot == 6 || yarg_nil(iarg - 1)) continue; /* LAZY is not a key */
+    if (slot == 0 || slot == 1) {
+      if (yarg_rank(iarg - 1) != 0 || yarg_typeid(iarg - 1) > Y_LONG) return 0;
+      key[KEY_SIZE + slot] = ygets_l(iarg - 1);
+      if (key[KEY_SIZE + slot] < 1) return 0;
+    } else if (slot == 2 || slot == 3) {
+      if (yarg_rank(iarg - 1) != 0 || yarg_typeid(iarg - 1) != Y_STRING) {
+        return 0;
+      }
+      name = ygets_q(iarg - 1);
+      if (name == NULL) return 0;
+      if (slot == 2) {
+        k = (strcmp(name, "lru") == 0 ? YFFC_CACHE_LRU :
+             (strcmp(name, "fifo") == 0 ? YFFC_CACHE_FIFO : 0));
+      } else {
+        for (k = YFFC_NBACKENDS; k > 0; --k) {
+          if (strcmp(name, backend_names[k - 1]) == 0) break;
+        }
+      }
+      if (k == 0) return 0;
+      key[KEY_SIZE + slot] = k;
+    } else if (slot == 4) {
+      if (yget_obj(iarg - 1, NULL) != (void *)yffc_class.type_name) return 0;
+      key[KEY_FREE] = (long)yget_obj(iarg - 1, &yffc_class);
+    } else {
+      if (yarg_typeid(iarg - 1) > Y_LONG) return 0;
+      list = ygeta_l(iarg - 1, &ntot, dims);
+      if (ntot > Y_DIMSIZE) return 0;
+      key[KEY_DIMS] = ntot;
+      for (k = 0; k < ntot; ++k) {
+        key[KEY_DIMS + 1 + k] = list[k];
+      }
+    }
+  }
+  return KEY_TYPES + nargs + 1;
+}
+
+/* FNV-1a hash of a key and of a symbol name. */
+static unsigned long yffc_intern_hash(const long key[], int length,
+                                      const char *symbol)
+{
+  const unsigned char *p = (const unsigned char *)key;
+  size_t j, n = length*sizeof(long);
+  unsigned long hash = 2166136261UL;
+  for (j = 0; j < n; ++j) {
+    hash = (hash ^ p[j])*16777619UL;
+  }
+  for (p = (const unsigned char *)symbol; *p != '\0'; ++p) {
+    hash = (hash ^ *p)*16777619UL;
+  }
+  return hash;
+}
+
+/* Find an interned wrapper, return NULL if not found. */
+static yffc_intern_t *yffc_intern_find(const long key[], int length,
+                                       const char *symbol,
+                                       unsigned long hash)
+{
+  yffc_intern_t *entry;
+
+  if (interned.count == 0) return NULL;
+  for (entry = interned.buckets[hash & (interned.nbuckets - 1)];
+       entry != NULL; entry = entry->next) {
+    if (entry->hash == hash && entry->length == length &&
+        memcmp(entry->key, key, length*sizeof(long)) == 0 &&
+        strcmp(entry->symbol, symbol) == 0) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+/* Intern the wrapper at position IARG in the stack. */
+static void yffc_intern_add(int iarg, const long key[], int length,
+                            const char *symbol, unsigned long hash)
+{
+  yffc_intern_t *entry, **buckets;
+  long j, n, size;
+
+  if (interned.count >= interned.nbuckets) {
+    /* Grow the hash table. */
+    n = (interned.nbuckets > 0 ? 2*interned.nbuckets : 64);
+    buckets = (yffc_intern_t **)p_malloc(n*sizeof(yffc_intern_t *));
+    for (j = 0; j < n; ++j) {
+      buckets[j] = NULL;
+    }
+    for (j = 0; j < interned.nbuckets; ++j) {
+      while ((entry = interned.buckets[j]) != NULL) {
+        interned.buckets[j] = entry->next;
+        entry->next = buckets[entry->hash & (n - 1)];
+        buckets[entry->hash & (n - 1)] = entry;
+      }
+    }
+    if (interned.buckets != NULL) p_free(interned.buckets);
+    interned.buckets = buckets;
+    interned.nbuckets = n;
+  }
+  size = OFFSET_OF(yffc_intern_t, key) + length*sizeof(long);
+  entry = (yffc_intern_t *)p_malloc(size + strlen(symbol) + 1);
+  memcpy(entry->key, key, length*sizeof(long));
+  entry->symbol = (char *)entry + size;
+  strcpy(entry->symbol, symbol);
+  entry->length = length;
+  entry->hash = hash;
+  entry->hits = 0;
+  entry->obj = (yffc_instance_t *)yget_obj(iarg, &yffc_class);
+  entry->obj->intern = entry;
+  /* The handle is only used to push the wrapper when the entry is found, the
+     reference is dropped at once (the entry is removed when the wrapper is
+     freed). */
+  entry->use = yget_use(iarg);
+  ydrop_use(entry->use);
+  j = hash & (interned.nbuckets - 1);
+  entry->next = interned.buckets[j];
+  interned.buckets[j] = entry;
+  ++interned.count;
+}
+
+/* Remove an entry from the table of interned wrappers (called when the
+   wrapper is freed). */
+static void yffc_intern_remove(yffc_intern_t *entry)
+{
+  yffc_intern_t **link;
+
+  link = &interned.buckets[entry->hash & (interned.nbuckets - 1)];
+  while (*link != NULL) {
+    if (*link == entry) {
+      *link = entry->next;
+      --interned.count;
+      break;
+    }
+    link = &(*link)->next;
+  }
+  p_free(entry);
+}
+
+/* Forget all interned wrappers. */
+static void yffc_intern_clear(void)
+{
+  yffc_intern_t *entry;
+  long j;
+
+  for (j = 0; j < interned.nbuckets; ++j) {
+    while ((entry = interned.buckets[j]) != NULL) {
+      interned.buckets[j] = entry->next;
+      entry->obj->intern = NULL;
+      p_free(entry);
+    }
+  }
+  interned.count = 0;
+}
+
+/*-----------------------------------------------------------------------------
+** Built-in Functions
+** ==================
+*/
+
+void Y_dlwrap(int argc)
+{
+  ydl_wrap(argc, FALSE);
+}
+
+void ydl_wrap(int argc, int lazy)
+{
+  static int needs_initialization = TRUE;
+  static long size_index = -1L, dims_index = -1L, free_index = -1L;
+  static long cache_index = -1L, evict_index = -1L, backend_index = -1L;
+  static long lazy_index = -1L;
+  static long keywords[7];
+  long key[KEY_SIZE_MAX];
+  unsigned long hash = 0;
+  yffc_intern_t *entry;
+  long size, y_type, capacity, policy, attr, out, index, ntot, dims[Y_DIMSIZE], soffset;
+  const long *list;
+#ifdef USE_LIBFFI
+  long offset;
+#endif
+  int j, k, iarg, nargs, nouts, nstructs, nkeys, c_type, backend, length;
+  char *symbol, *name;
+  short *args;
+  yffc_instance_t *obj, *rfree;
+
+  /* Initialization and minimal checking. */
+  if (needs_initialization) {
+    yfunc_obj(&yffc_class);
+    yfunc_obj(&yffc_array_class);
+    size_index = yget_global("size", 0);
+    dims_index = yget_global("dims", 0);
+    free_index = yget_global("free", 0);
+    cache_index = yget_global("cache", 0);
+    evict_index = yget_global("evict", 0);
+    backend_index = yget_global("backend", 0);
+    lazy_index = yget_global("lazy", 0);
+    keywords[0] = size_index;
+    keywords[1] = cache_index;
+    keywords[2] = evict_index;
+    keywords[3] = backend_index;
+    keywords[4] = free_index;
+    keywords[5] = dims_index;
+    keywords[6] = lazy_index;
+    needs_initialization = FALSE;
+  }
+
+  /* Move the keywords and their values on top of the stack (keeping the
+     order of the positional arguments) so that the positional arguments are
+     at the bottom of the stack whatever the position of the keywords. */
+  nkeys = 0;
+  iarg = argc - 1;
+  while (iarg > 2*nkeys) {
+    if (yarg_key(iarg) >= 0L) {
+      for (k = iarg - 1; k > 0; --k) yarg_swap(k, k - 1);
+      for (k = iarg; k > 1; --k) yarg_swap(k, k - 1);
+      ++nkeys;
+    } else {
+      --iarg;
+    }
+  }
+  nargs = argc - 3 - 2*nkeys;
+  nouts = 0;
+  nstructs = 0;
+  attr = 0;
+  if (nargs < 0) ERROR("too few arguments");
+
+  /* Check that 1st argument is a dynamic module and fetch symbol name (its
+     address is found by yffc_bind). */
+  if (! ydl_check(argc - 1)) ERROR("expecting dynamic module object");
+  symbol = ygets_q(argc - 3);
+  if (symbol == NULL || symbol[0] == '\0') ERROR("invalid symbol name");
+
+  /* Return the shared wrapper if an identical request has been interned. */
+  length = 0;
+  if (interned.enabled) {
+    length = yffc_intern_key(argc, nargs, nkeys, keywords, key);
+  }
+  if (length > 0) {
+    hash = yffc_intern_hash(key, length, symbol);
+    entry = yffc_intern_find(key, length, symbol, hash);
+    if (entry != NULL) {
+      ++entry->hits;
+      ++interned.hits;
+      for (iarg = 2*nkeys - 1; iarg >= 1; iarg -= 2) {
+        if (yarg_key(iarg) == lazy_index) lazy = yarg_true(iarg - 1);
+      }
+      ykeep_use(entry->use);
+      if (! lazy) yffc_get(0);
+      return;
+    }
+    ++interned.misses;
+  }
+
+  /* Create the wrapper object. */
+  size = OFFSET_OF(yffc_instance_t, args) + (nargs + 1)*sizeof(short);
+  size = ROUND_UP(size, sizeof(ydl_struct_t *));
+  soffset = size;
+  size += (nargs + 1)*sizeof(ydl_struct_t *);
+#ifdef USE_LIBFFI
+  /* Storage for the call interface is appended to the wrapper object. */
+  size = ROUND_UP(size, sizeof(double));
+  offset = size;
+  size += nargs*(sizeof(yffc_value_t) + sizeof(void *) + sizeof(ffi_type *));
+#endif
+  obj = (yffc_instance_t *)ypush_obj(&yffc_class, size);
+  ++argc; /* stack has one more element */
+  args = obj->args;
+  obj->nargs = nargs;
+  obj->structs = (ydl_struct_t **)((char *)obj + soffset);
+  for (j = 0; j <= nargs; ++j) {
+    if (j == 0) {
+      /* get stack index for return type */
+      iarg = argc - 2;
+    } else {
+      /* get stack index for j-th argument type */
+      iarg = argc - 3 - j;
+    }
+    out = 0;
+    if (yarg_typeid(iarg) == Y_STRUCTDEF) {
+      /* Structure passed by value, its layout is computed once for all. */
+      obj->structs[j] = ydl_struct_new(iarg);
+      ++nstructs;
+      y_type = Y_STRUCT;
+    } else {
+      y_type = ygets_l(iarg);
+      if (j == 0) {
+        /* The return type may have some attributes. */
+        attr = (y_type & YFFC_ATTRIBUTES);
+        y_type &= ~YFFC_ATTRIBUTES;
+      } else {
+        /* An argument may be an output one. */
+        out = (y_type & INOUT_FLAG);
+        y_type &= ~INOUT_FLAG;
+      }
+    }
+    switch (y_type) {
+#define CASE(a,b) case a: c_type = b; break
+    CASE(Y_VOID,              C_VOID);
+    CASE(Y_CHAR,              C_CHAR);
+    CASE(Y_SHORT,             C_SHORT);
+    CASE(Y_INT,               C_INT);
+    CASE(Y_LONG,              C_LONG);
+    CASE(Y_FLOAT,             C_FLOAT);
+    CASE(Y_DOUBLE,            C_DOUBLE);
+    CASE(Y_COMPLEX,           C_COMPLEX);
+    CASE(Y_STRING,            C_STRING);
+    CASE(Y_POINTER,           C_POINTER);
+    case Y_STRUCT:
+      if (obj->structs[j] == NULL) {
+        ERROR("structures must be specified by their definition");
+      }
+      c_type = C_STRUCT;
+      break;
+    CASE(Y_CHAR_ARRAY,    C_CHAR_ARRAY);
+    CASE(Y_SHORT_ARRAY,   C_SHORT_ARRAY);
+    CASE(Y_INT_ARRAY,     C_INT_ARRAY);
+    CASE(Y_LONG_ARRAY,    C_LONG_ARRAY);
+    CASE(Y_FLOAT_ARRAY,   C_FLOAT_ARRAY);
+    CASE(Y_DOUBLE_ARRAY,  C_DOUBLE_ARRAY);
+    CASE(Y_COMPLEX_ARRAY, C_COMPLEX_ARRAY);
+    CASE(Y_STRING_ARRAY,  C_STRING_ARRAY);
+    CASE(Y_POINTER_ARRAY, C_POINTER_ARRAY);
+#undef CASE
+    default:
+      ERROR("bad type value");
+    }
+    if (j == 0) {
+      if (c_type == C_STRUCT) {
+        if (obj->structs[0]->pointers) {
+          ERROR("structures with string or pointer members "
+                "cannot be returned");
+        }
+      } else if (c_type >= C_POINTER && ! IS_ARRAY_RESULT(c_type)) {
+        if (c_type == C_POINTER) {
+          ERROR("DL_POINTER is not a valid return type "
+                "(use DL_LONG to fake pointers)");
+        } else {
+          ERROR("unsupported return type");
+        }
+      }
+    } else if (c_type == C_VOID) {
+      if (j == 1 && nargs == 1) {
+        /* foo(void) is threated as if no arguments */
+        --nargs;
+      } else {
+        ERROR("void type is only allowed for the return type "
+              "or for a single argument");
+      }
+    }
+    if (out != 0) {
+      if (c_type < C_CHAR || c_type > C_COMPLEX) {
+        ERROR("output arguments must be numerical scalars");
+      }
+      c_type += (out == INOUT_FLAG ? C_CHAR_INOUT : C_CHAR_OUT) - C_CHAR;
+      ++nouts;
+    }
+    args[j] = c_type;
+  }
+
+  /* Instanciate the other members of the wrapper object.  The wrapper object
+     keeps a reference on the dynamic module object. */
+  obj->nargs = nargs;
+  obj->nouts = nouts;
+  obj->nstructs = nstructs;
+
+  /* Keywords specifying the size and the deallocator of array results, the
+     cache of pure functions and the call backend. */
+  capacity = YFFC_CACHE_DEFAULT_CAPACITY;
+  policy = YFFC_CACHE_LRU;
+  backend = YFFC_AUTO;
+  for (iarg = 2*nkeys; iarg >= 2; iarg -= 2) {
+    index = yarg_key(iarg);
+    if (index != size_index && index != dims_index && index != free_index &&
+        index != cache_index && index != evict_index &&
+        index != backend_index && index != lazy_index) {
+      ERROR("unknown keyword");
+    }
+    if (yarg_nil(iarg - 1)) continue;
+    if (index == lazy_index) {
+      lazy = yarg_true(iarg - 1);
+    } else if (index == backend_index) {
+      name = ygets_q(iarg - 1);
+      backend = -1;
+      for (k = 0; k < YFFC_NBACKENDS; ++k) {
+        if (name != NULL && strcmp(name, backend_names[k]) == 0) {
+          backend = k;
+          break;
+        }
+      }
+      if (backend < 0) {
+        ERROR("BACKEND must be \"auto\", \"thunk\", \"jit\", "
+              "\"ffcall\" or \"libffi\"");
+      }
+#ifndef USE_FFCALL
+      if (backend == YFFC_FFCALL) {
+        ERROR("FFCALL backend not available in this plugin");
+      }
+#endif
+#ifndef USE_LIBFFI
+      if (backend == YFFC_LIBFFI) {
+        ERROR("LIBFFI backend not available in this plugin");
+      }
+#endif
+    } else if (index == cache_index || index == evict_index) {
+      if ((attr & YFFC_PURE) == 0) {
+        ERROR("CACHE and EVICT are only allowed with DL_PURE");
+      }
+      if (index == cache_index) {
+        capacity = ygets_l(iarg - 1);
+        if (capacity < 1) ERROR("CACHE must be at least 1");
+      } else {
+        name = ygets_q(iarg - 1);
+        if (name != NULL && strcmp(name, "lru") == 0) {
+          policy = YFFC_CACHE_LRU;
+        } else if (name != NULL && strcmp(name, "fifo") == 0) {
+          policy = YFFC_CACHE_FIFO;
+        } else {
+          ERROR("EVICT must be \"lru\" or \"fifo\"");
+        }
+      }
+    } else if (index == size_index) {
+      k = ygets_l(iarg - 1);
+      c_type = (k >= 1 && k <= nargs ? args[k] : C_VOID);
+      if (C_IS_OUT(c_type)) c_type = C_TARGET_OF(c_type);
+      if (c_type < C_CHAR || c_type > C_LONG) {
+        ERROR("SIZE must be the index of an integer argument");
+      }
+      obj->rsize = k;
+    } else if (index == dims_index) {
+      list = ygeta_l(iarg - 1, &ntot, dims);
+      if (dims[0] == 0) {
+        obj->rdims[0] = 1;
+        obj->rdims[1] = list[0];
+      } else if (dims[0] == 1 && ntot == list[0] + 1 && ntot <= Y_DIMSIZE) {
+        for (k = 0; k < ntot; ++k) {
+          obj->rdims[k] = list[k];
+        }
+      } else {
+        ERROR("bad dimension list");
+      }
+      for (k = 1; k <= obj->rdims[0]; ++k) {
+        if (obj->rdims[k] < 1) ERROR("bad dimension list");
+      }
+    } else if (index == free_index) {
+      rfree = yffc_get(iarg - 1);
+      if (rfree->nargs != 1 || (rfree->args[1] != C_POINTER &&
+                                rfree->args[1] != C_LONG &&
+                                ! IS_ARRAY_RESULT(rfree->args[1]))) {
+        ERROR("FREE must be a wrapped function taking a single address");
+      }
+      obj->rfree = rfree;
+      obj->rfree_use = yget_use(iarg - 1);
+    }
+  }
+  if (IS_ARRAY_RESULT(args[0])) {
+    if ((obj->rsize > 0) == (obj->rdims[0] > 0)) {
+      ERROR("one of SIZE or DIMS must be specified for an array result");
+    }
+  } else if (obj->rsize > 0 || obj->rdims[0] > 0 || obj->rfree != NULL) {
+    ERROR("SIZE, DIMS and FREE are only allowed for an array result");
+  }
+  if ((attr & YFFC_PURE) != 0) {
+    /* Only calls with numerical scalar arguments and result can be
+       memoized. */
+    if (args[0] < C_CHAR || args[0] > C_COMPLEX) {
+      ERROR("DL_PURE requires a numerical scalar result");
+    }
+    for (j = 1; j <= nargs; ++j) {
+      if (args[j] < C_CHAR || args[j] > C_COMPLEX) {
+        ERROR("DL_PURE requires numerical scalar arguments");
+      }
+    }
+    if (nargs > YDL_JIT_MAX_ARGS) {
+      ERROR("too many arguments for DL_PURE");
+    }
+  }
+
+  /* Choose the engine of the generic machinery, which is also used by the
+     other paths for the calls they do not handle. */
+  if (backend == YFFC_FFCALL || backend == YFFC_LIBFFI) {
+    obj->engine = backend;
+  } else {
+#ifdef USE_LIBFFI
+    obj->engine = (nstructs > 0 ? YFFC_LIBFFI : YFFC_DEFAULT_ENGINE);
+#else
+    obj->engine = YFFC_DEFAULT_ENGINE;
+#endif
+  }
+  if (nstructs > 0 && obj->engine == YFFC_FFCALL) {
+    ERROR("structures passed by value require LIBFFI");
+  }
+  if ((attr & YFFC_PURE) != 0 && backend == YFFC_THUNK) {
+    ERROR("calls to DL_PURE functions cannot use a thunk");
+  }
+
+  obj->symbol = p_strcpy(symbol);
+  obj->module = yget_use(argc - 1);
+  obj->attr = attr;
+  obj->backend = backend;
+  obj->vector_checked = FALSE;
+  if ((attr & YFFC_PURE) != 0) {
+    obj->cache = yffc_cache_new(capacity, policy, nargs);
+  }
+#ifdef USE_LIBFFI
+  obj->values = (yffc_value_t *)((char *)obj + offset);
+  obj->avalues = (void **)(obj->values + nargs);
+  obj->atypes = (ffi_type **)(obj->avalues + nargs);
+#endif
+
+  /* Insert the wrapper in the list of live wrappers. */
+  obj->next = yffc_wrappers;
+  if (yffc_wrappers != NULL) yffc_wrappers->prev = obj;
+  yffc_wrappers = obj;
+  if (! lazy) {
+    yffc_bind(obj);
+  }
+  if (length > 0) {
+    yffc_intern_add(0, key, length, obj->symbol, hash);
+  }
+}
+
+void Y_dlwrap_map(int argc)
+{
+  static long out_index = -1L;
+  long dims[Y_DIMSIZE], ntot;
+  yffc_map_t map;
+  yffc_map_task_t task;
+  yffc_instance_t *obj;
+  int d, out_iarg;
+
+  if (out_index < 0L) out_index = yget_global("out", 0);
+  obj = yffc_map_init(argc, 0, NULL, out_index, &out_iarg, 0, &map, &task);
+
+  /* Fetch or create the destination array. */
+  if (out_iarg >= 0) {
+    if (yarg_typeid(out_iarg) != type_table[obj->args[0]].y_type) {
+      y_error("bad data type for OUT");
+    }
+    task.dst = (char *)ygeta_any(out_iarg, &ntot, dims, NULL);
+    for (d = 0; d <= map.dims[0]; ++d) {
+      if (dims[d] != map.dims[d]) {
+        y_error("bad dimensions for OUT");
+      }
+    }
+  } else {
+    task.dst = (char *)yffc_push_array(obj->args[0], map.dims);
+  }
+
+  /* Compute the result. */
+  yffc_map_run(&task, yffc_map_task);
+  if (out_iarg >= 0) {
+    ypush_use(yget_use(out_iarg));
+  }
+}
+
+void Y_dlwrap_reduce(int argc)
+{
+  yffc_map_t map;
+  yffc_map_task_t task;
+  yffc_instance_t *obj;
+  yffc_fold_t acc;
+  const char *name;
+  int k, op, c_type, op_iarg;
+
+  obj = yffc_map_init(argc, 1, &op_iarg, -1L, NULL,
+                      YFFC_FOLD_SIZE + YFFC_REDUCE_BLOCK*2*sizeof(double),
+                      &map, &task);
+  c_type = obj->args[0];
+  name = ygets_q(op_iarg);
+  op = 0;
+  for (k = 0; name != NULL && reduce_table[k].name != NULL; ++k) {
+    if (strcmp(name, reduce_table[k].name) == 0) {
+      op = reduce_table[k].op;
+      break;
+    }
+  }
+  if (op == 0) ERROR("unknown reduction operation");
+  if (c_type == C_COMPLEX && (op == YFFC_MIN || op == YFFC_MAX)) {
+    ERROR("complex values cannot be compared");
+  }
+
+  /* Compute and fold the elements of the result. */
+  task.op = op;
+  for (k = 0; k < task.nworkers; ++k) {
+    yffc_fold_init(op, (yffc_fold_t *)(task.extra + k*task.extra_size));
+  }
+  yffc_map_run(&task, yffc_reduce_task);
+  yffc_fold_init(op, &acc);
+  for (k = 0; k < task.nworkers; ++k) {
+    yffc_fold_merge(op, c_type, &acc,
+                    (yffc_fold_t *)(task.extra + k*task.extra_size));
+  }
+
+  /* Push the result. */
+  if (op == YFFC_COUNT) {
+    ypush_long(acc.l);
+  } else if (c_type == C_COMPLEX) {
+    double *z = ypush_z(NULL);
+    z[0] = acc.re;
+    z[1] = acc.im;
+    if (op == YFFC_AVG) {
+      z[0] /= acc.n;
+      z[1] /= acc.n;
+    }
+  } else if (op == YFFC_AVG) {
+    ypush_double((c_type <= C_LONG ? (double)acc.l : acc.re)/acc.n);
+  } else if (c_type <= C_LONG) {
+    ypush_long(acc.l);
+  } else {
+    ypush_double(acc.re);
   }
 }
 
-/*-----------------------------------------------------------------------------
-** Built-in Functions
-** ==================
-*/
+void Y_dlwrap_threads(int argc)
+{
+  long dims[2], *result, chunk;
+  int nthreads;
 
-void Y_dlwrap(int argc)
+  if (argc > 2) ERROR("too many arguments");
+  nthreads = (argc >= 1 && ! yarg_nil(argc - 1) ? ygets_i(argc - 1) : 0);
+  chunk = (argc >= 2 && ! yarg_nil(argc - 2) ? ygets_l(argc - 2) : 0);
+  if (nthreads < 0) ERROR("invalid number of threads");
+  if (chunk < 0) ERROR("invalid chunk size");
+  ydl_pool_configure(nthreads, chunk);
+  dims[0] = 1;
+  dims[1] = 2;
+  result = ypush_l(dims);
+  result[0] = ydl_pool_get_threads();
+  result[1] = ydl_pool_get_chunk();
+}
+
+void Y_dlcallback(int argc)
 {
   static int needs_initialization = TRUE;
-  long size, y_type;
-  int j, iarg, nargs, c_type;
-  void *func;
-  char *symbol;
-  short *args;
+  yffc_callback_t *cb;
   yffc_instance_t *obj;
+  long y_type, *task, dims[Y_DIMSIZE];
+  char name[32], *src;
+  int j, k, iarg, nargs, c_type;
 
-  /* Initialization and minimal checking. */
   if (needs_initialization) {
-    yfunc_obj(&yffc_class);
+    callback_func_index = yget_global("_dlcb_func", 0);
+    callback_result_index = yget_global("_dlcb_result", 0);
+    for (j = 0; j < YFFC_CALLBACK_MAX_ARGS; ++j) {
+      sprintf(name, "_dlcb_arg%d", j + 1);
+      callback_arg_index[j] = yget_global(name, 0);
+    }
+    for (j = 0; j <= YFFC_CALLBACK_MAX_ARGS; ++j) {
+      callback_task_index[0][j] = -1L;
+      callback_task_index[1][j] = -1L;
+    }
+    ydl_set_main_thread();
     needs_initialization = FALSE;
   }
-  nargs = argc - 3;
-  if (nargs < 0) ERROR("too few arguments");
+  if (argc < 1) ERROR("too few arguments");
 
-  /* Check that 1st argument is a dynamic module, fetch symbol name and find
-     its address in the module. */
-  if (! ydl_check(argc - 1)) ERROR("expecting dynamic module object");
-  symbol = ygets_q(argc - 3);
-  func = ydl_find(argc - 1, symbol);
-  if (func == NULL) {
-    ERROR("symbol not found in dynamic module object (see dlsym)");
+  /* A wrapped function yields the address of the compiled function. */
+  if (yarg_typeid(argc - 1) == Y_OPAQUE &&
+      yget_obj(argc - 1, NULL) == (void *)yffc_class.type_name) {
+    if (argc != 1) {
+      ERROR("the signature of a wrapped function must not be specified");
+    }
+    obj = yffc_get(0);
+    cb = PUSH_OBJ(yffc_callback_t, yffc_callback_class);
+    cb->native = TRUE;
+    cb->code = obj->func;
+    cb->nargs = obj->nargs;
+    cb->use = yget_use(1);
+    return;
   }
 
-  /* Create the wrapper object. */
-  size = OFFSET_OF(yffc_instance_t, args) + (nargs + 1)*sizeof(short);
-  obj = (yffc_instance_t *)ypush_obj(&yffc_class, size);
+  /* A Yorick function is called through a closure. */
+  if (! yarg_func(argc - 1)) {
+    ERROR("expecting a function or a wrapped function");
+  }
+  nargs = argc - 2;
+  if (nargs < 0) ERROR("missing return type");
+  if (nargs > YFFC_CALLBACK_MAX_ARGS) ERROR("too many arguments");
+#ifndef USE_LIBFFI
+  ERROR("callbacks from Yorick functions require LIBFFI");
+#endif
+  cb = PUSH_OBJ(yffc_callback_t, yffc_callback_class);
   ++argc; /* stack has one more element */
-  args = obj->args;
   for (j = 0; j <= nargs; ++j) {
-    if (j == 0) {
-      /* get stack index for return type */
-      iarg = argc - 2;
+    iarg = argc - 2 - j;
+    y_type = ygets_l(iarg);
+    c_type = -1;
+    for (k = C_VOID; k <= C_POINTER; ++k) {
+      if (type_table[k].y_type == y_type) {
+        c_type = type_table[k].c_type;
+        break;
+      }
+    }
+    if (c_type < 0 || c_type == C_STRING || (j > 0 && c_type == C_VOID)
+        || (j == 0 && c_type == C_POINTER)) {
+      ERROR("unsupported type for a callback");
+    }
+    cb->args[j] = c_type;
+  }
+  cb->nargs = nargs;
+  cb->use = yget_use(argc - 1);
+
+  /* Private function to call the Yorick function, it is parsed the first
+     time it is needed.  Its source is like:
+
+       func _dlcb_call2 {
+         extern _dlcb_result;
+         _dlcb_result = _dlcb_func(_dlcb_arg1, _dlcb_arg2);
+       }
+  */
+  task = &callback_task_index[cb->args[0] != C_VOID][nargs];
+  if (*task < 0L) {
+    char source[80 + 14*YFFC_CALLBACK_MAX_ARGS];
+    if (cb->args[0] == C_VOID) {
+      sprintf(name, "_dlcb_sub%d", nargs);
+      sprintf(source, "func %s { _dlcb_func", name);
     } else {
-      /* get stack index for j-th argument type */
-      iarg = nargs + 1 - j;
+      sprintf(name, "_dlcb_call%d", nargs);
+      sprintf(source, "func %s { extern _dlcb_result; "
+              "_dlcb_result = _dlcb_func(", name);
     }
-    y_type = ygets_l(iarg);
-    switch (y_type) {
-#define CASE(a,b) case a: c_type = b; break
-    CASE(Y_VOID,              C_VOID);
-    CASE(Y_CHAR,              C_CHAR);
-    CASE(Y_SHORT,             C_SHORT);
-    CASE(Y_INT,               C_INT);
-    CASE(Y_LONG,              C_LONG);
-    CASE(Y_FLOAT,             C_FLOAT);
-    CASE(Y_DOUBLE,            C_DOUBLE);
-    CASE(Y_COMPLEX,           C_COMPLEX);
-    CASE(Y_STRING,            C_STRING);
-    CASE(Y_POINTER,           C_POINTER);
-    case Y_STRUCT:
-      ERROR("only pointer(s) to structure(s) are allowed");
-      break;
-    CASE(Y_CHAR_ARRAY,    C_CHAR_ARRAY);
-    CASE(Y_SHORT_ARRAY,   C_SHORT_ARRAY);
-    CASE(Y_INT_ARRAY,     C_INT_ARRAY);
-    CASE(Y_LONG_ARRAY,    C_LONG_ARRAY);
-    CASE(Y_FLOAT_ARRAY,   C_FLOAT_ARRAY);
-    CASE(Y_DOUBLE_ARRAY,  C_DOUBLE_ARRAY);
-    CASE(Y_COMPLEX_ARRAY, C_COMPLEX_ARRAY);
-    CASE(Y_STRING_ARRAY,  C_STRING_ARRAY);
-    CASE(Y_POINTER_ARRAY, C_POINTER_ARRAY);
-#undef CASE
-    default:
-      ERROR("bad type value");
+    for (j = 1; j <= nargs; ++j) {
+      src = source + strlen(source);
+      sprintf(src, (j == 1 && cb->args[0] != C_VOID ? "_dlcb_arg%d"
+                    : ", _dlcb_arg%d"), j);
     }
-    if (j == 0) {
-      if (c_type >= C_POINTER) {
-        if (c_type == C_POINTER) {
-          ERROR("DL_POINTER is not a valid return type "
-                "(use DL_LONG to fake pointers)");
+    strcat(source, (cb->args[0] == C_VOID ? "; }" : "); }"));
+    dims[0] = 0;
+    ypush_q(dims)[0] = p_strcpy(source);
+    yexec_include(0, 1);
+    yarg_drop(1);
+    *task = yget_global(name, 0);
+  }
+  cb->task = *task;
+
+#ifdef USE_LIBFFI
+  for (j = 0; j < nargs; ++j) {
+    cb->atypes[j] = ffi_type_table[cb->args[j + 1]];
+  }
+  if (yffc_prep_call(&cb->cif, nargs, ffi_type_table[cb->args[0]],
+                     cb->atypes) != FFI_OK) {
+    ERROR("failed to prepare the call interface");
+  }
+  cb->closure = ffi_closure_alloc(sizeof(ffi_closure), &cb->code);
+  if (cb->closure == NULL) {
+    ERROR("failed to allocate closure");
+  }
+  if (ffi_prep_closure_loc((ffi_closure *)cb->closure, &cb->cif,
+                           yffc_callback_handler, cb, cb->code) != FFI_OK) {
+    ERROR("failed to prepare closure");
+  }
+#endif
+}
+
+void Y_dlbind(int argc)
+{
+  static int needs_initialization = TRUE;
+  yffc_bound_t *b;
+  yffc_instance_t *obj;
+  long *keys;
+  char name[32], *buffer;
+  long size, index;
+  int iarg, j, k, nargs, fn_iarg, c_type;
+
+  if (needs_initialization) {
+    yfunc_obj(&yffc_bound_class);
+    needs_initialization = FALSE;
+  }
+
+  /* Find the wrapped function, it must be the only positional argument. */
+  fn_iarg = -1;
+  for (iarg = argc - 1; iarg >= 0; --iarg) {
+    if (yarg_key(iarg) >= 0L) {
+      --iarg;
+    } else if (fn_iarg < 0) {
+      fn_iarg = iarg;
+    } else {
+      ERROR("too many arguments (bound values must be given by keywords)");
+    }
+  }
+  if (fn_iarg < 0) ERROR("expecting a function wrapper");
+  obj = yffc_get(fn_iarg);
+  if (NEEDS_TEMPORARIES(obj)) {
+    ERROR("function with output arguments, structures passed by value "
+          "or returning an array cannot be bound");
+  }
+  nargs = obj->nargs;
+
+  /* Create the bound wrapper object, storage for the argument slots and
+     the references is appended to the object.  The indices of the keywords
+     ARG1, ARG2, ... are stored at the end. */
+  size = ROUND_UP(sizeof(yffc_bound_t), sizeof(double));
+  size += nargs*(sizeof(yffc_value_t) + 2*sizeof(void *) + sizeof(int)
+                 + sizeof(long));
+  b = (yffc_bound_t *)ypush_obj(&yffc_bound_class, size);
+  ++argc; /* stack has one more element */
+  buffer = (char *)b + ROUND_UP(sizeof(yffc_bound_t), sizeof(double));
+  b->argv = (yffc_value_t *)buffer;
+  b->avalues = (void **)(b->argv + nargs);
+  b->uses = b->avalues + nargs;
+  keys = (long *)(b->uses + nargs);
+  b->free = (int *)(keys + nargs);
+  for (j = 0; j < nargs; ++j) {
+    sprintf(name, "arg%d", j + 1);
+    keys[j] = yget_global(name, 0);
+    b->free[j] = TRUE; /* used as a flag for now */
+  }
+  b->obj = obj;
+  b->use = yget_use(fn_iarg + 1);
+  yffc_bind_slots(obj, b->argv, b->avalues);
+
+  /* Store the bound values. */
+  for (iarg = argc - 1; iarg >= 1; --iarg) {
+    index = yarg_key(iarg);
+    if (index < 0L) continue;
+    --iarg;
+    for (j = 0; j < nargs && keys[j] != index; ++j)
+      ;
+    if (j >= nargs) ERROR("unknown keyword (expecting ARG1, ARG2, etc.)");
+    if (! b->free[j]) ERROR("argument bound more than once");
+    b->free[j] = FALSE;
+    c_type = obj->args[j + 1];
+    yffc_get_arg(obj, c_type, iarg, &b->argv[j]);
+    if (c_type >= C_STRING) {
+      /* Keep a reference on the value (possibly converted by
+         yffc_get_arg) to make sure the data are not released. */
+      b->uses[j] = yget_use(iarg);
+    }
+  }
+
+  /* Make the list of free arguments. */
+  for (j = 0, k = 0; j < nargs; ++j) {
+    if (b->free[j]) {
+      b->free[k++] = j;
+    }
+  }
+  b->nfree = k;
+}
+
+void Y_dlpipeline(int argc)
+{
+  static int needs_initialization = TRUE;
+  static long stop_index = -1L;
+  yffc_pipeline_t *pl;
+  yffc_stage_t *stage;
+  yffc_instance_t *obj;
+  yffc_value_t *argv;
+  void **avalues;
+  int *sources;
+  const long *wire;
+  char **stops;
+  char *buffer;
+  long size, ntot, dims[Y_DIMSIZE];
+  int iarg, j, k, pass, npos, nstages, nslots, src, stop_iarg;
+
+  if (needs_initialization) {
+    yfunc_obj(&yffc_pipeline_class);
+    stop_index = yget_global("stop", 0);
+    needs_initialization = FALSE;
+  }
+
+  /* First pass to count the stages and the argument slots, second pass
+     (after having pushed the pipeline object, which is then at the bottom of
+     the arguments) to instanciate the stages. */
+  pl = NULL;
+  argv = NULL;
+  avalues = NULL;
+  sources = NULL;
+  nslots = 0;
+  for (pass = 1; pass <= 2; ++pass) {
+    npos = 0;
+    stop_iarg = -1;
+    for (iarg = argc - 1; iarg >= pass - 1; --iarg) {
+      long index = yarg_key(iarg);
+      if (index >= 0L) {
+        --iarg;
+        if (index == stop_index) {
+          stop_iarg = iarg;
         } else {
-          ERROR("unsupported return type");
+          y_error("unknown keyword");
         }
+        continue;
       }
-    } else if (c_type == C_VOID) {
-      if (j == 1 && nargs == 1) {
-        /* foo(void) is threated as if no arguments */
-        --nargs;
+      k = npos/2;
+      if (npos%2 == 0) {
+        /* Wrapped function of the K-th stage. */
+        obj = yffc_get(iarg);
+        if (pass == 1) {
+          if (NEEDS_TEMPORARIES(obj)) {
+            y_error("functions with output arguments, structures passed "
+                    "by value or returning arrays cannot be piped");
+          }
+          nslots += obj->nargs;
+        } else {
+          stage = &pl->stages[k];
+          stage->obj = obj;
+          stage->use = yget_use(iarg);
+          stage->argv = argv;
+          stage->avalues = avalues;
+          stage->src = sources;
+          argv += obj->nargs;
+          avalues += obj->nargs;
+          sources += obj->nargs;
+          yffc_bind_slots(obj, stage->argv, stage->avalues);
+        }
+      } else if (pass == 2) {
+        /* Wiring of the K-th stage. */
+        stage = &pl->stages[k];
+        obj = (yffc_instance_t *)stage->obj;
+        if (yarg_nil(iarg)) {
+          ntot = 0;
+          wire = NULL;
+        } else {
+          wire = ygeta_l(iarg, &ntot, dims);
+          if (dims[0] > 1) y_error("wiring must be a vector");
+        }
+        if (ntot != obj->nargs) {
+          y_error("bad number of sources in wiring");
+        }
+        for (j = 0; j < obj->nargs; ++j) {
+          src = (wire[j] < -k || wire[j] > INT_MAX ? 0 : (int)wire[j]);
+          if (src == 0 || src < -k) {
+            y_error("invalid source in wiring (must be an argument "
+                    "or the result of a previous stage)");
+          }
+          if (src < 0 && ! yffc_convertible(pl->stages[-src - 1].obj->args[0],
+                                           obj->args[j + 1])) {
+            y_error("result of stage cannot be converted "
+                    "to the argument type");
+          }
+          if (src > pl->ninputs) pl->ninputs = src;
+          stage->src[j] = src;
+        }
+      }
+      ++npos;
+    }
+    if (pass == 1) {
+      if (npos < 2 || npos%2 != 0) {
+        y_error("expecting pairs of wrapped function and wiring");
+      }
+      nstages = npos/2;
+
+      /* Storage for the stages is appended to the pipeline object. */
+      size = ROUND_UP(sizeof(yffc_pipeline_t), sizeof(double));
+      size += nstages*ROUND_UP(sizeof(yffc_stage_t), sizeof(double));
+      size += (nstages + nslots)*sizeof(yffc_value_t);
+      size += nslots*(sizeof(void *) + sizeof(int));
+      pl = (yffc_pipeline_t *)ypush_obj(&yffc_pipeline_class, size);
+      ++argc; /* stack has one more element */
+      buffer = (char *)pl + ROUND_UP(sizeof(yffc_pipeline_t), sizeof(double));
+      pl->stages = (yffc_stage_t *)buffer;
+      buffer += nstages*ROUND_UP(sizeof(yffc_stage_t), sizeof(double));
+      pl->results = (yffc_value_t *)buffer;
+      argv = pl->results + nstages;
+      avalues = (void **)(argv + nslots);
+      sources = (int *)(avalues + nslots);
+      pl->nstages = nstages;
+    }
+  }
+
+  /* Stop predicates: a single one for all stages or one per stage. */
+  if (stop_iarg >= 0 && ! yarg_nil(stop_iarg)) {
+    stops = ygeta_q(stop_iarg, &ntot, dims);
+    if (dims[0] > 1 || (ntot != 1 && ntot != pl->nstages)) {
+      y_error("STOP must be a scalar string or have one string per stage");
+    }
+    for (k = 0; k < pl->nstages; ++k) {
+      const char *name = stops[ntot == 1 ? 0 : k];
+      for (j = 0; stop_table[j].name != NULL; ++j) {
+        if (name != NULL && strcmp(name, stop_table[j].name) == 0) break;
+      }
+      if (stop_table[j].name == NULL) y_error("unknown stop predicate");
+      pl->stages[k].stop = stop_table[j].stop;
+    }
+  }
+}
+
+void Y_dlwrap_async(int argc)
+{
+  static int needs_initialization = TRUE;
+  yffc_future_t *fut;
+  yffc_instance_t *obj;
+  yffc_callback_t *cb;
+  char *buffer;
+  long size, rsize;
+  int j, iarg, nargs, c_type;
+
+  if (needs_initialization) {
+    yfunc_obj(&yffc_future_class);
+    needs_initialization = FALSE;
+  }
+  if (argc < 1) ERROR("expecting a function wrapper");
+  obj = yffc_get(argc - 1);
+  if (obj->nouts > 0 || IS_ARRAY_RESULT(obj->args[0])) {
+    ERROR("function with output arguments or returning an array cannot "
+          "be called asynchronously");
+  }
+  nargs = obj->nargs;
+  if (nargs == 0) {
+    if (argc != 1 && (argc > 2 || ! yarg_nil(0))) {
+      ERROR("expecting one nil argument");
+    }
+  } else if (argc - 1 != nargs) {
+    ERROR("bad number of arguments");
+  }
+
+  /* Create the future object, storage for the result, the argument slots
+     and the references is appended to the object. */
+  rsize = (obj->args[0] == C_STRUCT
+           ? ROUND_UP(obj->structs[0]->size, sizeof(yffc_value_t))
+           : sizeof(yffc_value_t));
+  size = ROUND_UP(sizeof(yffc_future_t), sizeof(double));
+  size += rsize + nargs*(sizeof(yffc_value_t) + 2*sizeof(void *));
+  fut = (yffc_future_t *)ypush_obj(&yffc_future_class, size);
+  ++argc; /* stack has one more element */
+  buffer = (char *)fut + ROUND_UP(sizeof(yffc_future_t), sizeof(double));
+  fut->result = (yffc_value_t *)buffer;
+  fut->argv = (yffc_value_t *)(buffer + rsize);
+  fut->avalues = (void **)(fut->argv + nargs);
+  fut->uses = fut->avalues + nargs;
+  fut->obj = obj;
+  fut->use = yget_use(argc - 1);
+
+  /* Convert the arguments. */
+  for (j = 0; j < nargs; ++j) {
+    iarg = argc - 2 - j;
+    c_type = obj->args[j + 1];
+    if (c_type == C_STRUCT) {
+      fut->argv[j].p = ydl_struct_data(iarg, obj->structs[j + 1]);
+    } else {
+      if (c_type == C_POINTER && yarg_typeid(iarg) == Y_OPAQUE &&
+          yget_obj(iarg, NULL) == yffc_callback_class.type_name) {
+        cb = (yffc_callback_t *)yget_obj(iarg, &yffc_callback_class);
+        if (! cb->native) {
+          ERROR("callbacks made from Yorick functions cannot be called "
+                "asynchronously");
+        }
+      }
+      yffc_get_arg(obj, c_type, iarg, &fut->argv[j]);
+    }
+    if (c_type >= C_STRING) {
+      /* Keep a reference on the value (possibly converted by
+         yffc_get_arg) to make sure the data are not released. */
+      fut->uses[j] = yget_use(iarg);
+    }
+  }
+  yffc_bind_slots(obj, fut->argv, fut->avalues);
+
+  /* Start the call, it is done immediately if no thread can be started. */
+  fut->job = ydl_job_start(yffc_future_run, fut);
+  if (fut->job == NULL) {
+    yffc_future_run(fut);
+  }
+}
+
+/* Compare wrappers for sorting them by decreasing time spent in native
+   code. */
+static int yffc_compare_profiles(const void *a, const void *b)
+{
+  long ta = (*(const yffc_instance_t **)a)->ns_total;
+  long tb = (*(const yffc_instance_t **)b)->ns_total;
+  return (ta < tb) - (ta > tb);
+}
+
+void Y_dlwrap_profile(int argc)
+{
+  static long reset_index = -1L;
+  yffc_instance_t *obj, **list;
+  long n, k;
+  int iarg, flag_iarg, reset, previous;
+  char buf[100];
+
+  if (reset_index < 0L) {
+    reset_index = yget_global("reset", 0);
+  }
+  flag_iarg = -1;
+  reset = FALSE;
+  for (iarg = argc - 1; iarg >= 0; --iarg) {
+    long index = yarg_key(iarg);
+    if (index >= 0L) {
+      --iarg;
+      if (index == reset_index) {
+        reset = yarg_true(iarg);
       } else {
-        ERROR("void type is only allowed for the return type "
-              "or for a single argument");
+        y_error("unknown keyword");
       }
+    } else if (flag_iarg < 0) {
+      flag_iarg = iarg;
+    } else {
+      y_error("too many arguments");
+    }
+  }
+  previous = profiling;
+  if (flag_iarg >= 0 && ! yarg_nil(flag_iarg)) {
+    profiling = (yarg_true(flag_iarg) ? TRUE : FALSE);
+    instrumented = (profiling || tracing);
+  } else if (yarg_subroutine()) {
+    /* Print the profiles of the wrappers which have been called, sorted by
+       decreasing time spent in native code. */
+    n = 0;
+    for (obj = yffc_wrappers; obj != NULL; obj = obj->next) {
+      if (obj->ncalls > 0) ++n;
+    }
+    list = (yffc_instance_t **)ypush_scratch((n > 0 ? n : 1)
+                                             *sizeof(yffc_instance_t *),
+                                             NULL);
+    k = 0;
+    for (obj = yffc_wrappers; obj != NULL; obj = obj->next) {
+      if (obj->ncalls > 0) list[k++] = obj;
+    }
+    qsort(list, n, sizeof(yffc_instance_t *), yffc_compare_profiles);
+    y_print("     calls    errors   total(ms)    mean(us)     max(us)"
+            " marshal(us)  symbol", 1);
+    for (k = 0; k < n; ++k) {
+      obj = list[k];
+      sprintf(buf, "%10ld %9ld %11.3f %11.3f %11.3f %11.3f  ",
+              obj->ncalls, obj->nerrors, obj->ns_total*1E-6,
+              obj->ns_total*1E-3/obj->ncalls, obj->ns_max*1E-3,
+              obj->ns_marshal*1E-3/obj->ncalls);
+      y_print(buf, 0);
+      y_print(obj->symbol, 1);
+    }
+    if (! profiling) {
+      y_print("(profiling is disabled, see dlwrap_profile)", 1);
+    }
+  }
+  if (reset) {
+    for (obj = yffc_wrappers; obj != NULL; obj = obj->next) {
+      obj->ncalls = 0;
+      obj->nerrors = 0;
+      obj->ns_total = 0;
+      obj->ns_max = 0;
+      obj->ns_marshal = 0;
     }
-    args[j] = c_type;
   }
+  ypush_int(previous);
+}
 
-  /* Instanciate the other members of the wrapper object.  The wrapper object
-     keeps a reference on the dynamic module object. */
-  obj->nargs = nargs;
-  obj->func = func;
-  obj->symbol = p_strcpy(symbol);
-  obj->module = yget_use(argc - 1);
+void Y_dlwrap_intern(int argc)
+{
+  static long clear_index = -1L;
+  yffc_intern_t *entry;
+  yffc_instance_t *obj;
+  long j, *stats, dims[2];
+  int iarg, flag_iarg, clear;
+  char buf[100];
+
+  if (clear_index < 0L) {
+    clear_index = yget_global("clear", 0);
+  }
+  flag_iarg = -1;
+  clear = FALSE;
+  for (iarg = argc - 1; iarg >= 0; --iarg) {
+    long index = yarg_key(iarg);
+    if (index >= 0L) {
+      --iarg;
+      if (index == clear_index) {
+        clear = yarg_true(iarg);
+      } else {
+        y_error("unknown keyword");
+      }
+    } else if (flag_iarg < 0) {
+      flag_iarg = iarg;
+    } else {
+      y_error("too many arguments");
+    }
+  }
+  if (flag_iarg >= 0 && ! yarg_nil(flag_iarg)) {
+    interned.enabled = (yarg_true(flag_iarg) ? TRUE : FALSE);
+  } else if (yarg_subroutine() && ! clear) {
+    /* Print the interned wrappers. */
+    y_print("      hits  nargs  path    symbol", 1);
+    for (j = 0; j < interned.nbuckets; ++j) {
+      for (entry = interned.buckets[j]; entry != NULL;
+           entry = entry->next) {
+        obj = entry->obj;
+        sprintf(buf, "%10ld  %5d  %-6s  ", entry->hits, obj->nargs,
+                (obj->thunk != NULL ? "thunk" : (obj->code != NULL ? "jit" :
+                 yffc_engine_name(obj->engine))));
+        y_print(buf, 0);
+        y_print(entry->symbol, 1);
+      }
+    }
+    sprintf(buf, "(%ld interned wrapper(s), %ld hit(s), %ld miss(es)%s)",
+            interned.count, interned.hits, interned.misses,
+            (interned.enabled ? "" : ", interning is disabled"));
+    y_print(buf, 1);
+  }
+  dims[0] = 1;
+  dims[1] = 3;
+  stats = ypush_l(dims);
+  stats[0] = interned.count;
+  stats[1] = interned.hits;
+  stats[2] = interned.misses;
+  if (clear) {
+    yffc_intern_clear();
+    interned.hits = 0;
+    interned.misses = 0;
+  }
+}
+
+void Y_dlwrap_trace(int argc)
+{
+  long size, number;
+  unsigned long n;
+
+  if (argc > 1) ERROR("too many arguments");
+  if (argc == 1 && ! yarg_nil(0)) {
+    size = ygets_l(0);
+    if (size < 0) ERROR("invalid number of entries");
+    if (size > 0) {
+      /* Start tracing with a new ring buffer. */
+      n = 1;
+      while (n < (unsigned long)size) {
+        n *= 2;
+      }
+      yffc_trace_clear(n);
+      tracing = TRUE;
+    } else {
+      /* Stop tracing, recorded entries are kept. */
+      tracing = FALSE;
+    }
+    instrumented = (profiling || tracing);
+  }
+  number = (trace.entries == NULL ? 0 :
+            (trace.count > trace.mask ? trace.mask + 1 : trace.count));
+  ypush_long(number);
+}
+
+/* Write a symbol name in a JSON string. */
+static void yffc_trace_put_name(FILE *file, const char *name)
+{
+  int c;
+  fputc('"', file);
+  while ((c = *name++) != '\0') {
+    if (c == '"' || c == '\\') {
+      fputc('\\', file);
+      fputc(c, file);
+    } else if ((c & 0xff) >= ' ') {
+      fputc(c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+void Y_dlwrap_trace_dump(int argc)
+{
+  static long binary_index = -1L;
+  yffc_trace_entry_t *entry;
+  unsigned long first, last, i;
+  const char *name;
+  char *path;
+  FILE *file;
+  long pid, header[2];
+  int iarg, name_iarg, binary, status, k, len;
+
+  if (binary_index < 0L) {
+    binary_index = yget_global("binary", 0);
+  }
+  name_iarg = -1;
+  binary = FALSE;
+  for (iarg = argc - 1; iarg >= 0; --iarg) {
+    long index = yarg_key(iarg);
+    if (index >= 0L) {
+      --iarg;
+      if (index == binary_index) {
+        binary = yarg_true(iarg);
+      } else {
+        y_error("unknown keyword");
+      }
+    } else if (name_iarg < 0) {
+      name_iarg = iarg;
+    } else {
+      y_error("too many arguments");
+    }
+  }
+  if (name_iarg < 0) ERROR("missing file name");
+  name = ygets_q(name_iarg);
+  if (name == NULL || name[0] == '\0') ERROR("invalid file name");
+
+  /* Recorded entries, from the oldest to the newest. */
+  last = trace.count;
+  first = (trace.entries == NULL ? last :
+           (last > trace.mask ? last - trace.mask - 1 : 0));
+
+  path = p_native(name);
+  file = fopen(path, (binary ? "wb" : "w"));
+  p_free(path);
+  if (file == NULL) ERROR("cannot open trace file for writing");
+  if (binary) {
+    /* Header with magic, number of names and number of entries, then the
+       names (each preceded by its length) and the entries (with times
+       relative to the start of the trace and Yorick type identifiers), all
+       in native byte order. */
+    fwrite("YDLTRACE", 1, 8, file);
+    header[0] = trace.nnames;
+    header[1] = (long)(last - first);
+    fwrite(header, sizeof(long), 2, file);
+    for (k = 0; k < trace.nnames; ++k) {
+      len = (int)strlen(trace.names[k]);
+      fwrite(&len, sizeof(int), 1, file);
+      fwrite(trace.names[k], 1, len, file);
+    }
+    for (i = first; i < last; ++i) {
+      yffc_trace_entry_t tmp = trace.entries[i & trace.mask];
+      tmp.start -= trace.origin;
+      tmp.end -= trace.origin;
+      tmp.rtype = type_table[tmp.rtype].y_type;
+      fwrite(&tmp, sizeof(tmp), 1, file);
+    }
+  } else {
+    /* Chrome trace event format ("complete" events, times in
+       microseconds). */
+    pid = (long)getpid();
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", file);
+    for (i = first; i < last; ++i) {
+      entry = &trace.entries[i & trace.mask];
+      fputs((i == first ? "\n{\"name\":" : ",\n{\"name\":"), file);
+      yffc_trace_put_name(file, trace.names[entry->symbol]);
+      fprintf(file, ",\"cat\":\"dlwrap\",\"ph\":\"X\",\"ts\":%.3f,"
+              "\"dur\":%.3f,\"pid\":%ld,\"tid\":1,"
+              "\"args\":{\"rtype\":\"%s\",\"errno\":%d}}",
+              (entry->start - trace.origin)*1E-3,
+              (entry->end - entry->start)*1E-3, pid,
+              type_table[entry->rtype].c_name, entry->error);
+    }
+    fputs("\n]}\n", file);
+  }
+  status = ferror(file);
+  if (fclose(file) != 0 || status != 0) {
+    ERROR("error while writing trace file");
+  }
+}
+
+void Y_dlwrap_conversions(int argc)
+{
+  static long reset_index = -1L;
+  yffc_instance_t *obj;
+  long dims[2], *result;
+  int iarg, fn_iarg, reset;
+
+  if (reset_index < 0L) {
+    reset_index = yget_global("reset", 0);
+  }
+  fn_iarg = -1;
+  reset = FALSE;
+  for (iarg = argc - 1; iarg >= 0; --iarg) {
+    long index = yarg_key(iarg);
+    if (index >= 0L) {
+      --iarg;
+      if (index == reset_index) {
+        reset = yarg_true(iarg);
+      } else {
+        y_error("unknown keyword");
+      }
+    } else if (fn_iarg < 0) {
+      fn_iarg = iarg;
+    } else {
+      y_error("too many arguments");
+    }
+  }
+  obj = ((fn_iarg >= 0 && ! yarg_nil(fn_iarg))
+         ? yffc_get(fn_iarg) : NULL);
+  dims[0] = 1;
+  dims[1] = 2;
+  result = ypush_l(dims);
+  if (obj != NULL) {
+    result[0] = obj->conversions;
+    result[1] = obj->copied;
+    if (reset) {
+      obj->conversions = 0;
+      obj->copied = 0;
+    }
+  } else {
+    result[0] = conversions;
+    result[1] = copied;
+    if (reset) {
+      conversions = 0;
+      copied = 0;
+    }
+  }
 }
 
 void Y_dlwrap_errno(int argc)
@@ -0,0 +1,683 @@
+/*
+ * ydldecl.c --
+ *
+ * Declaration of wrapped functions from their C prototypes.
+ *
+ *-----------------------------------------------------------------------------
+ *
+ * Copyright (C) 2011-2015: Éric Thiébaut <https://github.com/emmt>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <pstdlib.h>
+#include "ydlwrap.h"
+
+/*
+ * The prototypes are parsed by a small recursive descent parser which only
+ * knows about the basic C types, the qualifiers, the pointers and the
+ * (unsized) arrays.  Other type names are looked up in the typedefs given
+ * by the caller and then in a table of the most common system types.  The
+ * C types are then mapped to the type identifiers of dlwrap as follows:
+ *
+ *   T          -> T           for a numerical type T (argument or result)
+ *   const char* -> DL_STRING  (argument)
+ *   char*      -> DL_STRING   (result)
+ *   T*         -> DL_POINTER  (argument)
+ *   T*         -> DL_ADDRESS  (result)
+ *   T x[]      -> T array     (argument)
+ *   char* x[]  -> DL_STRING_ARRAY (argument)
+ *   T* x[]     -> DL_POINTER_ARRAY (argument)
+ *   OUT T*     -> DL_T_OUT    (argument, T numerical)
+ *   OUT T**    -> DL_ADDRESS_OUT (argument)
+ *
+ * and similarly for INOUT.  The wrappers are then created by ydl_wrap() as
+ * if dlwrap had been called with these identifiers.
+ */
+
+#define NUMBER_OF(arr) ((long)(sizeof(arr)/sizeof((arr)[0])))
+
+#define IS_NUMERICAL(type) ((type) >= Y_CHAR && (type) <= Y_COMPLEX)
+
+/* Pseudo types for the structures (and unions) and for the system types
+   which have no Yorick counterpart. */
+#define BASE_NONE    (-1)
+#define BASE_STRUCT  (-2)
+
+/* Yorick integer type of a given size. */
+#define INTEGER_OF_SIZE(n) ((n) == sizeof(char)  ? Y_CHAR  :    \
+                            (n) == sizeof(short) ? Y_SHORT :    \
+                            (n) == sizeof(int)   ? Y_INT   :    \
+                            (n) == sizeof(long)  ? Y_LONG  : BASE_NONE)
+#define INTEGER(type) INTEGER_OF_SIZE(sizeof(type))
+
+/* Type used for the addresses (see DL_ADDRESS in dlwrap.i). */
+#define ADDRESS (sizeof(void *) == sizeof(long) ? Y_LONG : Y_INT)
+
+/* Common system types.  There are no unsigned integers in Yorick, signed
+   integers of the same size will do. */
+static const struct {
+  const char *name;
+  int base;
+} system_types[] = {
+  {"size_t",    INTEGER(size_t)},
+  {"ssize_t",   INTEGER(ssize_t)},
+  {"ptrdiff_t", INTEGER(ptrdiff_t)},
+  {"intptr_t",  INTEGER(void *)},
+  {"uintptr_t", INTEGER(void *)},
+  {"off_t",     INTEGER(off_t)},
+  {"pid_t",     INTEGER(pid_t)},
+  {"uid_t",     INTEGER(uid_t)},
+  {"gid_t",     INTEGER(gid_t)},
+  {"mode_t",    INTEGER(mode_t)},
+  {"key_t",     INTEGER(key_t)},
+  {"time_t",    INTEGER(time_t)},
+  {"socklen_t", INTEGER_OF_SIZE(4)},
+  {"int8_t",    INTEGER_OF_SIZE(1)},
+  {"uint8_t",   INTEGER_OF_SIZE(1)},
+  {"int16_t",   INTEGER_OF_SIZE(2)},
+  {"uint16_t",  INTEGER_OF_SIZE(2)},
+  {"int32_t",   INTEGER_OF_SIZE(4)},
+  {"uint32_t",  INTEGER_OF_SIZE(4)},
+  {"int64_t",   INTEGER_OF_SIZE(8)},
+  {"uint64_t",  INTEGER_OF_SIZE(8)},
+};
+
+/* Words which are ignored in a declaration. */
+static const char *ignored_words[] = {
+  "volatile", "restrict", "__restrict", "__restrict__", "extern", "static",
+  "inline", "register", "__extension__"
+};
+
+/* A parsed C type. */
+typedef struct _decl_type decl_type_t;
+struct _decl_type {
+  int base;     /* Yorick type, Y_VOID, BASE_STRUCT or BASE_NONE */
+  int stars;    /* level of indirection */
+  int constant; /* the base type is qualified by const */
+  int text;     /* the base type is a plain char (neither signed nor
+                   unsigned, nor given by a typedef) */
+  int array;    /* the declarator is an array */
+  int flags;    /* OUT_FLAG or INOUT_FLAG for an output argument */
+};
+
+/* A typedef given by the caller.  The name is not NUL terminated. */
+typedef struct _decl_typedef decl_typedef_t;
+struct _decl_typedef {
+  const char *name;
+  int len;
+  decl_type_t type;
+};
+
+/* Kinds of tokens (other ones are single punctuation characters). */
+#define TOK_END       0
+#define TOK_IDENT     1
+#define TOK_ELLIPSIS  2
+
+typedef struct _decl_parser decl_parser_t;
+struct _decl_parser {
+  const char *text;         /* text being parsed (for error messages) */
+  const char *ptr;          /* current position */
+  const char *tok;          /* first character of current token */
+  int len;                  /* length of current token */
+  int kind;                 /* kind of current token */
+  decl_typedef_t *typedefs; /* typedefs of the caller */
+  long ntypedefs;           /* number of typedefs */
+};
+
+static void decl_error(const decl_parser_t *p, const char *reason)
+{
+  char buf[100];
+  sprintf(buf, "%.60s in \"%%s\"", reason);
+  y_errorq(buf, p->text);
+}
+
+static int is_ident(int c, int first)
+{
+  return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' ||
+          (! first && c >= '0' && c <= '9'));
+}
+
+static void next_token(decl_parser_t *p)
+{
+  const char *s = p->ptr;
+
+  while (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r') ++s;
+  p->tok = s;
+  if (*s == '\0') {
+    p->kind = TOK_END;
+  } else if (is_ident(*s, TRUE)) {
+    do { ++s; } while (is_ident(*s, FALSE));
+    p->kind = TOK_IDENT;
+  } else if (s[0] == '.' && s[1] == '.' && s[2] == '.') {
+    s += 3;
+    p->kind = TOK_ELLIPSIS;
+  } else {
+    p->kind = *s++;
+  }
+  p->len = (int)(s - p->tok);
+  p->ptr = s;
+}
+
+static int match(const decl_parser_t *p, const char *word)
+{
+  return (p->kind == TOK_IDENT && strncmp(p->tok, word, p->len) == 0 &&
+          word[p->len] == '\0');
+}
+
+static int is_ignored(const decl_parser_t *p)
+{
+  long k;
+  for (k = 0; k < NUMBER_OF(ignored_words); ++k) {
+    if (match(p, ignored_words[k])) return TRUE;
+  }
+  return FALSE;
+}
+
+/* Find the definition of the type name of the current token.  The last
+   typedefs of the caller have precedence. */
+static int find_typedef(const decl_parser_t *p, decl_type_t *type)
+{
+  long k;
+
+  for (k = p->ntypedefs - 1; k >= 0; --k) {
+    if (p->typedefs[k].len == p->len &&
+        strncmp(p->typedefs[k].name, p->tok, p->len) == 0) {
+      *type = p->typedefs[k].type;
+      return TRUE;
+    }
+  }
+  for (k = 0; k < NUMBER_OF(system_types); ++k) {
+    if (match(p, system_types[k].name)) {
+      memset(type, 0, sizeof(*type));
+      type->base = system_types[k].base;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/* Parse a declaration (a type followed by an optional name).  NAME and LEN
+   are set with the name if any. */
+static void parse_declaration(decl_parser_t *p, decl_type_t *type,
+                              const char **name, int *len)
+{
+  decl_type_t def;
+  int nvoid = 0, nchar = 0, nshort = 0, nint = 0, nlong = 0, nsign = 0;
+  int nfloat = 0, ndouble = 0, ncomplex = 0, nstruct = 0, ntypedef = 0;
+  int constant = FALSE, flags = 0;
+
+  *name = NULL;
+  *len = 0;
+  memset(&def, 0, sizeof(def));
+
+  /* Type specifiers and qualifiers. */
+  while (p->kind == TOK_IDENT) {
+    if (match(p, "const")) {
+      constant = TRUE;
+    } else if (is_ignored(p)) {
+      ;
+    } else if (match(p, "OUT")) {
+      flags = OUT_FLAG;
+    } else if (match(p, "INOUT")) {
+      flags = INOUT_FLAG;
+    } else if (match(p, "signed") || match(p, "unsigned")) {
+      ++nsign;
+    } else if (match(p, "void")) {
+      ++nvoid;
+    } else if (match(p, "char")) {
+      ++nchar;
+    } else if (match(p, "short")) {
+      ++nshort;
+    } else if (match(p, "int")) {
+      ++nint;
+    } else if (match(p, "long")) {
+      ++nlong;
+    } else if (match(p, "float")) {
+      ++nfloat;
+    } else if (match(p, "double")) {
+      ++ndouble;
+    } else if (match(p, "complex") || match(p, "_Complex")) {
+      ++ncomplex;
+    } else if (match(p, "struct") || match(p, "union") || match(p, "enum")) {
+      if (match(p, "enum")) ++nint; else ++nstruct;
+      next_token(p);
+      if (p->kind != TOK_IDENT) decl_error(p, "missing tag name");
+    } else if (nvoid + nchar + nshort + nint + nlong + nsign + nfloat +
+               ndouble + ncomplex + nstruct + ntypedef == 0) {
+      if (! find_typedef(p, &def)) decl_error(p, "unknown type name");
+      ++ntypedef;
+    } else {
+      /* This is the name of the declaration. */
+      break;
+    }
+    next_token(p);
+  }
+
+  /* Base type. */
+  memset(type, 0, sizeof(*type));
+  if (ntypedef > 0) {
+    *type = def;
+    type->text = FALSE;
+  } else if (nstruct > 0) {
+    type->base = BASE_STRUCT;
+  } else if (nvoid > 0) {
+    type->base = Y_VOID;
+  } else if (ncomplex > 0) {
+    if (ndouble != 1 || nlong > 0) decl_error(p, "unsupported complex type");
+    type->base = Y_COMPLEX;
+  } else if (ndouble > 0) {
+    if (nlong > 0) decl_error(p, "long double is not supported");
+    type->base = Y_DOUBLE;
+  } else if (nfloat > 0) {
+    type->base = Y_FLOAT;
+  } else if (nchar > 0) {
+    type->base = Y_CHAR;
+    type->text = (nsign == 0);
+  } else if (nshort > 0) {
+    type->base = Y_SHORT;
+  } else if (nlong == 1) {
+    type->base = Y_LONG;
+  } else if (nlong == 2) {
+    type->base = (sizeof(long) >= 8 ? Y_LONG : BASE_NONE);
+  } else if (nint > 0 || nsign > 0) {
+    type->base = Y_INT;
+  } else {
+    decl_error(p, "missing type");
+  }
+  if (type->base == BASE_NONE) decl_error(p, "unsupported type");
+  if (constant) type->constant = TRUE;
+  type->flags = flags;
+
+  /* Pointers (qualifiers of the pointers are ignored). */
+  while (p->kind == '*') {
+    ++type->stars;
+    next_token(p);
+    while (match(p, "const") || is_ignored(p)) next_token(p);
+  }
+
+  /* Name and array declarator. */
+  if (p->kind == '(') decl_error(p, "unsupported declarator");
+  if (p->kind == TOK_IDENT) {
+    *name = p->tok;
+    *len = p->len;
+    next_token(p);
+  }
+  while (p->kind == '[') {
+    do {
+      next_token(p);
+      if (p->kind == TOK_END) decl_error(p, "missing ']'");
+    } while (p->kind != ']');
+    next_token(p);
+    if (type->array) decl_error(p, "multi-dimensional arrays not supported");
+    type->array = TRUE;
+  }
+}
+
+/* Yield the type identifier of dlwrap for a parsed type. */
+static long type_identifier(const decl_parser_t *p, const decl_type_t *type,
+                            int result)
+{
+  if (type->flags != 0) {
+    if (result || type->array || type->stars < 1) {
+      decl_error(p, "OUT/INOUT only apply to pointer arguments");
+    }
+    if (type->stars >= 2) return (ADDRESS | type->flags);
+    if (! IS_NUMERICAL(type->base)) decl_error(p, "bad output argument");
+    return (type->base | type->flags);
+  }
+  if (type->array) {
+    if (type->stars == 0 && IS_NUMERICAL(type->base)) {
+      return ARRAY_OF(type->base);
+    }
+    if (type->stars == 1 && type->text) return Y_STRING_ARRAY;
+    if (type->stars >= 1) return Y_POINTER_ARRAY;
+    decl_error(p, "unsupported array type");
+  }
+  if (type->stars == 0) {
+    if (type->base == BASE_STRUCT) {
+      decl_error(p, "structures passed by value must be given to dlwrap");
+    }
+    if (type->base == Y_VOID && ! result) decl_error(p, "void argument");
+    return type->base;
+  }
+  /* Only a plain char points to text, other bytes are binary data. */
+  if (type->stars == 1 && type->text && (result || type->constant)) {
+    return Y_STRING;
+  }
+  return (result ? ADDRESS : Y_POINTER);
+}
+
+/*---------------------------------------------------------------------------*/
+/* Table of Wrapped Functions */
+
+typedef struct _decl_entry decl_entry_t;
+struct _decl_entry {
+  char *name;  /* name of the function */
+  void *use;   /* reference on the wrapper */
+};
+
+typedef struct _decl_table decl_table_t;
+struct _decl_table {
+  decl_entry_t *entries;    /* wrapped functions sorted by name */
+  long nentries;            /* number of entries */
+  void *module;             /* reference on the dynamic module */
+  long *types;              /* workspace for the types of a prototype */
+  decl_typedef_t *typedefs; /* workspace for the typedefs */
+};
+
+static void decl_table_free(void *);
+static void decl_table_print(void *);
+static void decl_table_eval(void *, int);
+static void decl_table_extract(void *, char *);
+
+static y_userobj_t decl_table_class = {
+  "DLTable",
+  decl_table_free,
+  decl_table_print,
+  decl_table_eval,
+  decl_table_extract,
+  NULL
+};
+
+static void decl_table_free(void *self)
+{
+  decl_table_t *tab = (decl_table_t *)self;
+  long k;
+
+  if (tab->entries != NULL) {
+    for (k = 0; k < tab->nentries; ++k) {
+      if (tab->entries[k].use != NULL) ydrop_use(tab->entries[k].use);
+      if (tab->entries[k].name != NULL) p_free(tab->entries[k].name);
+    }
+    p_free(tab->entries);
+  }
+  if (tab->module != NULL) ydrop_use(tab->module);
+  if (tab->types != NULL) p_free(tab->types);
+  if (tab->typedefs != NULL) p_free(tab->typedefs);
+}
+
+static void decl_table_print(void *self)
+{
+  decl_table_t *tab = (decl_table_t *)self;
+  long k;
+  char buf[100];
+
+  y_print(decl_table_class.type_name, 0);
+  sprintf(buf, " object (table of %ld wrapped function(s)):", tab->nentries);
+  y_print(buf, 1);
+  for (k = 0; k < tab->nentries; ++k) {
+    y_print("  ", 0);
+    y_print(tab->entries[k].name, 1);
+  }
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+  return strcmp(((const decl_entry_t *)a)->name,
+                ((const decl_entry_t *)b)->name);
+}
+
+static decl_entry_t *find_entry(decl_table_t *tab, const char *name)
+{
+  decl_entry_t key;
+
+  if (name == NULL) return NULL;
+  key.name = (char *)name;
+  return (decl_entry_t *)bsearch(&key, tab->entries, tab->nentries,
+                                 sizeof(decl_entry_t), compare_entries);
+}
+
+static void push_entry(decl_table_t *tab, const char *name)
+{
+  decl_entry_t *entry = find_entry(tab, name);
+  if (entry == NULL) {
+    y_errorq("no function \"%s\" in table", (name != NULL ? name : ""));
+  }
+  ykeep_use(entry->use);
+}
+
+static void decl_table_eval(void *self, int argc)
+{
+  decl_table_t *tab = (decl_table_t *)self;
+  char **names;
+  long k, dims[2];
+
+  if (argc != 1) y_error("expecting exactly one argument");
+  if (yarg_nil(0)) {
+    /* Yield the names of the functions. */
+    if (tab->nentries < 1) {
+      ypush_nil();
+      return;
+    }
+    dims[0] = 1;
+    dims[1] = tab->nentries;
+    names = ypush_q(dims);
+    for (k = 0; k < tab->nentries; ++k) {
+      names[k] = p_strcpy(tab->entries[k].name);
+    }
+  } else {
+    push_entry(tab, ygets_q(0));
+  }
+}
+
+static void decl_table_extract(void *addr, char *member)
+{
+  push_entry((decl_table_t *)addr, member);
+}
+
+/* Parse the typedef declaration TEXT and append it to the typedefs of
+   parser P. */
+static void parse_typedef(decl_parser_t *p, const char *text)
+{
+  decl_typedef_t *def = &p->typedefs[p->ntypedefs];
+  const char *name;
+  int len;
+
+  p->text = text;
+  p->ptr = text;
+  next_token(p);
+  if (match(p, "typedef")) next_token(p);
+  parse_declaration(p, &def->type, &name, &len);
+  if (p->kind == ';') next_token(p);
+  if (name == NULL) decl_error(p, "missing type name");
+  if (p->kind != TOK_END) decl_error(p, "syntax error");
+  if (def->type.array || def->type.flags != 0) {
+    decl_error(p, "unsupported typedef");
+  }
+  def->name = name;
+  def->len = len;
+  ++p->ntypedefs;
+}
+
+/* Parse the prototype TEXT and store the type identifiers of its result and
+   of its arguments in TYPES (which must be large enough).  The number of
+   arguments is returned, NAME and LEN are set with the name of the
+   function. */
+static int parse_prototype(decl_parser_t *p, const char *text, long *types,
+                           const char **name, int *len)
+{
+  decl_type_t type;
+  const char *arg_name;
+  int arg_len, nargs;
+
+  p->text = text;
+  p->ptr = text;
+  next_token(p);
+  parse_declaration(p, &type, name, len);
+  if (*name == NULL) decl_error(p, "missing function name");
+  if (type.array) decl_error(p, "syntax error");
+  types[0] = type_identifier(p, &type, TRUE);
+  if (p->kind != '(') decl_error(p, "expecting '('");
+  next_token(p);
+  nargs = 0;
+  if (p->kind == ')') {
+    next_token(p);
+  } else {
+    for (;;) {
+      if (p->kind == TOK_ELLIPSIS) {
+        decl_error(p, "variadic functions are not supported");
+      }
+      parse_declaration(p, &type, &arg_name, &arg_len);
+      if (nargs == 0 && type.base == Y_VOID && type.stars == 0 &&
+          arg_name == NULL && p->kind == ')') {
+        /* Function taking no arguments. */
+        next_token(p);
+        break;
+      }
+      types[++nargs] = type_identifier(p, &type, FALSE);
+      if (p->kind == ')') {
+        next_token(p);
+        break;
+      }
+      if (p->kind != ',') decl_error(p, "expecting ',' or ')'");
+      next_token(p);
+    }
+  }
+  if (p->kind == ';') next_token(p);
+  if (p->kind != TOK_END) decl_error(p, "syntax error");
+  return nargs;
+}
+
+void Y_dlwrap_declare(int argc)
+{
+  static long typedefs_index = -1L, lazy_index = -1L;
+  decl_parser_t parser;
+  decl_table_t *tab;
+  decl_entry_t *entry;
+  char **protos, **typedefs;
+  const char *name, *s;
+  long index, k, n, nprotos, ntypedefs, size;
+  int iarg, nargs, len, lazy, dl_iarg, protos_iarg, typedefs_iarg;
+
+  if (typedefs_index < 0L) {
+    typedefs_index = yget_global("typedefs", 0);
+    lazy_index = yget_global("lazy", 0);
+  }
+
+  /* Parse the arguments. */
+  dl_iarg = protos_iarg = typedefs_iarg = -1;
+  lazy = FALSE;
+  nargs = 0;
+  for (iarg = argc - 1; iarg >= 0; --iarg) {
+    index = yarg_key(iarg);
+    if (index < 0L) {
+      if (nargs == 0) {
+        dl_iarg = iarg;
+      } else if (nargs == 1) {
+        protos_iarg = iarg;
+      } else {
+        y_error("too many arguments");
+      }
+      ++nargs;
+    } else {
+      --iarg;
+      if (index == typedefs_index) {
+        typedefs_iarg = iarg;
+      } else if (index == lazy_index) {
+        lazy = yarg_true(iarg);
+      } else {
+        y_error("unknown keyword");
+      }
+    }
+  }
+  if (nargs != 2) y_error("expecting exactly two arguments");
+  if (! ydl_check(dl_iarg)) y_error("expecting dynamic module object");
+  protos = ygeta_q(protos_iarg, &nprotos, NULL);
+  if (typedefs_iarg >= 0 && ! yarg_nil(typedefs_iarg)) {
+    typedefs = ygeta_q(typedefs_iarg, &ntypedefs, NULL);
+  } else {
+    typedefs = NULL;
+    ntypedefs = 0;
+  }
+
+  /* Create the table which owns all the resources in case of errors.  The
+     workspace for the types is large enough for the prototype with the most
+     commas. */
+  tab = (decl_table_t *)ypush_obj(&decl_table_class, sizeof(decl_table_t));
+  ++dl_iarg;
+  tab->module = yget_use(dl_iarg);
+  tab->entries = (decl_entry_t *)p_malloc((nprotos > 0 ? nprotos : 1)*
+                                          sizeof(decl_entry_t));
+  memset(tab->entries, 0, (nprotos > 0 ? nprotos : 1)*sizeof(decl_entry_t));
+  size = 0;
+  for (k = 0; k < nprotos; ++k) {
+    n = 2;
+    for (s = protos[k]; s != NULL && *s != '\0'; ++s) {
+      if (*s == ',') ++n;
+    }
+    if (n > size) size = n;
+  }
+  tab->types = (long *)p_malloc(size*sizeof(long));
+  tab->typedefs = (decl_typedef_t *)p_malloc((ntypedefs > 0 ? ntypedefs : 1)*
+                                             sizeof(decl_typedef_t));
+  memset(&parser, 0, sizeof(parser));
+  parser.typedefs = tab->typedefs;
+  for (k = 0; k < ntypedefs; ++k) {
+    if (typedefs[k] != NULL && typedefs[k][0] != '\0') {
+      parse_typedef(&parser, typedefs[k]);
+    }
+  }
+
+  /* Parse the prototypes and create the wrappers (blank prototypes are
+     ignored). */
+  for (k = 0; k < nprotos; ++k) {
+    if (protos[k] == NULL) continue;
+    for (s = protos[k]; *s == ' ' || *s == '\t'; ++s)
+      ;
+    if (*s == '\0') continue;
+    nargs = parse_prototype(&parser, protos[k], tab->types, &name, &len);
+    entry = &tab->entries[tab->nentries];
+    entry->name = p_strncat(NULL, name, len);
+    ++tab->nentries;
+    ykeep_use(tab->module);
+    ypush_long(tab->types[0]);
+    *ypush_q(NULL) = p_strcpy(entry->name);
+    for (iarg = 1; iarg <= nargs; ++iarg) {
+      ypush_long(tab->types[iarg]);
+    }
+    ydl_wrap(nargs + 3, lazy);
+    entry->use = yget_use(0);
+    yarg_drop(nargs + 4);
+  }
+
+  /* Sort the entries for searching them by name. */
+  qsort(tab->entries, tab->nentries, sizeof(decl_entry_t), compare_entries);
+  for (k = 1; k < tab->nentries; ++k) {
+    if (strcmp(tab->entries[k - 1].name, tab->entries[k].name) == 0) {
+      y_errorq("function \"%s\" declared more than once",
+               tab->entries[k].name);
+    }
+  }
+  p_free(tab->typedefs);
+  tab->typedefs = NULL;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * tab-width: 8
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * fill-column: 79
+ * coding: utf-8
+ * ispell-local-dictionary: "american"
+ * End:
+ */
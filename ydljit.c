@@ -0,0 +1,309 @@
+/*
+ * ydljit.c --
+ *
+ * Native trampolines for calling wrapped functions (x86-64 System V ABI).
+ *
+ *-----------------------------------------------------------------------------
+ *
+ * Copyright (C) 2011-2015: Éric Thiébaut <https://github.com/emmt>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "ydlwrap.h"
+
+#if defined(__x86_64__) && defined(__linux__) && ! defined(YDL_NO_JIT)
+# define USE_JIT 1
+# include <sys/mman.h>
+# include <unistd.h>
+#endif
+
+#ifdef USE_JIT
+
+/*
+ * A trampoline is called as:
+ *
+ *     trampoline(argv, result);
+ *
+ * with ARGV the address of the argument slots and RESULT the address of the
+ * slot where to store the result.  The generated code is:
+ *
+ *     push  rbx                  ; save callee-saved register (this also
+ *                                ; aligns the stack on 16 bytes)
+ *     mov   rbx, rsi             ; RBX = RESULT
+ *     mov   r10, rdi             ; R10 = ARGV
+ *     ...                        ; load arguments in registers from [r10+...]
+ *     mov   eax, NSSE            ; number of SSE registers (for varargs)
+ *     mov   r11, FUNC
+ *     call  r11
+ *     ...                        ; store result from RAX or XMM0/XMM1
+ *     pop   rbx
+ *     ret
+ *
+ * Only arguments passed in registers are supported (at most 6 integer/pointer
+ * arguments and 8 floating-point ones, a complex takes 2 floating-point
+ * registers).
+ */
+
+#define MAX_INT_REGS 6
+#define MAX_SSE_REGS 8
+#define CODE_SIZE    512 /* more than enough for YDL_JIT_MAX_ARGS arguments */
+
+/* Encodings of the integer registers used to pass arguments (in order): RDI,
+   RSI, RDX, RCX, R8 and R9. */
+static const int int_regs[MAX_INT_REGS] = {7, 6, 2, 1, 8, 9};
+
+typedef struct _emitter emitter_t;
+struct _emitter {
+  unsigned char *code;
+  size_t len;
+};
+
+static void put8(emitter_t *e, unsigned int byte)
+{
+  e->code[e->len++] = (unsigned char)byte;
+}
+
+static void put32(emitter_t *e, unsigned long value)
+{
+  int k;
+  for (k = 0; k < 4; ++k) {
+    put8(e, (value >> (8*k)) & 0xff);
+  }
+}
+
+static void put64(emitter_t *e, unsigned long value)
+{
+  int k;
+  for (k = 0; k < 8; ++k) {
+    put8(e, (value >> (8*k)) & 0xff);
+  }
+}
+
+/* Emit ModRM byte and displacement for [r10 + disp32] with register REG. */
+static void put_r10_disp(emitter_t *e, int reg, long disp)
+{
+  put8(e, 0x80 | ((reg & 7) << 3) | 2);
+  put32(e, (unsigned long)disp);
+}
+
+/* Load integer register REG from [r10 + DISP].  OPCODE is 0x8b for a
+   (32-bit or 64-bit) move, 0x0fbe or 0x0fbf for a sign extension of a byte
+   or a word. */
+static void load_int(emitter_t *e, int wide, int opcode, int reg, long disp)
+{
+  put8(e, 0x41 | (wide ? 0x08 : 0) | (reg >= 8 ? 0x04 : 0));
+  if (opcode > 0xff) put8(e, opcode >> 8);
+  put8(e, opcode & 0xff);
+  put_r10_disp(e, reg, disp);
+}
+
+/* Load SSE register XMM from [r10 + DISP], PREFIX is 0xf2 for a double and
+   0xf3 for a float. */
+static void load_sse(emitter_t *e, int prefix, int xmm, long disp)
+{
+  put8(e, prefix);
+  put8(e, 0x41);
+  put8(e, 0x0f);
+  put8(e, 0x10);
+  put_r10_disp(e, xmm, disp);
+}
+
+static int emit_trampoline(emitter_t *e, void *func, const short *types,
+                           int nargs, size_t slot_size)
+{
+  long disp;
+  int j, type, nint = 0, nsse = 0;
+
+  /* Prologue. */
+  put8(e, 0x53);                              /* push rbx */
+  put8(e, 0x48); put8(e, 0x89); put8(e, 0xf3); /* mov rbx, rsi */
+  put8(e, 0x49); put8(e, 0x89); put8(e, 0xfa); /* mov r10, rdi */
+
+  /* Load the arguments. */
+  for (j = 1; j <= nargs; ++j) {
+    disp = (long)((j - 1)*slot_size);
+    /* Output arguments are passed as pointers. */
+    type = (C_IS_OUT(types[j]) ? C_POINTER : types[j]);
+    switch (type) {
+    case C_CHAR:
+    case C_SHORT:
+    case C_INT:
+    case C_LONG:
+    case C_STRING:
+    case C_POINTER:
+    case C_CHAR_ARRAY:
+    case C_SHORT_ARRAY:
+    case C_INT_ARRAY:
+    case C_LONG_ARRAY:
+    case C_FLOAT_ARRAY:
+    case C_DOUBLE_ARRAY:
+    case C_COMPLEX_ARRAY:
+    case C_STRING_ARRAY:
+    case C_POINTER_ARRAY:
+      if (nint >= MAX_INT_REGS) return FALSE;
+      if (type == C_CHAR) {
+        load_int(e, FALSE, 0x0fbe, int_regs[nint], disp);
+      } else if (type == C_SHORT) {
+        load_int(e, FALSE, 0x0fbf, int_regs[nint], disp);
+      } else if (type == C_INT) {
+        load_int(e, FALSE, 0x8b, int_regs[nint], disp);
+      } else {
+        load_int(e, TRUE, 0x8b, int_regs[nint], disp);
+      }
+      ++nint;
+      break;
+    case C_FLOAT:
+      if (nsse >= MAX_SSE_REGS) return FALSE;
+      load_sse(e, 0xf3, nsse++, disp);
+      break;
+    case C_DOUBLE:
+      if (nsse >= MAX_SSE_REGS) return FALSE;
+      load_sse(e, 0xf2, nsse++, disp);
+      break;
+    case C_COMPLEX:
+      /* Structure of 2 doubles, passed in 2 SSE registers (or in memory if
+         not enough registers are left). */
+      if (nsse + 2 > MAX_SSE_REGS) return FALSE;
+      load_sse(e, 0xf2, nsse++, disp);
+      load_sse(e, 0xf2, nsse++, disp + sizeof(double));
+      break;
+    default:
+      return FALSE;
+    }
+  }
+
+  /* Call the function. */
+  put8(e, 0xb8); put32(e, nsse);               /* mov eax, nsse */
+  put8(e, 0x49); put8(e, 0xbb);                /* mov r11, func */
+  put64(e, (unsigned long)func);
+  put8(e, 0x41); put8(e, 0xff); put8(e, 0xd3); /* call r11 */
+
+  /* Store the result. */
+  switch (types[0]) {
+  case C_VOID:
+    break;
+  case C_CHAR:
+  case C_SHORT:
+  case C_INT:
+  case C_LONG:
+  case C_STRING:
+  case C_CHAR_ARRAY:
+  case C_SHORT_ARRAY:
+  case C_INT_ARRAY:
+  case C_LONG_ARRAY:
+  case C_FLOAT_ARRAY:
+  case C_DOUBLE_ARRAY:
+  case C_COMPLEX_ARRAY:
+    put8(e, 0x48); put8(e, 0x89); put8(e, 0x03); /* mov [rbx], rax */
+    break;
+  case C_FLOAT:
+    put8(e, 0xf3); put8(e, 0x0f); put8(e, 0x11); /* movss [rbx], xmm0 */
+    put8(e, 0x03);
+    break;
+  case C_DOUBLE:
+    put8(e, 0xf2); put8(e, 0x0f); put8(e, 0x11); /* movsd [rbx], xmm0 */
+    put8(e, 0x03);
+    break;
+  case C_COMPLEX:
+    put8(e, 0xf2); put8(e, 0x0f); put8(e, 0x11); /* movsd [rbx], xmm0 */
+    put8(e, 0x03);
+    put8(e, 0xf2); put8(e, 0x0f); put8(e, 0x11); /* movsd [rbx+8], xmm1 */
+    put8(e, 0x4b); put8(e, sizeof(double));
+    break;
+  default:
+    return FALSE;
+  }
+
+  /* Epilogue. */
+  put8(e, 0x5b); /* pop rbx */
+  put8(e, 0xc3); /* ret */
+  return TRUE;
+}
+
+static size_t page_size(void)
+{
+  long size = sysconf(_SC_PAGESIZE);
+  return (size > 0 ? (size_t)size : 4096);
+}
+
+void *ydl_jit_compile(void *func, const short *types, int nargs,
+                      size_t slot_size)
+{
+  unsigned char buf[CODE_SIZE];
+  emitter_t e;
+  size_t size;
+  void *page;
+
+  if (func == NULL || nargs < 0 || nargs > YDL_JIT_MAX_ARGS) {
+    return NULL;
+  }
+  e.code = buf;
+  e.len = 0;
+  if (! emit_trampoline(&e, func, types, nargs, slot_size)) {
+    return NULL;
+  }
+
+  /* Copy the code in its own page which is made executable but no longer
+     writable. */
+  size = ROUND_UP(e.len, page_size());
+  page = mmap(NULL, size, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (page == MAP_FAILED) {
+    return NULL;
+  }
+  memcpy(page, buf, e.len);
+  if (mprotect(page, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(page, size);
+    return NULL;
+  }
+  return page;
+}
+
+void ydl_jit_free(void *code)
+{
+  if (code != NULL) {
+    munmap(code, page_size());
+  }
+}
+
+#else /* JIT not supported */
+
+void *ydl_jit_compile(void *func, const short *types, int nargs,
+                      size_t slot_size)
+{
+  return NULL;
+}
+
+void ydl_jit_free(void *code)
+{
+}
+
+#endif /* USE_JIT */
+
+/*
+ * Local Variables:
+ * mode: C
+ * tab-width: 8
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * fill-column: 79
+ * coding: utf-8
+ * ispell-local-dictionary: "american"
+ * End:
+ */
@@ -26,11 +26,12 @@
 #include <stdio.h>
 #include <string.h>
 #if defined(HAVE_LIBTOOL)
+# define USE_LTDL 1
 # include <ltdl.h>
-#elif defined(HAVE_DLOPEN)
+#endif
+#if defined(HAVE_DLOPEN)
+# define USE_DL 1
 # include <dlfcn.h>
-#else
-# warning no dynamic loader interface defined (perhaps use built-in one?)
 #endif
 #include <pstdlib.h>
 #include "ydlwrap.h"
@@ -48,35 +49,21 @@
 
 #define STATEMENT(code) do { code; } while (0)
 
-/* Definitions to hide the implementation details. */
-#if defined(HAVE_LIBTOOL)
-
-/* Use LIBTOOL */
-static const char *my_variant = "ltdl";
-# define MY_DLSYM(HANDLE,NAME) ((NAME) != NULL ? lt_dlsym(HANDLE,NAME) : NULL)
-# define MY_DLCLOSE(HANDLE)    if ((HANDLE) == NULL) ; else lt_dlclose(HANDLE)
-
-#elif defined(HAVE_DLOPEN)
-
-/* Use DLOPEN */
-static const char *my_variant = "dl";
-# define MY_DLSYM(HANDLE,NAME) ((NAME) != NULL ? dlsym(HANDLE,NAME) : NULL)
-# define MY_DLCLOSE(HANDLE)    if ((HANDLE) == NULL) ; else dlclose(HANDLE)
+/* Loaders.  Every loader available when the plugin is built is compiled in
+   and the loader is chosen for each module (see the LOADER keyword of
+   dlopen).  The loader of Yorick (PLAY) is always available, the default
+   loader is the first available one among LTDL, DL and PLAY. */
+#define LOADER_PLAY 0
+#define LOADER_DL   1
+#define LOADER_LTDL 2
+#define NLOADERS    3
+static const char *loader_names[NLOADERS] = {"play", "dl", "ltdl"};
+#if defined(USE_LTDL)
+# define DEFAULT_LOADER LOADER_LTDL
+#elif defined(USE_DL)
+# define DEFAULT_LOADER LOADER_DL
 #else
-
-/* Use own Yorick implementation in the Portability LAYer */
-static const char *my_variant = "play";
-# define MY_DLSYM(HANDLE,NAME) my_dlsym(HANDLE,NAME)
-# define MY_DLCLOSE(HANDLE)
-static void *my_dlsym(void *handle, const char *symbol)
-{
-  void *addr = NULL;
-  if (symbol == NULL || p_dlsym(handle, symbol, 0, &addr)) {
-    return NULL;
-  }
-  return addr;
-}
-
+# define DEFAULT_LOADER LOADER_PLAY
 #endif
 
 /*-----------------------------------------------------------------------------
@@ -89,6 +76,7 @@ struct _ydl_instance {
   void *handle;
   const char *path;   /* path to dynamic module (can be NULL) */
   unsigned int hints;
+  int loader;         /* loader used to open the module */
 };
 
 static void ydl_free(void *);
@@ -105,11 +93,56 @@ y_userobj_t ydl_class = {
   NULL
 };
 
+static void *my_dlsym(const ydl_instance_t *obj, const char *symbol)
+{
+  void *addr = NULL;
+  if (symbol == NULL || obj->handle == NULL) {
+    return NULL;
+  }
+  switch (obj->loader) {
+#ifdef USE_LTDL
+  case LOADER_LTDL:
+    return lt_dlsym((lt_dlhandle)obj->handle, symbol);
+#endif
+#ifdef USE_DL
+  case LOADER_DL:
+    return dlsym(obj->handle, symbol);
+#endif
+  default:
+    if (p_dlsym(obj->handle, symbol, 0, &addr)) {
+      return NULL;
+    }
+    return addr;
+  }
+}
+
+static void my_dlclose(ydl_instance_t *obj)
+{
+  if (obj->handle == NULL) {
+    return;
+  }
+  switch (obj->loader) {
+#ifdef USE_LTDL
+  case LOADER_LTDL:
+    lt_dlclose((lt_dlhandle)obj->handle);
+    break;
+#endif
+#ifdef USE_DL
+  case LOADER_DL:
+    dlclose(obj->handle);
+    break;
+#endif
+  default:
+    /* Modules loaded by PLAY cannot be unloaded. */
+    break;
+  }
+}
+
 static void ydl_free(void *addr)
 {
   ydl_instance_t *obj = (ydl_instance_t *)addr;
   if (obj->path != NULL) p_free((void *)obj->path);
-  MY_DLCLOSE(obj->handle);
+  my_dlclose(obj);
 }
 
 static void ydl_print(void *addr)
@@ -135,12 +168,14 @@ static void ydl_print(void *addr)
   if (first) {
     y_print("0", 0);
   }
+  y_print(", loader = \"", 0);
+  y_print(loader_names[obj->loader], 0);
   if (obj->path != NULL) {
-    y_print(", path = \"", 0);
+    y_print("\", path = \"", 0);
     y_print(obj->path, 0);
     y_print("\")", 1);
   } else {
-    y_print(", path = NULL)", 1);
+    y_print("\", path = NULL)", 1);
   }
 }
 
@@ -152,7 +187,7 @@ static void ydl_eval(void *addr, int argc)
 
   if (argc != 1) ERROR("bad number of arguments");
   symbol = ygets_q(0);
-  ptr = MY_DLSYM(obj->handle, symbol);
+  ptr = my_dlsym(obj, symbol);
   ypush_long((long)ptr);
 }
 
@@ -167,11 +202,155 @@ static void ydl_extract(void *addr, char *member)
     } else if (strcmp(member, "hints") == 0) {
       ypush_long(obj->hints);
       return;
+    } else if (strcmp(member, "loader") == 0) {
+      long dims = 0;
+      ypush_q(&dims)[0] = p_strcpy(loader_names[obj->loader]);
+      return;
     }
   }
   ERROR("bad member name");
 }
 
+/*-----------------------------------------------------------------------------
+** Loaders
+** =======
+**
+** These functions open the module at OBJ->PATH according to HINTS, set
+** OBJ->HANDLE and OBJ->HINTS and raise an error in case of failure.
+*/
+
+#ifdef USE_LTDL
+static void open_ltdl(ydl_instance_t *obj, unsigned int hints)
+{
+  static int needs_initialization = TRUE;
+  lt_dladvise advise;
+  int destroy_advise = FALSE;
+  const char *msg;
+
+  if (needs_initialization) {
+    if (lt_dlinit() != 0) {
+      y_error("lt_dlinit() failure");
+    }
+    needs_initialization = FALSE;
+  }
+  if ((hints & (YDL_NOW | YDL_LAZY)) == YDL_NOW) {
+    y_error("flag DL_NOW not supported on this implementation");
+    obj->hints = YDL_NOW;
+  } else {
+    /* This is the default for libltdl. */
+    obj->hints = YDL_LAZY;
+  }
+  if (lt_dladvise_init(&advise) != 0) {
+    goto failure;
+  }
+  destroy_advise = TRUE;
+  if ((hints & (YDL_GLOBAL | YDL_LOCAL)) == YDL_GLOBAL) {
+    if (lt_dladvise_global(&advise) != 0) {
+      goto failure;
+    }
+    obj->hints |= YDL_GLOBAL;
+  } else {
+    if (lt_dladvise_local(&advise) != 0) {
+      goto failure;
+    }
+    obj->hints |= YDL_LOCAL;
+  }
+  if ((hints & YDL_RESIDENT) != 0) {
+    if (lt_dladvise_resident(&advise) != 0) {
+      goto failure;
+    }
+    obj->hints |= YDL_RESIDENT;
+  }
+  if ((hints & YDL_EXTENSION) != 0) {
+    if (lt_dladvise_ext(&advise) != 0) {
+      goto failure;
+    }
+    obj->hints |= YDL_EXTENSION;
+  }
+  if ((hints & YDL_PRELOAD) != 0) {
+    if (lt_dladvise_preload(&advise) != 0) {
+      goto failure;
+    }
+    obj->hints |= YDL_PRELOAD;
+  }
+  if ((hints & YDL_DEEPBIND) != 0) {
+    if (destroy_advise) lt_dladvise_destroy(&advise);
+    y_error("flag DL_DEEPBIND not supported on this implementation");
+  }
+  obj->handle = lt_dlopenadvise(obj->path, advise);
+  if (obj->handle == NULL) {
+  failure:
+    msg = lt_dlerror(); /* get message first */
+    if (destroy_advise) lt_dladvise_destroy(&advise);
+    if (msg == NULL) msg = "failed to open dynamic library (unknown reason)";
+    y_error(msg);
+  }
+  if (lt_dladvise_destroy(&advise) != 0) {
+    destroy_advise = FALSE;
+    goto failure;
+  }
+}
+#endif /* USE_LTDL */
+
+#ifdef USE_DL
+static void open_dl(ydl_instance_t *obj, unsigned int hints)
+{
+  const char *msg;
+  int flags;
+
+  if ((hints & (YDL_NOW | YDL_LAZY)) == YDL_NOW) {
+    obj->hints = YDL_NOW;
+    flags = RTLD_NOW;
+  } else {
+    obj->hints = YDL_LAZY;
+    flags = RTLD_LAZY;
+  }
+  if ((hints & (YDL_GLOBAL | YDL_LOCAL)) == YDL_GLOBAL) {
+    obj->hints |= YDL_GLOBAL;
+    flags |= RTLD_GLOBAL;
+  } else {
+    obj->hints |= YDL_LOCAL;
+    flags |= RTLD_LOCAL;
+  }
+  if ((hints & YDL_RESIDENT) != 0) {
+#  ifdef RTLD_NODELETE
+    obj->hints |= YDL_RESIDENT;
+    flags |= RTLD_NODELETE;
+#  else
+    y_error("flag DL_RESIDENT not supported on this implementation");
+#  endif
+  }
+  if ((hints & YDL_DEEPBIND) != 0) {
+#  ifdef RTLD_DEEPBIND
+    obj->hints |=  YDL_DEEPBIND;
+    flags |= RTLD_DEEPBIND;
+#  else
+    y_error("flag DL_DEEPBIND not supported on this implementation");
+#  endif
+  }
+  if ((hints & YDL_EXTENSION) != 0) {
+    y_error("flag DL_REXTENSION not supported on this implementation");
+  }
+  if ((hints & YDL_PRELOAD) != 0) {
+    y_error("flag DL_PRELOAD not supported on this implementation");
+  }
+  obj->handle = dlopen(obj->path, flags);
+  if (obj->handle == NULL) {
+    msg = dlerror();
+    if (msg == NULL) msg = "failed to open dynamic library (unknown reason)";
+    y_error(msg);
+  }
+}
+#endif /* USE_DL */
+
+static void open_play(ydl_instance_t *obj, unsigned int hints)
+{
+  obj->handle = p_dlopen(obj->path);
+  if (obj->handle == NULL) {
+    y_errorq("failed to open dynamic module \"%s\"", obj->path);
+  }
+}
+
 /*-----------------------------------------------------------------------------
 ** Built-in Functions
 ** ==================
@@ -179,26 +358,96 @@ static void ydl_extract(void *addr, char *member)
 
 void Y_dlvariant(int argc)
 {
-  long dims = 0;
-  if (argc != 0 && (argc > 1 || ! yarg_nil(0))) {
-    y_error("expecting a single nil argument");
+  const char *names[NLOADERS > YDL_MAX_BACKENDS ? NLOADERS : YDL_MAX_BACKENDS];
+  const char *what;
+  long dims[2];
+  char **list;
+  int j, n;
+
+  if (argc > 1) y_error("too many arguments");
+  what = (argc == 1 && ! yarg_nil(0) ? ygets_q(0) : NULL);
+  if (what == NULL) {
+    dims[0] = 0;
+    ypush_q(dims)[0] = p_strcpy(loader_names[DEFAULT_LOADER]);
+    return;
+  }
+  if (strcmp(what, "loader") == 0) {
+    /* Available loaders, the default one first. */
+    n = 0;
+    names[n++] = loader_names[DEFAULT_LOADER];
+    for (j = NLOADERS - 1; j >= 0; --j) {
+#ifndef USE_LTDL
+      if (j == LOADER_LTDL) continue;
+#endif
+#ifndef USE_DL
+      if (j == LOADER_DL) continue;
+#endif
+      if (j != DEFAULT_LOADER) names[n++] = loader_names[j];
+    }
+  } else if (strcmp(what, "backend") == 0) {
+    n = ydl_backends(names);
+  } else {
+    y_error("expecting \"loader\" or \"backend\"");
+    return;
+  }
+  dims[0] = 1;
+  dims[1] = n;
+  list = ypush_q(dims);
+  for (j = 0; j < n; ++j) {
+    list[j] = p_strcpy(names[j]);
   }
-  ypush_q(&dims)[0] = p_strcpy(my_variant);
 }
 
 void Y_dlopen(int argc)
 {
+  static long loader_index = -1L;
   ydl_instance_t *obj;
-  const char *msg, *name;
+  const char *name;
   unsigned int hints;
+  int iarg, npos, pos[2], loader;
 
-  if (argc < 1 || argc > 2) ERROR("bad number of arguments");
-  if (yarg_nil(argc - 1)) {
+  if (loader_index < 0L) {
+    loader_index = yget_global("loader", 0);
+  }
+  npos = 0;
+  loader = DEFAULT_LOADER;
+  for (iarg = argc - 1; iarg >= 0; --iarg) {
+    long index = yarg_key(iarg);
+    if (index >= 0L) {
+      --iarg;
+      if (index != loader_index) {
+        y_error("unknown keyword");
+      }
+      if (! yarg_nil(iarg)) {
+        name = ygets_q(iarg);
+        for (loader = NLOADERS - 1; loader >= 0; --loader) {
+          if (name != NULL && strcmp(name, loader_names[loader]) == 0) {
+            break;
+          }
+        }
+#ifndef USE_LTDL
+        if (loader == LOADER_LTDL) loader = -1;
+#endif
+#ifndef USE_DL
+        if (loader == LOADER_DL) loader = -1;
+#endif
+        if (loader < 0) {
+          y_error("unknown or unavailable loader (see dlvariant)");
+        }
+      }
+    } else if (npos < 2) {
+      pos[npos++] = iarg;
+    } else {
+      y_error("bad number of arguments");
+    }
+  }
+  if (npos < 1) ERROR("bad number of arguments");
+  if (yarg_nil(pos[0])) {
     name = NULL;
   } else {
-    name = ygets_q(argc - 1);
+    name = ygets_q(pos[0]);
   }
-  hints = (argc >= 2 ? ygets_i(argc - 2) : 0);
+  hints = (npos >= 2 ? ygets_i(pos[1]) : 0);
   if ((hints & (YDL_NOW | YDL_LAZY)) == 0) {
     hints |= YDL_LAZY;
   } else if ((hints & (YDL_NOW | YDL_LAZY)) == (YDL_NOW | YDL_LAZY)) {
@@ -212,127 +461,21 @@ void Y_dlopen(int argc)
   obj = PUSH_OBJ(ydl_instance_t, ydl_class);
   obj->path = (name != NULL ? p_native(name) : NULL);
   obj->hints = 0;
-#if defined(HAVE_LIBTOOL)
-  {
-    static int needs_initialization = TRUE;
-    lt_dladvise advise;
-    int destroy_advise = FALSE;
-    if (needs_initialization) {
-      if (lt_dlinit() != 0) {
-        y_error("lt_dlinit() failure");
-      }
-      needs_initialization = FALSE;
-    }
-    if ((hints & (YDL_NOW | YDL_LAZY)) == YDL_NOW) {
-      y_error("flag DL_NOW not supported on this implementation");
-      obj->hints = YDL_NOW;
-    } else {
-      /* This is the default for libltdl. */
-      obj->hints = YDL_LAZY;
-    }
-    if (lt_dladvise_init(&advise) != 0) {
-      goto failure;
-    }
-    destroy_advise = TRUE;
-    if ((hints & (YDL_GLOBAL | YDL_LOCAL)) == YDL_GLOBAL) {
-      if (lt_dladvise_global(&advise) != 0) {
-        goto failure;
-      }
-      obj->hints |= YDL_GLOBAL;
-    } else {
-      if (lt_dladvise_local(&advise) != 0) {
-        goto failure;
-      }
-      obj->hints |= YDL_LOCAL;
-    }
-    if ((hints & YDL_RESIDENT) != 0) {
-      if (lt_dladvise_resident(&advise) != 0) {
-        goto failure;
-      }
-      obj->hints |= YDL_RESIDENT;
-    }
-    if ((hints & YDL_EXTENSION) != 0) {
-      if (lt_dladvise_ext(&advise) != 0) {
-        goto failure;
-      }
-      obj->hints |= YDL_EXTENSION;
-    }
-    if ((hints & YDL_PRELOAD) != 0) {
-      if (lt_dladvise_preload(&advise) != 0) {
-        goto failure;
-      }
-      obj->hints |= YDL_PRELOAD;
-    }
-    if ((hints & YDL_DEEPBIND) != 0) {
-      if (destroy_advise) lt_dladvise_destroy(&advise);
-      y_error("flag DL_DEEPBIND not supported on this implementation");
-    }
-    obj->handle = lt_dlopenadvise(obj->path, advise);
-    if (obj->handle == NULL) {
-    failure:
-      msg = lt_dlerror(); /* get message first */
-      if (destroy_advise) lt_dladvise_destroy(&advise);
-      if (msg == NULL) msg = "failed to open dynamic library (unknown reason)";
-      y_error(msg);
-    }
-    if (lt_dladvise_destroy(&advise) != 0) {
-      destroy_advise = FALSE;
-      goto failure;
-    }
-  }
-#elif defined(HAVE_DLOPEN)
-  {
-    int flags;
-    if ((hints & (YDL_NOW | YDL_LAZY)) == YDL_NOW) {
-      obj->hints = YDL_NOW;
-      flags = RTLD_NOW;
-    } else {
-      obj->hints = YDL_LAZY;
-      flags = RTLD_LAZY;
-    }
-    if ((hints & (YDL_GLOBAL | YDL_LOCAL)) == YDL_GLOBAL) {
-      obj->hints |= YDL_GLOBAL;
-      flags |= RTLD_GLOBAL;
-    } else {
-      obj->hints |= YDL_LOCAL;
-      flags |= RTLD_LOCAL;
-    }
-    if ((hints & YDL_RESIDENT) != 0) {
-#    ifdef RTLD_NODELETE
-      obj->hints |= YDL_RESIDENT;
-      flags |= RTLD_NODELETE;
-#    else
-      y_error("flag DL_RESIDENT not supported on this implementation");
-#    endif
-    }
-    if ((hints & YDL_DEEPBIND) != 0) {
-#    ifdef RTLD_DEEPBIND
-      obj->hints |=  YDL_DEEPBIND;
-      flags |= RTLD_DEEPBIND;
-#    else
-      y_error("flag DL_DEEPBIND not supported on this implementation");
-#    endif
-    }
-    if ((hints & YDL_EXTENSION) != 0) {
-      y_error("flag DL_REXTENSION not supported on this implementation");
-    }
-    if ((hints & YDL_PRELOAD) != 0) {
-      y_error("flag DL_PRELOAD not supported on this implementation");
-    }
-    obj->handle = dlopen(obj->path, flags);
-    if (obj->handle == NULL) {
-      msg = dlerror();
-      if (msg == NULL) msg = "failed to open dynamic library (unknown reason)";
-      y_error(msg);
-    }
-  }
-#else
-  obj->handle = p_dlopen(obj->path);
-  if (obj->handle == NULL) {
-    msg = "failed to open dynamic module \"%s\"";
-    y_errorq(msg, obj->path);
-  }
+  obj->loader = loader;
+  switch (loader) {
+#ifdef USE_LTDL
+  case LOADER_LTDL:
+    open_ltdl(obj, hints);
+    break;
 #endif
+#ifdef USE_DL
+  case LOADER_DL:
+    open_dl(obj, hints);
+    break;
+#endif
+  default:
+    open_play(obj, hints);
+  }
 }
 
 void Y_dlsym(int argc)
@@ -344,7 +487,7 @@ void Y_dlsym(int argc)
   if (argc != 2) ERROR("bad number of arguments");
   obj = GET_OBJ(ydl_instance_t, ydl_class, 1);
   symbol = ygets_q(0);
-  ptr = MY_DLSYM(obj->handle, symbol);
+  ptr = my_dlsym(obj, symbol);
   ypush_long((long)ptr);
 }
 
@@ -363,6 +506,12 @@ void *ydl_get(int iarg)
   return yget_obj(iarg, &ydl_class);
 }
 
+void *ydl_handle(int iarg)
+{
+  ydl_instance_t *obj = (ydl_instance_t *)yget_obj(iarg, &ydl_class);
+  return obj->handle;
+}
+
 const char *ydl_path(int iarg)
 {
   ydl_instance_t *obj = (ydl_instance_t *)yget_obj(iarg, &ydl_class);
@@ -378,7 +527,7 @@ unsigned int ydl_hints(int iarg)
 void *ydl_find(int iarg, const char *symbol)
 {
   ydl_instance_t *obj = yget_obj(iarg, &ydl_class);
-  return MY_DLSYM(obj->handle, symbol);
+  return my_dlsym(obj, symbol);
 }
 
 /*
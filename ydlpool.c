@@ -0,0 +1,369 @@
+/*
+ * ydlpool.c --
+ *
+ * Pool of worker threads for executing tasks split in chunks and background
+ * threads for asynchronous jobs.
+ *
+ *-----------------------------------------------------------------------------
+ *
+ * Copyright (C) 2011-2015: Éric Thiébaut <https://github.com/emmt>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "ydlwrap.h"
+
+#if defined(HAVE_PTHREAD)
+# define USE_THREADS 1
+# include <pthread.h>
+# include <signal.h>
+#endif
+
+#define DEFAULT_CHUNK 65536L
+
+/*
+ * The pool is owned by the plugin and persists between calls.  Worker
+ * threads are only started when a task is run in parallel for the first
+ * time (or after the number of threads has been changed).  The main thread
+ * takes part in the execution of the task as worker number 0.  Chunks of
+ * the task are distributed dynamically: each worker repeatedly takes the
+ * next available chunk until there are none left.
+ *
+ * Workers only execute the task function.  It is the responsibility of the
+ * caller to make sure that the task does not touch Yorick's stack (nor call
+ * any function which may raise a Yorick error).
+ */
+
+static int nthreads = 0; /* number of threads (including the main one) */
+static long chunk = DEFAULT_CHUNK;
+
+#ifdef USE_THREADS
+
+static struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t start;   /* signaled when a new task is available */
+  pthread_cond_t done;    /* signaled when last worker has finished */
+  pthread_t *threads;     /* worker threads */
+  int nworkers;           /* number of started worker threads */
+  int active;             /* number of workers busy with the current task */
+  int quit;               /* workers must terminate */
+  unsigned long serial;   /* incremented for each new task */
+  unsigned long base;     /* value of serial when workers were started */
+  ydl_task_t *task;       /* current task */
+  void *data;             /* task data */
+  long number;            /* total number of elements of the task */
+  long chunk;             /* size of chunks */
+  long next;              /* first element of next chunk */
+} pool = {
+  PTHREAD_MUTEX_INITIALIZER,
+  PTHREAD_COND_INITIALIZER,
+  PTHREAD_COND_INITIALIZER,
+  NULL, 0, 0, 0, 0, 0, NULL, NULL, 0, 0, 0
+};
+
+/* Execute chunks of current task until there are no more.  Must be called
+   with the mutex locked. */
+static void run_chunks(int worker)
+{
+  long i0, i1;
+
+  while (pool.next < pool.number) {
+    i0 = pool.next;
+    i1 = (pool.number - i0 > pool.chunk ? i0 + pool.chunk : pool.number);
+    pool.next = i1;
+    pthread_mutex_unlock(&pool.mutex);
+    pool.task(pool.data, i0, i1, worker);
+    pthread_mutex_lock(&pool.mutex);
+  }
+}
+
+static void *worker_main(void *arg)
+{
+  unsigned long serial;
+  int worker = (int)(long)arg;
+
+  pthread_mutex_lock(&pool.mutex);
+  serial = pool.base;
+  for (;;) {
+    while (pool.serial == serial && ! pool.quit) {
+      pthread_cond_wait(&pool.start, &pool.mutex);
+    }
+    if (pool.quit) {
+      break;
+    }
+    serial = pool.serial;
+    run_chunks(worker);
+    if (--pool.active == 0) {
+      pthread_cond_signal(&pool.done);
+    }
+  }
+  pthread_mutex_unlock(&pool.mutex);
+  return NULL;
+}
+
+static void stop_workers(void)
+{
+  int k;
+
+  if (pool.nworkers > 0) {
+    pthread_mutex_lock(&pool.mutex);
+    pool.quit = TRUE;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.mutex);
+    for (k = 0; k < pool.nworkers; ++k) {
+      pthread_join(pool.threads[k], NULL);
+    }
+    pool.nworkers = 0;
+    pool.quit = FALSE;
+  }
+  if (pool.threads != NULL) {
+    free(pool.threads);
+    pool.threads = NULL;
+  }
+}
+
+/* Start the worker threads, return the number of threads (including the
+   main one) which can be used. */
+static int start_workers(int number)
+{
+  sigset_t all, old;
+  int k;
+
+  if (pool.nworkers == number - 1) {
+    return number;
+  }
+  stop_workers();
+  pool.threads = (pthread_t *)malloc((number - 1)*sizeof(pthread_t));
+  if (pool.threads == NULL) {
+    return 1;
+  }
+
+  pool.base = pool.serial;
+
+  /* Signals are blocked in the worker threads so that they are delivered to
+     the main thread (where Yorick handles them). */
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  for (k = 1; k < number; ++k) {
+    if (pthread_create(&pool.threads[k - 1], NULL, worker_main,
+                       (void *)(long)k) != 0) {
+      break;
+    }
+    pool.nworkers = k;
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  return pool.nworkers + 1;
+}
+
+#endif /* USE_THREADS */
+
+int ydl_pool_get_threads(void)
+{
+  if (nthreads <= 0) {
+#if defined(USE_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = (ncpus > 1 ? (int)ncpus : 1);
+#else
+    nthreads = 1;
+#endif
+  }
+  return nthreads;
+}
+
+long ydl_pool_get_chunk(void)
+{
+  return chunk;
+}
+
+void ydl_pool_configure(int number, long size)
+{
+  if (number > 0) {
+#ifdef USE_THREADS
+    if (number > YDL_POOL_MAX_THREADS) number = YDL_POOL_MAX_THREADS;
+    if (number != nthreads) {
+      stop_workers();
+    }
+    nthreads = number;
+#else
+    nthreads = 1;
+#endif
+  }
+  if (size > 0) {
+    chunk = size;
+  }
+}
+
+void ydl_pool_run(ydl_task_t *task, void *data, long number)
+{
+#ifdef USE_THREADS
+  int count = ydl_pool_get_threads();
+
+  if (count > 1 && number > chunk) {
+    count = start_workers(count);
+  }
+  if (count > 1 && number > chunk) {
+    pthread_mutex_lock(&pool.mutex);
+    pool.task = task;
+    pool.data = data;
+    pool.number = number;
+    pool.chunk = chunk;
+    pool.next = 0;
+    pool.active = pool.nworkers;
+    ++pool.serial;
+    pthread_cond_broadcast(&pool.start);
+    run_chunks(0);
+    while (pool.active > 0) {
+      pthread_cond_wait(&pool.done, &pool.mutex);
+    }
+    pool.task = NULL;
+    pool.data = NULL;
+    pthread_mutex_unlock(&pool.mutex);
+    return;
+  }
+#endif /* USE_THREADS */
+  if (number > 0) {
+    task(data, 0, number, 0);
+  }
+}
+
+/*
+ * Asynchronous jobs are not run by the pool: each job has its own thread so
+ * that several long jobs can run at the same time without delaying the tasks
+ * of the pool.  The thread is joined by ydl_job_wait.
+ */
+
+#ifdef USE_THREADS
+
+struct _ydl_job {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  ydl_job_func_t *func;
+  void *data;
+  int done;
+};
+
+static void *job_main(void *arg)
+{
+  ydl_job_t *job = (ydl_job_t *)arg;
+
+  job->func(job->data);
+  pthread_mutex_lock(&job->mutex);
+  job->done = TRUE;
+  pthread_mutex_unlock(&job->mutex);
+  return NULL;
+}
+
+ydl_job_t *ydl_job_start(ydl_job_func_t *func, void *data)
+{
+  sigset_t all, old;
+  ydl_job_t *job;
+  int status;
+
+  job = (ydl_job_t *)malloc(sizeof(ydl_job_t));
+  if (job == NULL) {
+    return NULL;
+  }
+  job->func = func;
+  job->data = data;
+  job->done = FALSE;
+  pthread_mutex_init(&job->mutex, NULL);
+
+  /* Signals are blocked in the thread (see start_workers). */
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  status = pthread_create(&job->thread, NULL, job_main, job);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (status != 0) {
+    pthread_mutex_destroy(&job->mutex);
+    free(job);
+    return NULL;
+  }
+  return job;
+}
+
+int ydl_job_done(ydl_job_t *job)
+{
+  int done;
+
+  pthread_mutex_lock(&job->mutex);
+  done = job->done;
+  pthread_mutex_unlock(&job->mutex);
+  return done;
+}
+
+void ydl_job_wait(ydl_job_t *job)
+{
+  pthread_join(job->thread, NULL);
+  pthread_mutex_destroy(&job->mutex);
+  free(job);
+}
+
+static pthread_t main_thread;
+static int main_thread_set = FALSE;
+
+void ydl_set_main_thread(void)
+{
+  if (! main_thread_set) {
+    main_thread = pthread_self();
+    main_thread_set = TRUE;
+  }
+}
+
+int ydl_is_main_thread(void)
+{
+  return (! main_thread_set || pthread_equal(pthread_self(), main_thread));
+}
+
+#else /* threads not supported */
+
+ydl_job_t *ydl_job_start(ydl_job_func_t *func, void *data)
+{
+  return NULL;
+}
+
+int ydl_job_done(ydl_job_t *job)
+{
+  return TRUE;
+}
+
+void ydl_job_wait(ydl_job_t *job)
+{
+}
+
+void ydl_set_main_thread(void)
+{
+}
+
+int ydl_is_main_thread(void)
+{
+  return TRUE;
+}
+
+#endif /* USE_THREADS */
+
+/*
+ * Local Variables:
+ * mode: C
+ * tab-width: 8
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * fill-column: 79
+ * coding: utf-8
+ * ispell-local-dictionary: "american"
+ * End:
+ */
@@ -0,0 +1,204 @@
+/*
+ * ydlstruct.c --
+ *
+ * Layout of Yorick structures passed by value to wrapped functions and calls
+ * of interpreted functions from compiled code.
+ *
+ *-----------------------------------------------------------------------------
+ *
+ * Copyright (C) 2011-2015: Éric Thiébaut <https://github.com/emmt>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#include <string.h>
+#include <ydata.h>
+#include <pstdlib.h>
+#include "ydlwrap.h"
+
+/*
+ * The public API of Yorick (yapi.h) provides no means to inspect a structure
+ * definition nor to create an instance of a structure, nor to call an
+ * interpreted function without parsing some code.  This file is the only one
+ * of the plugin which uses Yorick internals (ydata.h) for that.
+ *
+ * The members of a structure are flattened: a member which is an array of N
+ * elements yields N consecutive fields and the members of a nested structure
+ * are inserted in place.  This is sufficient to classify the structure for
+ * the calling conventions (which only depend on the types of the scalar
+ * fields and their offsets) as far as the layout follows the usual C rules,
+ * which is checked.
+ */
+
+typedef struct _scanner scanner_t;
+struct _scanner {
+  ydl_struct_t *s; /* NULL to only count and check the fields */
+  long count;      /* number of fields so far */
+  long end;        /* end of the last field so far */
+  long alignment;  /* largest alignment of the fields so far */
+  int pointers;    /* some fields are pointers or strings */
+};
+
+/* Get the data block at position IARG in the stack, NULL if none. */
+static DataBlock *get_block(int iarg)
+{
+  Symbol *s = sp - iarg;
+  if (s->ops == &referenceSym) ReplaceRef(s);
+  return (s->ops == &dataBlockSym ? s->value.db : NULL);
+}
+
+/* Yield the C type of a basic Yorick type, -1 if BASE is not a basic type. */
+static int scalar_type(const StructDef *base)
+{
+  if (base == &charStruct)    return C_CHAR;
+  if (base == &shortStruct)   return C_SHORT;
+  if (base == &intStruct)     return C_INT;
+  if (base == &longStruct)    return C_LONG;
+  if (base == &floatStruct)   return C_FLOAT;
+  if (base == &doubleStruct)  return C_DOUBLE;
+  if (base == &complexStruct) return C_COMPLEX;
+  if (base == &stringStruct)  return C_STRING;
+  if (base == &pointerStruct) return C_POINTER;
+  return -1;
+}
+
+static void scan_fields(scanner_t *sc, const StructDef *base, long offset)
+{
+  const StructDef *type;
+  long j, k, number, address;
+  int c_type;
+
+  for (j = 0; j < base->table.nItems; ++j) {
+    type = base->members[j].base;
+    number = base->members[j].number;
+    c_type = scalar_type(type);
+    for (k = 0; k < number; ++k) {
+      address = offset + base->offsets[j] + k*type->size;
+      if (c_type < 0) {
+        scan_fields(sc, type, address);
+        continue;
+      }
+      if (address != ROUND_UP(sc->end, type->alignment)) {
+        y_error("structure layout does not follow the C rules");
+      }
+      if (sc->s != NULL) {
+        sc->s->fields[sc->count].offset = address;
+        sc->s->fields[sc->count].type = c_type;
+      }
+      if (c_type == C_STRING || c_type == C_POINTER) {
+        sc->pointers = TRUE;
+      }
+      if (type->alignment > sc->alignment) {
+        sc->alignment = type->alignment;
+      }
+      sc->end = address + type->size;
+      ++sc->count;
+    }
+  }
+}
+
+ydl_struct_t *ydl_struct_new(int iarg)
+{
+  DataBlock *db = get_block(iarg);
+  StructDef *base;
+  scanner_t sc;
+  ydl_struct_t *s;
+
+  if (db == NULL || db->ops != &structDefOps) {
+    y_error("expecting a structure definition");
+  }
+  base = (StructDef *)db;
+  if (base->file != NULL) {
+    y_error("structure definition must be the in-memory one");
+  }
+
+  /* First pass to count and check the fields (nothing is allocated so that
+     errors do not leak memory), second pass to store them. */
+  memset(&sc, 0, sizeof(sc));
+  sc.alignment = 1;
+  scan_fields(&sc, base, 0);
+  if (sc.count < 1) {
+    y_error("structure has no members");
+  }
+  if (ROUND_UP(sc.end, sc.alignment) != base->size) {
+    y_error("structure layout does not follow the C rules");
+  }
+  s = (ydl_struct_t *)p_malloc(OFFSET_OF(ydl_struct_t, fields)
+                               + sc.count*sizeof(ydl_field_t));
+  memset(s, 0, OFFSET_OF(ydl_struct_t, fields));
+  sc.s = s;
+  sc.count = 0;
+  sc.end = 0;
+  scan_fields(&sc, base, 0);
+  s->use = yget_use(iarg);
+  s->base = base;
+  s->size = base->size;
+  s->alignment = sc.alignment;
+  s->pointers = sc.pointers;
+  s->nfields = (int)sc.count;
+  return s;
+}
+
+void ydl_struct_free(ydl_struct_t *s)
+{
+  if (s != NULL) {
+    if (s->use != NULL) ydrop_use(s->use);
+    if (s->extra != NULL) p_free(s->extra);
+    p_free(s);
+  }
+}
+
+void *ydl_struct_data(int iarg, const ydl_struct_t *s)
+{
+  Array *array;
+
+  if (yarg_typeid(iarg) == Y_STRUCT && yarg_rank(iarg) == 0) {
+    array = (Array *)get_block(iarg);
+    if (array != NULL && (void *)array->type.base == s->base) {
+      return array->value.c;
+    }
+  }
+  y_error("expecting a scalar instance of the structure");
+  return NULL;
+}
+
+void *ydl_struct_push(const ydl_struct_t *s)
+{
+  Array *array = NewArray((StructDef *)s->base, (Dimension *)0);
+  PushDataBlock(array);
+  return array->value.c;
+}
+
+void ydl_run_global(long index)
+{
+  Symbol *s = &globTab[index];
+  if (s->ops != &dataBlockSym || s->value.db->ops != &functionOps) {
+    y_error("expecting an interpreted function");
+  }
+  RunTaskNow((Function *)s->value.db);
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * tab-width: 8
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * fill-column: 79
+ * coding: utf-8
+ * ispell-local-dictionary: "american"
+ * End:
+ */
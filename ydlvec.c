@@ -0,0 +1,267 @@
+/*
+ * ydlvec.c --
+ *
+ * Vector variants of elementwise functions (x86-64 vector function ABI as
+ * implemented by glibc libmvec).
+ *
+ *-----------------------------------------------------------------------------
+ *
+ * Copyright (C) 2011-2015: Éric Thiébaut <https://github.com/emmt>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "ydlwrap.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && ! defined(YDL_NO_MVEC)
+# define USE_MVEC 1
+# if defined(__linux__)
+#  include <dlfcn.h>
+#  define LIBMVEC "libmvec.so.1"
+# endif
+#endif
+
+#ifdef USE_MVEC
+
+/*
+ * The vector variant of function FOO is named "_ZGV<isa>N<lanes><args>_FOO"
+ * where <isa> is 'b' (SSE, 128-bit registers), 'c' (AVX, 256-bit), 'd'
+ * (AVX2, 256-bit) or 'e' (AVX-512, 512-bit), <lanes> is the number of
+ * elements per register and <args> is 'v' repeated for each argument.  Vector
+ * arguments and results are passed in registers by value, so the loops
+ * calling these functions are compiled for the corresponding instruction
+ * set.
+ */
+
+typedef double v2d __attribute__((vector_size(16)));
+typedef double v4d __attribute__((vector_size(32)));
+typedef double v8d __attribute__((vector_size(64)));
+typedef float  v4f __attribute__((vector_size(16)));
+typedef float  v8f __attribute__((vector_size(32)));
+typedef float  v16f __attribute__((vector_size(64)));
+
+/* Define loops for a given instruction set: NAME is the suffix of the loop
+   functions, T the type of the elements, V the vector type, L the number of
+   lanes and TARGET the attribute of the functions. */
+#define DEFINE_LOOPS(NAME, T, V, L, TARGET)                             \
+  TARGET static void loop1_##NAME(void *func, long n, T *y,             \
+                                  const T *x, long sx)                  \
+  {                                                                     \
+    V (*f)(V) = (V (*)(V))func;                                         \
+    V a, r;                                                             \
+    T buf[L];                                                           \
+    long i;                                                             \
+    int k;                                                              \
+    for (i = 0; i < n; i += L) {                                        \
+      if (sx == 1) {                                                    \
+        memcpy(&a, x + i, sizeof(a));                                   \
+      } else {                                                          \
+        for (k = 0; k < L; ++k) buf[k] = x[(i + k)*sx];                 \
+        memcpy(&a, buf, sizeof(a));                                     \
+      }                                                                 \
+      r = f(a);                                                         \
+      memcpy(y + i, &r, sizeof(r));                                     \
+    }                                                                   \
+  }                                                                     \
+  TARGET static void loop2_##NAME(void *func, long n, T *y,             \
+                                  const T *x1, long s1,                 \
+                                  const T *x2, long s2)                 \
+  {                                                                     \
+    V (*f)(V, V) = (V (*)(V, V))func;                                   \
+    V a, b, r;                                                          \
+    T buf[L];                                                           \
+    long i;                                                             \
+    int k;                                                              \
+    for (i = 0; i < n; i += L) {                                        \
+      for (k = 0; k < L; ++k) buf[k] = x1[(i + k)*s1];                  \
+      memcpy(&a, buf, sizeof(a));                                       \
+      for (k = 0; k < L; ++k) buf[k] = x2[(i + k)*s2];                  \
+      memcpy(&b, buf, sizeof(b));                                       \
+      r = f(a, b);                                                      \
+      memcpy(y + i, &r, sizeof(r));                                     \
+    }                                                                   \
+  }
+
+DEFINE_LOOPS(b_d, double, v2d, 2, )
+DEFINE_LOOPS(b_f, float, v4f, 4, )
+DEFINE_LOOPS(c_d, double, v4d, 4, __attribute__((target("avx"))))
+DEFINE_LOOPS(c_f, float, v8f, 8, __attribute__((target("avx"))))
+DEFINE_LOOPS(d_d, double, v4d, 4, __attribute__((target("avx2"))))
+DEFINE_LOOPS(d_f, float, v8f, 8, __attribute__((target("avx2"))))
+DEFINE_LOOPS(e_d, double, v8d, 8, __attribute__((target("avx512f"))))
+DEFINE_LOOPS(e_f, float, v16f, 16, __attribute__((target("avx512f"))))
+
+#undef DEFINE_LOOPS
+
+/* Instruction sets in order of preference and their register size (in
+   bytes). */
+static const struct {
+  int isa;
+  int size;
+} isa_table[] = {
+  {'e', 64},
+  {'d', 32},
+  {'c', 32},
+  {'b', 16},
+};
+#define NISAS ((int)(sizeof(isa_table)/sizeof(isa_table[0])))
+
+static int isa_supported(int isa)
+{
+  __builtin_cpu_init();
+  switch (isa) {
+  case 'b': return TRUE; /* SSE2 is part of x86-64 */
+  case 'c': return __builtin_cpu_supports("avx");
+  case 'd': return __builtin_cpu_supports("avx2");
+  case 'e': return __builtin_cpu_supports("avx512f");
+  default:  return FALSE;
+  }
+}
+
+#ifdef LIBMVEC
+/* Find symbol NAME in libmvec (or in the libraries it depends on) which is
+   opened the first time (the handle is never closed). */
+static void *libmvec_find(const char *name)
+{
+  static void *handle = NULL;
+  static int opened = FALSE;
+
+  if (! opened) {
+    opened = TRUE;
+    handle = dlopen(LIBMVEC, RTLD_LAZY | RTLD_LOCAL);
+  }
+  return (handle != NULL ? dlsym(handle, name) : NULL);
+}
+#endif /* LIBMVEC */
+
+int ydl_vec_find(int iarg, const char *symbol, void *func, int type,
+                 int nargs, ydl_vector_t *vec)
+{
+  char name[128];
+  int j, lanes;
+#ifdef LIBMVEC
+  int libm;
+#endif
+
+  memset(vec, 0, sizeof(*vec));
+  if ((type != C_DOUBLE && type != C_FLOAT) || nargs < 1 || nargs > 2
+      || strlen(symbol) > sizeof(name) - 16) {
+    return FALSE;
+  }
+#ifdef LIBMVEC
+  /* The variants of libmvec are only valid for the functions of libm (which
+     libmvec depends on), not for other functions with the same name. */
+  libm = (func != NULL && libmvec_find(symbol) == func);
+#endif
+  for (j = 0; j < NISAS; ++j) {
+    if (! isa_supported(isa_table[j].isa)) continue;
+    lanes = isa_table[j].size/(type == C_DOUBLE ? sizeof(double)
+                               : sizeof(float));
+    sprintf(name, "_ZGV%cN%d%s_%s", isa_table[j].isa, lanes,
+            (nargs == 1 ? "v" : "vv"), symbol);
+    vec->func = ydl_find(iarg, name);
+#ifdef LIBMVEC
+    /* The variants of the mathematical functions are provided by libmvec
+       which is not loaded by the module of the scalar function. */
+    if (vec->func == NULL && libm) {
+      vec->func = libmvec_find(name);
+    }
+#endif
+    if (vec->func != NULL) {
+      vec->isa = isa_table[j].isa;
+      vec->lanes = lanes;
+      vec->type = type;
+      vec->nargs = nargs;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+long ydl_vec_apply(const ydl_vector_t *vec, long n, void *dst,
+                   const void *x1, long s1, const void *x2, long s2)
+{
+  if (vec->func == NULL || vec->lanes < 1) {
+    return 0;
+  }
+  n -= n%vec->lanes;
+  if (n <= 0) {
+    return 0;
+  }
+
+#define CASE(ISA, SFX, T)                                                \
+  case ISA:                                                             \
+    if (vec->nargs == 1) {                                              \
+      loop1_##SFX(vec->func, n, (T *)dst, (const T *)x1, s1);           \
+    } else {                                                            \
+      loop2_##SFX(vec->func, n, (T *)dst, (const T *)x1, s1,            \
+                  (const T *)x2, s2);                                   \
+    }                                                                   \
+    break
+
+  if (vec->type == C_DOUBLE) {
+    switch (vec->isa) {
+      CASE('b', b_d, double);
+      CASE('c', c_d, double);
+      CASE('d', d_d, double);
+      CASE('e', e_d, double);
+    default:
+      return 0;
+    }
+  } else {
+    switch (vec->isa) {
+      CASE('b', b_f, float);
+      CASE('c', c_f, float);
+      CASE('d', d_f, float);
+      CASE('e', e_f, float);
+    default:
+      return 0;
+    }
+  }
+#undef CASE
+  return n;
+}
+
+#else /* vector variants not supported */
+
+int ydl_vec_find(int iarg, const char *symbol, void *func, int type,
+                 int nargs, ydl_vector_t *vec)
+{
+  memset(vec, 0, sizeof(*vec));
+  return FALSE;
+}
+
+long ydl_vec_apply(const ydl_vector_t *vec, long n, void *dst,
+                   const void *x1, long s1, const void *x2, long s2)
+{
+  return 0;
+}
+
+#endif /* USE_MVEC */
+
+/*
+ * Local Variables:
+ * mode: C
+ * tab-width: 8
+ * c-basic-offset: 2
+ * indent-tabs-mode: nil
+ * fill-column: 79
+ * coding: utf-8
+ * ispell-local-dictionary: "american"
+ * End:
+ */
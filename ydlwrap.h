@@ -26,6 +26,7 @@
 #ifndef _YDLWRAP_H
 #define _YDLWRAP_H 1
 
+#include <stddef.h>
 #include <yapi.h>
 
 /*---------------------------------------------------------------------------*/
@@ -53,6 +54,14 @@
 #define Y_STRING_ARRAY     ARRAY_OF(Y_STRING)
 #define Y_POINTER_ARRAY    ARRAY_OF(Y_POINTER)
 
+/* Bits 6 and 7 of Yorick type constants are used to mark output arguments:
+   the argument is a variable set with a scalar of this type on return, the
+   called function takes a pointer to the corresponding C type.  Bit 7 is
+   also set for input/output arguments (the variable is then read before the
+   call). */
+#define OUT_FLAG           (1 << (ARRAY_BIT + 1))
+#define INOUT_FLAG         (3 << (ARRAY_BIT + 1))
+
 /* Constants (from 0 to C_NTYPES - 1 with no voids) to identify
    supported C types in tables or argument lists. */
 #define C_VOID              0
@@ -74,7 +83,29 @@
 #define C_COMPLEX_ARRAY    16
 #define C_STRING_ARRAY     17
 #define C_POINTER_ARRAY    18 /* void** */
-#define C_NTYPES           19 /* must be the last one + 1 */
+#define C_CHAR_OUT         19 /* char* set on return */
+#define C_SHORT_OUT        20
+#define C_INT_OUT          21
+#define C_LONG_OUT         22
+#define C_FLOAT_OUT        23
+#define C_DOUBLE_OUT       24
+#define C_COMPLEX_OUT      25
+#define C_CHAR_INOUT       26 /* char* read before and set after the call */
+#define C_SHORT_INOUT      27
+#define C_INT_INOUT        28
+#define C_LONG_INOUT       29
+#define C_FLOAT_INOUT      30
+#define C_DOUBLE_INOUT     31
+#define C_COMPLEX_INOUT    32
+#define C_STRUCT           33 /* structure passed by value */
+#define C_NTYPES           34 /* must be the last one + 1 */
+
+/* Check whether a C type is for an output (or input/output) argument and get
+   the type of the value pointed by such an argument. */
+#define C_IS_OUT(type)     ((type) >= C_CHAR_OUT && (type) <= C_COMPLEX_INOUT)
+#define C_IS_INOUT(type)   ((type) >= C_CHAR_INOUT && (type) <= C_COMPLEX_INOUT)
+#define C_TARGET_OF(type)  ((type) - (C_IS_INOUT(type) ? C_CHAR_INOUT \
+                                      : C_CHAR_OUT) + C_CHAR)
 
 
 #define C_VOID_PTR  C_POINTER
@@ -129,6 +160,11 @@ extern void *ydl_get(int iarg);
    error is raised if object at IARG is not a dynamic module object. */
 extern void *ydl_find(int iarg, const char *symbol);
 
+/* ydl_handle returns the handle given by the loader to the dynamic module
+   object at position IARG in the stack.  An error is raised if object at
+   IARG is not a dynamic module object. */
+extern void *ydl_handle(int iarg);
+
 /* ydl_path returns the name of the dynamic module file of object at position
    IARG in the stack.  An error is raised if object at IARG is not a dynamic
    module object. */
@@ -139,6 +175,193 @@ extern unsigned int ydl_hints(int iarg);
    position IARG in the stack.  An error is raised if object at IARG is not a
    dynamic module object. */
 
+/* ydl_backends stores in NAMES the names of the call engines compiled in
+   the plugin (the default one first) and returns their number.  NAMES must
+   have room for YDL_MAX_BACKENDS names. */
+#define YDL_MAX_BACKENDS 2
+extern int ydl_backends(const char *names[]);
+
+/*---------------------------------------------------------------------------*/
+/* Wrapped functions
+** =================
+*/
+
+/* ydl_wrap does the job of dlwrap: the ARGC elements on top of the stack are
+   the arguments of dlwrap (the dynamic module, the return type, the symbol
+   name, the argument types and the keywords) and the wrapper is pushed on
+   top of the stack.  LAZY is the default for keyword LAZY. */
+extern void ydl_wrap(int argc, int lazy);
+
+/*---------------------------------------------------------------------------*/
+/* Structures passed by value
+** ==========================
+*/
+
+/* A scalar field of a structure.  Members which are arrays or structures
+   are flattened into consecutive fields. */
+typedef struct _ydl_field ydl_field_t;
+struct _ydl_field {
+  long offset; /* offset of the field (in bytes) */
+  int  type;   /* C type of the field: C_CHAR, ..., C_COMPLEX, C_STRING or
+                  C_POINTER */
+};
+
+/* Layout of a Yorick structure. */
+typedef struct _ydl_struct ydl_struct_t;
+struct _ydl_struct {
+  void *use;      /* reference on the structure definition */
+  void *base;     /* address of the structure definition */
+  void *extra;    /* NULL or data needed by the caller (e.g., a description
+                     for the call interface), freed by ydl_struct_free() with
+                     p_free() */
+  long size;      /* size of the structure (in bytes) */
+  long alignment; /* alignment of the structure (in bytes) */
+  int  pointers;  /* the structure has string or pointer fields */
+  int  nfields;   /* number of fields */
+  ydl_field_t fields[1];
+};
+
+/* ydl_struct_new computes the layout of the structure definition at position
+   IARG in the stack.  An error is raised if IARG is not a structure
+   definition or if the layout of the structure does not follow the C rules.
+   The returned layout keeps a reference on the structure definition, it must
+   be released by ydl_struct_free. */
+extern ydl_struct_t *ydl_struct_new(int iarg);
+
+/* ydl_struct_free releases the resources of a structure layout (nothing is
+   done if S is NULL). */
+extern void ydl_struct_free(ydl_struct_t *s);
+
+/* ydl_struct_data returns the address of the data of the scalar instance of
+   structure S at position IARG in the stack.  An error is raised if IARG is
+   not a scalar instance of this very structure. */
+extern void *ydl_struct_data(int iarg, const ydl_struct_t *s);
+
+/* ydl_struct_push pushes a new scalar instance of structure S on top of the
+   stack and returns the address of its data. */
+extern void *ydl_struct_push(const ydl_struct_t *s);
+
+/* ydl_run_global runs the interpreted function (without arguments) stored
+   in the global variable of index INDEX.  The function is run immediately,
+   not after the current built-in function returns. */
+extern void ydl_run_global(long index);
+
+/*---------------------------------------------------------------------------*/
+/* Native trampolines
+** ==================
+*/
+
+/* Maximum number of arguments of a native trampoline. */
+#define YDL_JIT_MAX_ARGS 14
+
+/* Signature of a native trampoline: ARGV is the address of the argument
+   slots, RESULT is the address of the slot to store the result. */
+typedef void ydl_trampoline_t(const void *argv, void *result);
+
+/* ydl_jit_compile generates a native trampoline to call function FUNC.
+   TYPES gives the C type identifiers (C_VOID, C_CHAR, etc.) of the result
+   and of the NARGS arguments (hence TYPES has NARGS + 1 elements).  The
+   values of the arguments are stored in consecutive slots of SLOT_SIZE
+   bytes.  The address of the executable code is returned; NULL is returned
+   if the signature is not supported or if native trampolines are not
+   available on this machine. */
+extern void *ydl_jit_compile(void *func, const short *types, int nargs,
+                             size_t slot_size);
+
+/* ydl_jit_free releases the resources of a native trampoline. */
+extern void ydl_jit_free(void *code);
+
+/*---------------------------------------------------------------------------*/
+/* Vector variants
+** ===============
+*/
+
+/* Description of the vector variant of an elementwise function. */
+typedef struct _ydl_vector ydl_vector_t;
+struct _ydl_vector {
+  void *func; /* address of the vector function, NULL if none */
+  int isa;    /* instruction set: 'b', 'c', 'd' or 'e' */
+  int lanes;  /* number of elements processed per call */
+  int type;   /* type of arguments and result: C_FLOAT or C_DOUBLE */
+  int nargs;  /* number of arguments: 1 or 2 */
+};
+
+/* ydl_vec_find looks in the dynamic module object at position IARG in the
+   stack for the best vector variant (among those supported by the running
+   CPU) of function SYMBOL, at address FUNC, whose NARGS arguments and result
+   are all of type TYPE (C_FLOAT or C_DOUBLE).  The vector variants follow
+   the x86-64 vector function ABI (e.g., "_ZGVdN4v_sin" for the AVX2 variant
+   of "sin"), which is implemented by glibc libmvec; the variants of libmvec
+   are only used if FUNC is the function of the C library.  The result is
+   stored in VEC and TRUE or FALSE is returned depending whether a vector
+   variant was found. */
+extern int ydl_vec_find(int iarg, const char *symbol, void *func, int type,
+                        int nargs, ydl_vector_t *vec);
+
+/* ydl_vec_apply applies the vector function VEC to the N first elements
+   (rounded down to a multiple of the number of lanes) of X1 (and X2 if the
+   function has 2 arguments) and stores the results in DST.  The arguments
+   are taken every S1 (and S2) elements.  The number of processed elements
+   is returned, the remaining ones must be processed by the scalar
+   function. */
+extern long ydl_vec_apply(const ydl_vector_t *vec, long n, void *dst,
+                          const void *x1, long s1, const void *x2, long s2);
+
+/*---------------------------------------------------------------------------*/
+/* Pool of worker threads
+** ======================
+*/
+
+/* Maximum number of threads of the pool. */
+#define YDL_POOL_MAX_THREADS 256
+
+/* Signature of a task executed by the pool: DATA is the task data, the
+   elements of indices in the range [I0,I1) must be processed and WORKER is
+   the index (0 for the main thread) of the thread running the chunk.  A task
+   executed by the pool must not touch Yorick's stack. */
+typedef void ydl_task_t(void *data, long i0, long i1, int worker);
+
+/* ydl_pool_run executes task TASK for NUMBER elements split in chunks which
+   are distributed among the threads of the pool.  The function returns when
+   all chunks have been processed.  The task is executed by the calling
+   thread only if the pool has a single thread, if NUMBER is not larger than
+   the chunk size or if threads are not supported. */
+extern void ydl_pool_run(ydl_task_t *task, void *data, long number);
+
+/* ydl_pool_get_threads yields the number of threads of the pool (including
+   the calling thread), this is an upper bound for the worker indices. */
+extern int ydl_pool_get_threads(void);
+
+/* ydl_pool_get_chunk yields the size of the chunks. */
+extern long ydl_pool_get_chunk(void);
+
+/* ydl_pool_configure sets the number of threads and the size of the chunks,
+   a non-positive value means to leave the corresponding setting unchanged. */
+extern void ydl_pool_configure(int nthreads, long chunk);
+
+/* A job is a function run by its own background thread.  The function is
+   called as FUNC(DATA) and must not touch Yorick's stack. */
+typedef void ydl_job_func_t(void *data);
+typedef struct _ydl_job ydl_job_t;
+
+/* ydl_job_start starts a job.  NULL is returned if no thread can be
+   started (or if threads are not supported); the caller has then to call
+   FUNC(DATA) itself. */
+extern ydl_job_t *ydl_job_start(ydl_job_func_t *func, void *data);
+
+/* ydl_job_done yields whether a job has finished (without blocking). */
+extern int ydl_job_done(ydl_job_t *job);
+
+/* ydl_job_wait waits for a job to finish and releases its resources. */
+extern void ydl_job_wait(ydl_job_t *job);
+
+/* ydl_set_main_thread records the calling thread as the main one (the one
+   running the interpreter), ydl_is_main_thread yields whether the calling
+   thread is the main one (always true if the main thread is not yet
+   recorded or if threads are not supported). */
+extern void ydl_set_main_thread(void);
+extern int ydl_is_main_thread(void);
+
 /*---------------------------------------------------------------------------*/
 
 #endif /* _YDLWRAP_H */